@@ -38,6 +38,29 @@
 #include <sstream>
 #include <string>
 
+/*******************************************************************************
+ * Request classes
+ *******************************************************************************/
+// Class of the request being generated by this thread
+static thread_local uint32_t genReqClass = 0;
+
+void tBenchClientSetReqClass(unsigned cls) {
+    genReqClass = cls;
+}
+
+// Set by clients whose tBenchClientGenReq() may run concurrently
+static bool concurrentGen = false;
+
+void tBenchClientSetConcurrentGen() {
+    concurrentGen = true;
+}
+
+static void genReq(Request* req) {
+    genReqClass = 0;
+    req->len = tBenchClientGenReq(&req->data);
+    req->cls = genReqClass;
+}
+
 /*******************************************************************************
  * Client
  *******************************************************************************/
@@ -56,6 +79,8 @@ Client::Client(int _nthreads) {
     dist = nullptr; // Will get initialized in startReq()
 
     startedReqs = 0;
+    hasReqClasses = false;
+    hasRespAttempts = false;
 
     tBenchClientInit();
 }
@@ -102,11 +127,13 @@ Request* Client::startReq() {
         pthread_barrier_wait(&barrier);
     }
 
+    Request* req = new Request();
+    if (concurrentGen) genReq(req);
+
     pthread_mutex_lock(&lock);
 
-    Request* req = new Request();
-    size_t len = tBenchClientGenReq(&req->data);
-    req->len = len;
+    if (!concurrentGen) genReq(req);
+    if (req->cls != 0) hasReqClasses = true;
 
     req->id = startedReqs++;
 
@@ -150,6 +177,10 @@ void Client::finiReq(Response* resp) {
         queueTimes.push_back(qtime);
         svcTimes.push_back(resp->svcNs);
         sjrnTimes.push_back(sjrn);
+        reqClasses.push_back(req->cls);
+        respAttempts.push_back(resp->attempts);
+        failedTimes.push_back(resp->failedNs);
+        if (resp->attempts != 0) hasRespAttempts = true;
     }
 
     delete req;
@@ -164,6 +195,9 @@ void Client::_startRoi() {
     queueTimes.clear();
     svcTimes.clear();
     sjrnTimes.clear();
+    reqClasses.clear();
+    respAttempts.clear();
+    failedTimes.clear();
 }
 
 void Client::startRoi() {
@@ -185,6 +219,28 @@ void Client::dumpStats() {
                     sizeof(sjrnTimes[r]));
     }
     out.close();
+
+    if (hasReqClasses) {
+        std::ofstream clsOut("lats_classes.bin",
+                std::ios::out | std::ios::binary);
+        for (int r = 0; r < reqs; ++r) {
+            clsOut.write(reinterpret_cast<const char*>(&reqClasses[r]),
+                    sizeof(reqClasses[r]));
+        }
+        clsOut.close();
+    }
+
+    if (hasRespAttempts) {
+        std::ofstream attOut("lats_attempts.bin",
+                std::ios::out | std::ios::binary);
+        for (int r = 0; r < reqs; ++r) {
+            attOut.write(reinterpret_cast<const char*>(&respAttempts[r]),
+                    sizeof(respAttempts[r]));
+            attOut.write(reinterpret_cast<const char*>(&failedTimes[r]),
+                    sizeof(failedTimes[r]));
+        }
+        attOut.close();
+    }
 }
 
 bool Client::getAndClearStats(lats_t lats) {
@@ -214,6 +270,9 @@ bool Client::getAndClearStats(lats_t lats) {
     queueTimes.clear();
     svcTimes.clear();
     sjrnTimes.clear();
+    reqClasses.clear();
+    respAttempts.clear();
+    failedTimes.clear();
     pthread_mutex_unlock(&lock);
     return true;
 }
@@ -239,6 +298,9 @@ void Client::dumpAndClearStats() {
     queueTimes.clear();
     svcTimes.clear();
     sjrnTimes.clear();
+    reqClasses.clear();
+    respAttempts.clear();
+    failedTimes.clear();
     pthread_mutex_unlock(&lock);
 }
 
@@ -50,6 +50,11 @@ class Client {
         std::vector<uint64_t> svcTimes;
         std::vector<uint64_t> queueTimes;
         std::vector<uint64_t> sjrnTimes;
+        std::vector<uint32_t> reqClasses;
+        bool hasReqClasses;
+        std::vector<uint64_t> respAttempts;
+        std::vector<uint64_t> failedTimes;
+        bool hasRespAttempts;
 
         void _startRoi();
 
@@ -28,6 +28,7 @@ enum ResponseType { RESPONSE, ROI_BEGIN, FINISH };
 struct Request {
     uint64_t id;
     uint64_t genNs;
+    uint32_t cls; // Client-assigned request class, see tBenchClientSetReqClass
     size_t len;
     char data[MAX_REQ_BYTES];
 };
@@ -36,6 +37,8 @@ struct Response {
     ResponseType type;
     uint64_t id;
     uint64_t svcNs;
+    uint32_t attempts; // Server-reported, see tBenchSetRespAttempts; 0 if unset
+    uint64_t failedNs;
     size_t len;
     char data[MAX_RESP_BYTES];
 };
@@ -28,11 +28,19 @@
 #include <unordered_map>
 #include <vector>
 
+// Set by tBenchSetRespAttempts() for the next response this thread sends
+struct RespAttempts {
+    uint32_t attempts;
+    uint64_t failedNs;
+};
+extern __thread RespAttempts nextRespAttempts;
+
 class Server {
     protected:
         struct ReqInfo {
             uint64_t id;
             uint64_t startNs;
+            int fd; // Client connection (NetworkedServer only)
         };
 
         uint64_t finishedReqs;
@@ -41,6 +49,16 @@ class Server {
 
         std::vector<ReqInfo> reqInfo; // Request info for each thread 
 
+        // Sends the response to the request described by info
+        virtual void respond(const ReqInfo& info, const void* data,
+                size_t size, const RespAttempts& attempts) = 0;
+
+        static RespAttempts takeRespAttempts() {
+            RespAttempts attempts = nextRespAttempts;
+            nextRespAttempts = RespAttempts();
+            return attempts;
+        }
+
     public:
         Server(int nthreads) {
             finishedReqs = 0;
@@ -50,15 +68,37 @@ class Server {
         }
 
         virtual size_t recvReq(int id, void** data) = 0;
-        virtual void sendResp(int id, const void* data, size_t size) = 0;
+
+        void sendResp(int id, const void* data, size_t size) {
+            respond(reqInfo[id], data, size, takeRespAttempts());
+        }
+
+        // See tBenchReqClient()
+        int reqClient(int id) {
+            return reqInfo[id].fd;
+        }
+
+        // See tBenchDeferResp()
+        void* deferResp(int id) {
+            return new ReqInfo(reqInfo[id]);
+        }
+
+        void sendDeferredResp(void* handle, const void* data, size_t size) {
+            ReqInfo* info = reinterpret_cast<ReqInfo*>(handle);
+            respond(*info, data, size, takeRespAttempts());
+            delete info;
+        }
 };
 
 class IntegratedServer : public Server, public Client {
+    protected:
+        void respond(const ReqInfo& info, const void* data, size_t size,
+                const RespAttempts& attempts);
+
     public:
         IntegratedServer(int nthreads);
 
         size_t recvReq(int id, void** data);
-        void sendResp(int id, const void* data, size_t size);
 };
 
 class NetworkedServer : public Server {
@@ -69,8 +109,6 @@ class NetworkedServer : public Server {
         Request *reqbuf; // One for each server thread
 
         std::vector<int> clientFds;
-        std::vector<int> activeFds; // Currently active client fds for 
-                                    // each thread
         size_t recvClientHead; // The idx of the client at the 'head' of the 
                                // receive queue. We start with this idx and go
                                // down the list of eligible fds to receive from.
@@ -83,12 +121,16 @@ class NetworkedServer : public Server {
         // Helper Functions
         void removeClient(int fd);
         bool checkRecv(int recvd, int expected, int fd);
+
+    protected:
+        void respond(const ReqInfo& info, const void* data, size_t size,
+                const RespAttempts& attempts);
+
     public:
         NetworkedServer(int nthreads, std::string ip, int port, int nclients);
         ~NetworkedServer();
 
         size_t recvReq(int id, void** data);
-        void sendResp(int id, const void* data, size_t size);
         void finish();
 };
 
@@ -27,6 +27,17 @@ void tBenchClientInit();
 
 size_t tBenchClientGenReq(void* data);
 
+// Provided by the harness. May be called from tBenchClientGenReq() to tag the
+// request being generated with an application-defined class (0 by default).
+// When any request is tagged, the client also writes lats_classes.bin, which
+// holds the class of each entry in lats.bin.
+void tBenchClientSetReqClass(unsigned cls);
+
+// Provided by the harness. May be called from tBenchClientInit() to declare
+// that tBenchClientGenReq() is thread safe, so client threads generate
+// requests concurrently, outside the harness lock.
+void tBenchClientSetConcurrentGen();
+
 #ifdef __cplusplus 
 }
 #endif
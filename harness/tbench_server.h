@@ -17,6 +17,7 @@
 #ifndef __TBENCH_SERVER_H
 #define __TBENCH_SERVER_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #ifdef __cplusplus 
@@ -33,6 +34,27 @@ size_t tBenchRecvReq(void** data);
 
 void tBenchSendResp(const void* data, size_t size);
 
+// Returns an id for the client that sent the request this thread received
+// last. Requests sent over one client connection share an id; the integrated
+// server has a single client.
+int tBenchReqClient();
+
+// Detaches the request this thread received last, so that the thread can
+// receive more requests before answering it. Returns a handle for
+// tBenchSendDeferredResp(), which may be called from any thread. The request's
+// service time runs until its response is sent.
+void* tBenchDeferResp();
+
+void tBenchSendDeferredResp(void* handle, const void* data, size_t size);
+
+// Reports how many times the server attempted the request answered by the next
+// tBenchSendResp() or tBenchSendDeferredResp() call of this thread, and how
+// long its failed attempts (e.g., aborted transactions) took, within the
+// service time. When any response reports attempts, the client also writes
+// lats_attempts.bin, which holds the attempts and failed ns (as two uint64s)
+// of each entry in lats.bin.
+void tBenchSetRespAttempts(unsigned attempts, uint64_t failedNs);
+
 #ifdef __cplusplus 
 }
 #endif
@@ -53,21 +53,25 @@ size_t IntegratedServer::recvReq(int id, void** data) {
     uint64_t curNs = getCurNs();
     reqInfo[id].id = req->id;
     reqInfo[id].startNs = curNs;
+    reqInfo[id].fd = -1;
     return req->len;
 };
 
-void IntegratedServer::sendResp(int id, const void* data, size_t len) {
+void IntegratedServer::respond(const ReqInfo& info, const void* data,
+        size_t len, const RespAttempts& attempts) {
     Response* resp = new Response();
     
     resp->type = RESPONSE;
-    resp->id = reqInfo[id].id;
+    resp->id = info.id;
     resp->len = len;
+    resp->attempts = attempts.attempts;
+    resp->failedNs = attempts.failedNs;
     memcpy(reinterpret_cast<void*>(&resp->data), data, len);
 
     uint64_t curNs = getCurNs();
-    assert(curNs > reqInfo[id].startNs);
+    assert(curNs > info.startNs);
 
-    resp->svcNs = curNs - reqInfo[id].startNs;
+    resp->svcNs = curNs - info.startNs;
 
     Client::finiReq(resp);
 
@@ -91,6 +95,7 @@ void IntegratedServer::sendResp(int id, const void* data, size_t len) {
  * Per-thread State
  *******************************************************************************/
 __thread int tid;
+__thread RespAttempts nextRespAttempts;
 
 /*******************************************************************************
  * Global data
@@ -122,3 +127,20 @@ void tBenchSendResp(const void* data, size_t size) {
     return server->sendResp(tid, data, size);
 }
 
+int tBenchReqClient() {
+    return server->reqClient(tid);
+}
+
+void* tBenchDeferResp() {
+    return server->deferResp(tid);
+}
+
+void tBenchSendDeferredResp(void* handle, const void* data, size_t size) {
+    return server->sendDeferredResp(handle, data, size);
+}
+
+void tBenchSetRespAttempts(unsigned attempts, uint64_t failedNs) {
+    nextRespAttempts.attempts = attempts;
+    nextRespAttempts.failedNs = failedNs;
+}
+
@@ -53,8 +53,6 @@ NetworkedServer::NetworkedServer(int nthreads, std::string ip, int port, \
 
     reqbuf = new Request[nthreads]; 
 
-    activeFds.resize(nthreads);
-
     recvClientHead = 0;
 
     // Get address info
@@ -222,7 +220,7 @@ size_t NetworkedServer::recvReq(int id, void** data) {
         uint64_t curNs = getCurNs();
         reqInfo[id].id = req->id;
         reqInfo[id].startNs = curNs;
-        activeFds[id] = fd;
+        reqInfo[id].fd = fd;
 
         *data = reinterpret_cast<void*>(&req->data);
     }
@@ -232,21 +230,24 @@ size_t NetworkedServer::recvReq(int id, void** data) {
     return req->len;
 };
 
-void NetworkedServer::sendResp(int id, const void* data, size_t len) {
+void NetworkedServer::respond(const ReqInfo& info, const void* data,
+        size_t len, const RespAttempts& attempts) {
     pthread_mutex_lock(&sendLock);
 
     Response* resp = new Response();
     
     resp->type = RESPONSE;
-    resp->id = reqInfo[id].id;
+    resp->id = info.id;
     resp->len = len;
+    resp->attempts = attempts.attempts;
+    resp->failedNs = attempts.failedNs;
     memcpy(reinterpret_cast<void*>(&resp->data), data, len);
 
     uint64_t curNs = getCurNs();
-    assert(curNs > reqInfo[id].startNs);
-    resp->svcNs = curNs - reqInfo[id].startNs;
+    assert(curNs > info.startNs);
+    resp->svcNs = curNs - info.startNs;
 
-    int fd = activeFds[id];
+    int fd = info.fd;
     int totalLen = sizeof(Response) - MAX_RESP_BYTES + len;
     int sent = sendfull(fd, reinterpret_cast<const char*>(resp), totalLen, 0);
     assert(sent == totalLen);
@@ -295,6 +296,7 @@ void NetworkedServer::finish() {
  * Per-thread State
  *******************************************************************************/
 __thread int tid;
+__thread RespAttempts nextRespAttempts;
 
 /*******************************************************************************
  * Global data
@@ -329,3 +331,20 @@ void tBenchSendResp(const void* data, size_t size) {
     return server->sendResp(tid, data, size);
 }
 
+int tBenchReqClient() {
+    return server->reqClient(tid);
+}
+
+void* tBenchDeferResp() {
+    return server->deferResp(tid);
+}
+
+void tBenchSendDeferredResp(void* handle, const void* data, size_t size) {
+    return server->sendDeferredResp(handle, data, size);
+}
+
+void tBenchSetRespAttempts(unsigned attempts, uint64_t failedNs) {
+    nextRespAttempts.attempts = attempts;
+    nextRespAttempts.failedNs = failedNs;
+}
+
@@ -16,6 +16,10 @@
 #ifndef KSEARCH_HH
 #define KSEARCH_HH 1
 #include "kpermuter.hh"
+#include <type_traits>
+#if __AVX512F__ || __AVX2__
+#include <immintrin.h>
+#endif
 
 template <typename KA, typename T>
 struct key_comparator {
@@ -304,11 +308,145 @@ struct key_bound_linear {
     }
 };
 
+#if __AVX512F__ || __AVX2__
+/** @brief Compare @a x against @a ikeys[0, @a width) with vector
+    instructions.
+
+    Sets bit i of @a lt if ikeys[i] < x and bit i of @a eq if ikeys[i] == x,
+    comparing as unsigned. Lanes past @a width are never loaded. */
+template <int width>
+inline void ikey_compare_masks(const uint64_t *ikeys, uint64_t x,
+			       unsigned &lt, unsigned &eq)
+{
+    lt = eq = 0;
+#if __AVX512F__
+    __m512i k = _mm512_set1_epi64(x);
+    for (int i = 0; i < width; i += 8) {
+	__mmask8 valid = width - i >= 8 ? 0xFF : (1U << (width - i)) - 1;
+	__m512i v = _mm512_maskz_loadu_epi64(valid, ikeys + i);
+	lt |= unsigned(_mm512_mask_cmplt_epu64_mask(valid, v, k)) << i;
+	eq |= unsigned(_mm512_mask_cmpeq_epu64_mask(valid, v, k)) << i;
+    }
+#else
+    // AVX2 only compares signed, so flip the sign bits first
+    const __m256i sign = _mm256_set1_epi64x(0x8000000000000000LL);
+    __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(x), sign);
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+	__m256i v = _mm256_loadu_si256((const __m256i *) (ikeys + i));
+	v = _mm256_xor_si256(v, sign);
+	lt |= unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(
+			   _mm256_cmpgt_epi64(k, v)))) << i;
+	eq |= unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(
+			   _mm256_cmpeq_epi64(k, v)))) << i;
+    }
+    if (width % 4) {
+	const int n = width % 4;
+	__m256i valid = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n),
+					   _mm256_setr_epi64x(0, 1, 2, 3));
+	__m256i v = _mm256_maskload_epi64((const long long *) ikeys + i, valid);
+	v = _mm256_xor_si256(v, sign);
+	unsigned m = (1U << n) - 1;
+	lt |= (unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(
+			    _mm256_cmpgt_epi64(k, v)))) & m) << i;
+	eq |= (unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(
+			    _mm256_cmpeq_epi64(k, v)))) & m) << i;
+    }
+#endif
+}
+
+template <typename KA>
+inline uint64_t key_ikey(const KA &ka) {
+    return ka.ikey();
+}
+inline uint64_t key_ikey(uint64_t ikey) {
+    return ikey;
+}
+
+/** @brief Vectorized node search over 64-bit ikeys.
+
+    Compares the search key's ikey against every slot at once, then resolves
+    equal ikeys (keys that differ past the first 8 bytes) with the usual
+    comparator. Forms with versions or custom comparators use binary
+    search. */
+struct key_bound_simd : public key_bound_binary {
+    using key_bound_binary::upper;
+    using key_bound_binary::lower_with_position;
+    using key_bound_binary::lower_check;
+
+    // Internode keys are sorted and distinct, and compare by ikey alone, so
+    // the upper bound is the number of keys <= the search key.
+    template <typename KA, typename T>
+    static inline int upper(const KA &ka, const T &n) {
+	static_assert(!has_permuter_type<T>::value, "internodes only");
+	unsigned lt, eq;
+	ikey_compare_masks<T::width>(n.ikey0_, key_ikey(ka), lt, eq);
+	return __builtin_popcount((lt | eq) & ((1U << n.size()) - 1));
+    }
+
+    template <typename KA, typename T>
+    static inline int lower(const KA &ka, const T &n) {
+	int position;
+	return lower_with_position(ka, n, position);
+    }
+
+    template <typename KA, typename T>
+    static inline int lower_with_position(const KA &ka, const T &n, int &position) {
+	unsigned active, lt, eq;
+	slot_masks(ka, n, active, lt, eq);
+	int l = __builtin_popcount(lt);
+	for (position = -1; eq; eq &= eq - 1) {
+	    int p = __builtin_ctz(eq);
+	    int cmp = key_compare(ka, n, p);
+	    if (cmp == 0)
+		position = p;
+	    else if (cmp > 0)
+		++l;
+	}
+	return l;
+    }
+
+    template <typename KA, typename T>
+    static inline int lower_check(const KA &ka, const T &n) {
+	unsigned active, lt, eq;
+	slot_masks(ka, n, active, lt, eq);
+	int l = __builtin_popcount(lt);
+	for (; eq; eq &= eq - 1) {
+	    int p = __builtin_ctz(eq);
+	    int cmp = key_compare(ka, n, p);
+	    if (cmp == 0)
+		return p;
+	    else if (cmp > 0)
+		++l;
+	}
+	return -l - 1;
+    }
+
+  private:
+    // Masks over physical slots: active slots, and active slots whose ikey is
+    // less than or equal to the search key's
+    template <typename KA, typename T>
+    static inline void slot_masks(const KA &ka, const T &n, unsigned &active,
+				  unsigned &lt, unsigned &eq) {
+	typename key_permuter<T>::type perm = key_permuter<T>::permutation(n);
+	// The permutation lists free slots after the active ones, and leaves
+	// are usually more than half full, so clear the free slots
+	active = (1U << T::width) - 1;
+	for (int i = perm.size(); i < T::width; ++i)
+	    active &= ~(1U << perm[i]);
+	ikey_compare_masks<T::width>(n.ikey0_, key_ikey(ka), lt, eq);
+	lt &= active;
+	eq &= active;
+    }
+};
+#endif
+
 
 enum {
     bound_method_fast = 0,
     bound_method_binary,
-    bound_method_linear
+    bound_method_linear,
+    bound_method_simd		// binary search if not built with AVX2/AVX-512
 };
 template <int max_size, int method = bound_method_fast> struct key_bound {};
 template <int max_size> struct key_bound<max_size, bound_method_binary> {
@@ -317,6 +455,14 @@ template <int max_size> struct key_bound<max_size, bound_method_binary> {
 template <int max_size> struct key_bound<max_size, bound_method_linear> {
     typedef key_bound_linear type;
 };
+template <int max_size> struct key_bound<max_size, bound_method_simd> {
+#if __AVX512F__ || __AVX2__
+    typedef typename std::conditional<(max_size <= 16), key_bound_simd,
+				      key_bound_binary>::type type;
+#else
+    typedef key_bound_binary type;
+#endif
+};
 template <int max_size> struct key_bound<max_size, bound_method_fast> {
     typedef typename key_bound<max_size, (max_size > 16 ? bound_method_binary : bound_method_linear)>::type type;
 };
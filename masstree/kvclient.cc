@@ -1,9 +1,17 @@
+#include "getopt.h"
 #include "kvrandom.hh"
 #include "mttest.hh"
 #include "str.hh"
 #include "tbench_client.h"
+#include "ycsb.hh"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
 #include <vector>
 
 /*******************************************************************************
@@ -52,18 +60,195 @@ const Request* Client::getReq() {
     return &req;
 }
 
+// Zipfian over [0, n) with constant theta, as YCSB's ZipfianGenerator (Gray
+// et al., "Quickly Generating Billion-Record Synthetic Databases"). n may grow
+// between draws; zeta(n) is then extended incrementally.
+class ZipfianGenerator {
+    private:
+        double theta;
+        double alpha;
+        double zeta2;
+        double zetan;
+        double eta;
+        uint64_t n;
+
+        static double zeta(uint64_t from, uint64_t to, double theta) {
+            double sum = 0;
+            for (uint64_t i = from; i < to; ++i) sum += 1.0 / pow(i + 1, theta);
+            return sum;
+        }
+
+        void grow(uint64_t newN) {
+            zetan += zeta(n, newN, theta);
+            n = newN;
+            eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+        }
+
+    public:
+        // zetan, if known, saves computing it for large n
+        ZipfianGenerator(uint64_t n, double theta, double zetan = 0)
+            : theta(theta), alpha(1 / (1 - theta)), zeta2(zeta(0, 2, theta)),
+              zetan(zetan), n(zetan > 0 ? n : 0)
+        {
+            grow(n);
+        }
+
+        // u is uniform in [0, 1)
+        uint64_t next(double u, uint64_t count) {
+            if (count > n) grow(count);
+            double uz = u * zetan;
+            if (uz < 1) return 0;
+            if (uz < 1 + pow(0.5, theta)) return 1;
+            return std::min<uint64_t>(n * pow(eta * u - eta + 1, alpha), n - 1);
+        }
+};
+
+enum KeyDist { UNIFORM, ZIPFIAN, LATEST };
+
+struct YcsbWorkload {
+    char name;
+    double props[YCSB_NUM_OPS]; // indexed by YcsbOp
+    KeyDist dist;
+};
+
+// Op proportions are listed in YcsbOp order: -, read, update, insert, scan,
+// read-modify-write, delete
+static const YcsbWorkload ycsbWorkloads[] = {
+    { 'A', { 0, 0.50, 0.50, 0,    0,    0,    0 }, ZIPFIAN },
+    { 'B', { 0, 0.95, 0.05, 0,    0,    0,    0 }, ZIPFIAN },
+    { 'C', { 0, 1.00, 0,    0,    0,    0,    0 }, ZIPFIAN },
+    { 'D', { 0, 0.95, 0,    0.05, 0,    0,    0 }, LATEST },
+    { 'E', { 0, 0,    0,    0.05, 0.95, 0,    0 }, ZIPFIAN },
+    { 'F', { 0, 0.50, 0,    0,    0,    0.50, 0 }, ZIPFIAN },
+};
+
+// Generates YCSB core workload operations (Cooper et al., SoCC 2010). Each
+// request holds a batch of operations of one type and is tagged with that
+// type, so latencies can be split by op type; with the default batch of 1,
+// each request is a single operation.
+class YcsbClient {
+    private:
+        // YCSB's ScrambledZipfianGenerator draws from a fixed 10^10 items
+        static constexpr uint64_t SCRAMBLED_ITEMS = 10000000000ULL;
+        static constexpr double SCRAMBLED_ZETAN = 26.46902820178302;
+        static constexpr double ZIPF_THETA = 0.99;
+
+        YcsbConfig config;
+        std::vector<double> opCdf; // opCdf[i]: P(op <= i)
+        KeyDist dist;
+        ZipfianGenerator* zipf;
+        uint64_t insertCount; // records 0..insertCount-1 have been issued
+        int batch;
+        std::mt19937_64 rng;
+        std::uniform_real_distribution<double> uniform;
+
+        uint64_t nextKeynum() {
+            switch (dist) {
+            case UNIFORM:
+                return rng() % insertCount;
+            case ZIPFIAN:
+                return ycsbHash(zipf->next(uniform(rng), SCRAMBLED_ITEMS)) %
+                    insertCount;
+            case LATEST:
+            default:
+                return insertCount - 1 - zipf->next(uniform(rng), insertCount);
+            }
+        }
+
+    public:
+        YcsbClient(char workload, std::string distName, double deleteFrac,
+                int batch, unsigned long seed)
+            : config(YcsbConfig::fromEnv()), opCdf(YCSB_NUM_OPS, 0.0),
+              insertCount(config.recordCount), batch(batch), rng(seed),
+              uniform(0.0, 1.0)
+        {
+            const YcsbWorkload* w = nullptr;
+            for (const YcsbWorkload& cand : ycsbWorkloads)
+                if (cand.name == toupper(workload)) w = &cand;
+            if (!w) {
+                std::cerr << "Unknown YCSB workload " << workload << std::endl;
+                exit(-1);
+            }
+            if (batch < 1 || batch > ycsbMaxBatch) {
+                std::cerr << "YCSB batch must be in [1, " << ycsbMaxBatch
+                    << "]" << std::endl;
+                exit(-1);
+            }
+
+            double sum = 0;
+            for (int op = YCSB_READ; op < YCSB_NUM_OPS; ++op) {
+                sum += (op == YCSB_DELETE) ? deleteFrac : w->props[op];
+                opCdf[op] = sum;
+            }
+            for (auto& c : opCdf) c /= sum;
+
+            dist = w->dist;
+            if (distName == "uniform") dist = UNIFORM;
+            else if (distName == "zipfian") dist = ZIPFIAN;
+            else if (distName == "latest") dist = LATEST;
+            else if (!distName.empty()) {
+                std::cerr << "Unknown key distribution " << distName
+                    << std::endl;
+                exit(-1);
+            }
+
+            if (dist == ZIPFIAN)
+                zipf = new ZipfianGenerator(SCRAMBLED_ITEMS, ZIPF_THETA,
+                        SCRAMBLED_ZETAN);
+            else if (dist == LATEST)
+                zipf = new ZipfianGenerator(insertCount, ZIPF_THETA);
+            else
+                zipf = nullptr;
+        }
+
+        size_t genReq(void* data) {
+            YcsbOp op = static_cast<YcsbOp>(std::upper_bound(opCdf.begin(),
+                        opCdf.end(), uniform(rng)) - opCdf.begin());
+            if (op >= YCSB_NUM_OPS) op = YCSB_READ;
+            tBenchClientSetReqClass(op);
+
+            YcsbRequest* reqs = reinterpret_cast<YcsbRequest*>(data);
+            for (int i = 0; i < batch; ++i) {
+                YcsbRequest& req = reqs[i];
+                req.op = op;
+                req.scanLen = (op == YCSB_SCAN) ? \
+                              1 + rng() % config.maxScanLength : 0;
+                ycsbBuildKey(op == YCSB_INSERT ? insertCount++ : nextKeynum(),
+                        req.key);
+            }
+
+            return batch * sizeof(YcsbRequest);
+        }
+};
+
+constexpr uint64_t YcsbClient::SCRAMBLED_ITEMS;
+constexpr double YcsbClient::SCRAMBLED_ZETAN;
+constexpr double YcsbClient::ZIPF_THETA;
+
 /*******************************************************************************
  * Global State
  *******************************************************************************/
 Client* Client::singleton = nullptr;
+YcsbClient* ycsbClient = nullptr;
 
 /*******************************************************************************
  * API
  *******************************************************************************/
 
-void tBenchClientInit() {}
+void tBenchClientInit() {
+    std::string workload = getOpt<std::string>("TBENCH_YCSB_WORKLOAD", "");
+    if (workload.empty()) return; // mycsba
+
+    std::string dist = getOpt<std::string>("TBENCH_YCSB_DIST", "");
+    double deleteFrac = getOpt<double>("TBENCH_YCSB_DELETE_FRAC", 0.0);
+    int batch = getOpt<int>("TBENCH_YCSB_BATCH", 1);
+    unsigned long seed = getOpt<unsigned long>("TBENCH_YCSB_SEED", mycsbaSeed);
+    ycsbClient = new YcsbClient(workload[0], dist, deleteFrac, batch, seed);
+}
 
 size_t tBenchClientGenReq(void* data) {
+    if (ycsbClient) return ycsbClient->genReq(data);
+
     Client* client = Client::getSingleton();
     char* cur = reinterpret_cast<char*>(data);
 
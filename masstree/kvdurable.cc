@@ -0,0 +1,675 @@
+/* Masstree
+ * Eddie Kohler, Yandong Mao, Robert Morris
+ * Copyright (c) 2012-2013 President and Fellows of Harvard College
+ * Copyright (c) 2012-2013 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Masstree LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Masstree LICENSE file; the license in that file
+ * is legally binding.
+ */
+#include "kvdurable.hh"
+#include "log.hh"
+#include "checkpoint.hh"
+#include "file.hh"
+#include "json.hh"
+#include "masstree_query.hh"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <algorithm>
+
+enum { CKState_Quit, CKState_Uninit, CKState_Ready, CKState_Go };
+
+extern Masstree::default_table *tree;
+
+static int nlogger = 0;
+static int nckthreads = 0;
+static const char *logdir[MaxCores];
+static const char *ckpdir[MaxCores];
+static int nlogdir = 0;
+static int nckpdir = 0;
+
+static logset* logs;
+
+static double checkpoint_interval = -1;
+static bool partitioned_replay = false;
+static kvepoch_t ckp_gen = 0; // recover from checkpoint
+static ckstate *cks = NULL; // checkpoint status of all checkpointing threads
+static volatile bool ckp_quit = false;
+static pthread_cond_t rec_cond = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t rec_mu = PTHREAD_MUTEX_INITIALIZER;
+static int rec_nactive;
+static int rec_state = REC_NONE;
+static uint64_t rec_ckp_nrecords;
+static uint64_t rec_ckp_nbytes;
+
+static pthread_cond_t checkpoint_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t checkpoint_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t traverse_checkpoint_inorder(uint64_t off, uint64_t n,
+                                            char *base, uint64_t *ind,
+                                            uint64_t max, threadinfo *ti);
+static void *conc_checkpointer(void *);
+
+static void make_dir(const char* dir) {
+    struct stat sb;
+    int r = stat(dir, &sb);
+    if (r < 0 && errno == ENOENT) {
+	r = mkdir(dir, 0777);
+	if (r < 0) {
+	    fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+	    mandatory_assert(0);
+	}
+    }
+}
+
+static String log_filename(const char* logdir, int logindex) {
+    make_dir(logdir);
+
+    StringAccum sa;
+    sa.snprintf(strlen(logdir) + 24, "%s/kvd-log-%d", logdir, logindex);
+    return sa.take_string();
+}
+
+static void log_init() {
+  int ret, i;
+
+  logs = logset::make(nlogger);
+  for (i = 0; i < nlogger; i++)
+      logs->log(i).initialize(log_filename(logdir[i % nlogdir], i));
+
+  cks = (ckstate *)malloc(sizeof(ckstate) * nckthreads);
+  for (i = 0; i < nckthreads; i++) {
+    threadinfo *ti = threadinfo::make(threadinfo::TI_CHECKPOINT, i);
+    cks[i].state = CKState_Uninit;
+    cks[i].ti = ti;
+    ret = pthread_create(&ti->ti_threadid, 0, conc_checkpointer, ti);
+    mandatory_assert(ret == 0);
+  }
+}
+
+// p points to key\0val\0
+static void insert_from_checkpoint(char *p, threadinfo *ti) {
+    int keylen = strlen(p);
+    mandatory_assert(keylen >= 0 && keylen < MaxKeyLen);
+    kvtimestamp_t ts = *(kvtimestamp_t*)(p + keylen + 1);
+    int vlen = *(int*)(p + keylen + 1 + sizeof(ts));
+    Str key(p, keylen);
+    Str value(p + keylen + 1 + sizeof(ts) + sizeof(vlen), vlen);
+    tree->checkpoint_restore(key, value, ts, ti);
+}
+
+// read a checkpoint, insert key/value pairs into tree.
+// must be followed by a read of the log!
+// since checkpoint is not consistent
+// with any one point in time.
+// returns the timestamp of the first log record that needs
+// to come from the log.
+static kvepoch_t read_checkpoint(threadinfo *ti, const char *path) {
+  double t0 = now();
+
+  int fd = open(path, 0);
+  if(fd < 0){
+    printf("no %s\n", path);
+    return 0;
+  }
+  struct stat sb;
+  int ret = fstat(fd, &sb);
+  mandatory_assert(ret == 0);
+  char *p = (char *) mmap(0, sb.st_size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
+  mandatory_assert(p != MAP_FAILED);
+  close(fd);
+
+  uint64_t gen = *(uint64_t *)p;
+  uint64_t n = *(uint64_t *)(p + 8);
+  printf("reading checkpoint with %" PRIu64 " nodes\n", n);
+
+  char *keyjunk = p + 2*8; // array of key prefixes, ignore for now
+  uint64_t *ind = (uint64_t *)(keyjunk + CkpKeyPrefixLen*n);
+  char *keyval = (char *)(ind + n);
+  query<row_type> q;
+
+  // round n up to power of two
+  uint64_t n2 = pow(2, ceil(log(n) / log(2)));
+  mandatory_assert(n2 >= n);
+  traverse_checkpoint_inorder(0, n2, keyval, ind, n, ti);
+  munmap(p, sb.st_size);
+  fetch_and_add(&rec_ckp_nrecords, n);
+  fetch_and_add(&rec_ckp_nbytes, (uint64_t) sb.st_size);
+
+  double t1 = now();
+
+  printf("%.1f MB, %.2f sec, %.1f MB/sec\n",
+         sb.st_size / 1000000.0,
+         t1 - t0,
+         (sb.st_size / 1000000.0) / (t1 - t0));
+
+  return gen;
+}
+
+void
+waituntilphase(int phase)
+{
+  mandatory_assert(pthread_mutex_lock(&rec_mu) == 0);
+  while (rec_state != phase)
+    mandatory_assert(pthread_cond_wait(&rec_cond, &rec_mu) == 0);
+  mandatory_assert(pthread_mutex_unlock(&rec_mu) == 0);
+}
+
+void
+inactive(void)
+{
+  mandatory_assert(pthread_mutex_lock(&rec_mu) == 0);
+  rec_nactive --;
+  mandatory_assert(pthread_cond_broadcast(&rec_cond) == 0);
+  mandatory_assert(pthread_mutex_unlock(&rec_mu) == 0);
+}
+
+static uint64_t
+traverse_checkpoint_inorder(uint64_t off, uint64_t n,
+                            char *base, uint64_t *ind, uint64_t max,
+                            threadinfo *ti)
+{
+    mandatory_assert(off == 0);
+    for (uint64_t i = 0; i < max; i++)
+        insert_from_checkpoint(base + ind[i], ti);
+    return n;
+}
+
+static void recovercheckpoint(threadinfo *ti) {
+    waituntilphase(REC_CKP);
+    char path[256];
+    sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d", ckpdir[ti->ti_index % nckpdir],
+            ckp_gen.value(), ti->ti_index);
+    kvepoch_t gen = read_checkpoint(ti, path);
+    mandatory_assert(ckp_gen == gen);
+    inactive();
+}
+
+void
+recphase(int nactive, int state)
+{
+  rec_nactive = nactive;
+  rec_state = state;
+  mandatory_assert(pthread_cond_broadcast(&rec_cond) == 0);
+  while (rec_nactive)
+    mandatory_assert(pthread_cond_wait(&rec_cond, &rec_mu) == 0);
+}
+
+// read the checkpoint file.
+// read each log file.
+// insert will ignore attempts to update with timestamps
+// less than what was in the entry from the checkpoint file.
+// so we don't have to do an explicit merge by time of the log files.
+static void
+recover(threadinfo *, durable_recovery_stats *stats)
+{
+  recovering = true;
+  // XXX: discard temporary checkpoint and ckp-gen files generated before crash
+
+  // get the generation of the checkpoint from ckp-gen, if any
+  char path[256];
+  sprintf(path, "%s/kvd-ckp-gen", ckpdir[0]);
+  ckp_gen = 0;
+  rec_ckp_min_epoch = rec_ckp_max_epoch = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd >= 0) {
+      Json ckpj = Json::parse(read_file_contents(fd));
+      close(fd);
+      if (ckpj && ckpj["kvdb_checkpoint"] && ckpj["generation"].is_number()) {
+	  ckp_gen = ckpj["generation"].to_u64();
+	  rec_ckp_min_epoch = ckpj["min_epoch"].to_u64();
+	  rec_ckp_max_epoch = ckpj["max_epoch"].to_u64();
+	  printf("recover from checkpoint %" PRIu64 " [%" PRIu64 ", %" PRIu64 "]\n", ckp_gen.value(), rec_ckp_min_epoch.value(), rec_ckp_max_epoch.value());
+      }
+  } else {
+    printf("no %s\n", path);
+  }
+  mandatory_assert(pthread_mutex_lock(&rec_mu) == 0);
+
+  // recover from checkpoint, and set timestamp of the checkpoint
+  double t0 = now();
+  recphase(nckthreads, REC_CKP);
+  double t1 = now();
+
+  // find minimum maximum timestamp of entries in each log
+  rec_log_infos = new logreplay::info_type[nlogger];
+  if (partitioned_replay)
+      rec_log_replays.assign(nlogger, (logreplay *) 0);
+  recphase(nlogger, REC_LOG_TS);
+
+  // For partitioned replay, cut the sampled keys into one key range per
+  // logger, each holding about the same number of log records.
+  if (partitioned_replay) {
+      std::sort(rec_replay_keys.begin(), rec_replay_keys.end());
+      std::vector<Str> bounds;
+      if (!rec_replay_keys.empty())
+	  for (int i = 1; i < nlogger; ++i)
+	      bounds.push_back(rec_replay_keys[rec_replay_keys.size() * i / nlogger]);
+      rec_replay_keys.swap(bounds);
+  }
+
+  // replay log entries, remove inconsistent entries, and append
+  // an empty log entry with minimum timestamp
+
+  // calculate log range
+
+  // Maximum epoch seen in the union of the logs and the checkpoint. (We
+  // don't commit a checkpoint until all logs are flushed past the
+  // checkpoint's max_epoch.)
+  kvepoch_t max_epoch = rec_ckp_max_epoch;
+  if (max_epoch)
+      max_epoch = max_epoch.next_nonzero();
+  for (logreplay::info_type *it = rec_log_infos;
+       it != rec_log_infos + nlogger; ++it)
+      if (it->last_epoch
+	  && (!max_epoch || max_epoch < it->last_epoch))
+	  max_epoch = it->last_epoch;
+
+  // Maximum first_epoch seen in the logs. Full log information is not
+  // available for epochs before max_first_epoch.
+  kvepoch_t max_first_epoch = 0;
+  for (logreplay::info_type *it = rec_log_infos;
+       it != rec_log_infos + nlogger; ++it)
+      if (it->first_epoch
+	  && (!max_first_epoch || max_first_epoch < it->first_epoch))
+	  max_first_epoch = it->first_epoch;
+
+  // Maximum epoch of all logged wake commands.
+  kvepoch_t max_wake_epoch = 0;
+  for (logreplay::info_type *it = rec_log_infos;
+       it != rec_log_infos + nlogger; ++it)
+      if (it->wake_epoch
+	  && (!max_wake_epoch || max_wake_epoch < it->wake_epoch))
+	  max_wake_epoch = it->wake_epoch;
+
+  // Minimum last_epoch seen in QUIESCENT logs.
+  kvepoch_t min_quiescent_last_epoch = 0;
+  for (logreplay::info_type *it = rec_log_infos;
+       it != rec_log_infos + nlogger; ++it)
+      if (it->quiescent
+	  && (!min_quiescent_last_epoch || min_quiescent_last_epoch > it->last_epoch))
+	  min_quiescent_last_epoch = it->last_epoch;
+
+  // If max_wake_epoch && min_quiescent_last_epoch <= max_wake_epoch, then a
+  // wake command was missed by at least one quiescent log. We can't replay
+  // anything at or beyond the minimum missed wake epoch. So record, for
+  // each log, the minimum wake command that at least one quiescent thread
+  // missed.
+  if (max_wake_epoch && min_quiescent_last_epoch <= max_wake_epoch)
+      rec_replay_min_quiescent_last_epoch = min_quiescent_last_epoch;
+  else
+      rec_replay_min_quiescent_last_epoch = 0;
+  recphase(nlogger, REC_LOG_ANALYZE_WAKE);
+
+  // Calculate upper bound of epochs to replay.
+  // This is the minimum of min_post_quiescent_wake_epoch (if any) and the
+  // last_epoch of all non-quiescent logs.
+  rec_replay_max_epoch = max_epoch;
+  for (logreplay::info_type *it = rec_log_infos;
+       it != rec_log_infos + nlogger; ++it) {
+      if (!it->quiescent
+          && it->last_epoch
+	  && it->last_epoch < rec_replay_max_epoch)
+	  rec_replay_max_epoch = it->last_epoch;
+      if (it->min_post_quiescent_wake_epoch
+          && it->min_post_quiescent_wake_epoch < rec_replay_max_epoch)
+          rec_replay_max_epoch = it->min_post_quiescent_wake_epoch;
+  }
+
+  // Calculate lower bound of epochs to replay.
+  rec_replay_min_epoch = rec_ckp_min_epoch;
+  // XXX what about max_first_epoch?
+
+  // Checks.
+  if (rec_ckp_min_epoch) {
+      mandatory_assert(rec_ckp_min_epoch > max_first_epoch);
+      mandatory_assert(rec_ckp_min_epoch < rec_replay_max_epoch);
+      mandatory_assert(rec_ckp_max_epoch < rec_replay_max_epoch);
+      fprintf(stderr, "replay [%" PRIu64 ",%" PRIu64 ") from [%" PRIu64 ",%" PRIu64 ") into ckp [%" PRIu64 ",%" PRIu64 "]\n",
+	      rec_replay_min_epoch.value(), rec_replay_max_epoch.value(),
+	      max_first_epoch.value(), max_epoch.value(),
+	      rec_ckp_min_epoch.value(), rec_ckp_max_epoch.value());
+  }
+
+  // Actually replay.
+  delete[] rec_log_infos;
+  rec_log_infos = 0;
+  double t2 = now();
+  recphase(nlogger, REC_LOG_REPLAY);
+  if (partitioned_replay) {
+      recphase(nlogger, REC_LOG_APPLY);
+      recphase(nlogger, REC_LOG_CLEAN);
+      rec_log_replays.clear();
+      rec_replay_keys.clear();
+  }
+  double t3 = now();
+
+  // done recovering
+  recphase(0, REC_DONE);
+#if !NDEBUG
+  // check that all delta markers have been recycled (leaving only remove
+  // markers and real values)
+  uint64_t deltas_created = 0, deltas_removed = 0;
+  for (threadinfo *ti = threadinfo::allthreads; ti; ti = ti->ti_next) {
+      deltas_created += ti->pstat.deltas_created;
+      deltas_removed += ti->pstat.deltas_removed;
+  }
+  if (deltas_created)
+      fprintf(stderr, "deltas created: %" PRIu64 ", removed: %" PRIu64 "\n", deltas_created, deltas_removed);
+  mandatory_assert(deltas_created == deltas_removed);
+#endif
+
+  global_log_epoch = rec_replay_max_epoch.next_nonzero();
+
+  mandatory_assert(pthread_mutex_unlock(&rec_mu) == 0);
+  recovering = false;
+
+  if (stats) {
+      stats->ckp_records = rec_ckp_nrecords;
+      stats->ckp_bytes = rec_ckp_nbytes;
+      stats->ckp_time = t1 - t0;
+      stats->log_records = rec_replay_nrecords;
+      stats->log_bytes = rec_replay_nbytes;
+      stats->log_applied = rec_replay_napplied;
+      stats->log_time = t3 - t2;
+  }
+}
+
+static void
+writecheckpoint(const char *path, ckstate *c, double t0)
+{
+  double t1 = now();
+  printf("memory phase: %" PRIu64 " nodes, %.2f sec\n", c->count, t1 - t0);
+
+  int fd = creat(path, 0666);
+  mandatory_assert(fd >= 0);
+
+  // checkpoint file format:
+  //   ckp_gen (64 bits)
+  //   #keys (64 bits)
+  //   #keys * CKKEYLEN key prefixes, in lexical order
+  //   #keys * CKKEYLEN 64-bit indices, in lexical order, into...
+  //   key/val pairs
+
+  checked_write(fd, &ckp_gen, sizeof(ckp_gen));
+  checked_write(fd, &c->count, sizeof(c->count));
+  checked_write(fd, c->keys->buf, c->keys->n);
+  checked_write(fd, c->ind->buf, c->ind->n);
+  checked_write(fd, c->vals->buf, c->vals->n);
+
+  int ret = fsync(fd);
+  mandatory_assert(ret == 0);
+  ret = close(fd);
+  mandatory_assert(ret == 0);
+
+  double t2 = now();
+  c->bytes = c->keys->n + c->ind->n + c->vals->n;
+  printf("file phase (%s): %" PRIu64 " bytes, %.2f sec, %.1f MB/sec\n",
+         path,
+         c->bytes,
+         t2 - t1,
+         (c->bytes / 1000000.0) / (t2 - t1));
+}
+
+static void
+conc_filecheckpoint(threadinfo *ti)
+{
+  ckstate *c = &cks[ti->ti_index];
+  c->keys = new_bufkvout();
+  c->vals = new_bufkvout();
+  c->ind = new_bufkvout();
+  double t0 = now();
+  tree->scan(c->q, ti);
+  char path[256];
+  sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d", ckpdir[ti->ti_index % nckpdir],
+          ckp_gen.value(), ti->ti_index);
+  writecheckpoint(path, c, t0);
+  c->count = 0;
+  free(c->keys);
+  free(c->vals);
+  free(c->ind);
+}
+
+static Json
+prepare_checkpoint(kvepoch_t min_epoch, int nckthreads, const Str *pv)
+{
+    Json j;
+    j.set("kvdb_checkpoint", true)
+	.set("min_epoch", min_epoch.value())
+	.set("max_epoch", global_log_epoch.value())
+	.set("generation", ckp_gen.value())
+	.set("nckthreads", nckthreads);
+
+    Json pvj;
+    for (int i = 1; i < nckthreads; ++i)
+	pvj.push_back(Json::make_string(pv[i].s, pv[i].len));
+    j.set("pivots", pvj);
+
+    return j;
+}
+
+static void
+commit_checkpoint(Json ckpj)
+{
+    // atomically commit a set of checkpoint files by incrementing
+    // the checkpoint generation on disk
+    char path[256];
+    sprintf(path, "%s/kvd-ckp-gen", ckpdir[0]);
+    int r = atomic_write_file_contents(path, ckpj.unparse());
+    mandatory_assert(r == 0);
+    fprintf(stderr, "kvd-ckp-%" PRIu64 " [%s,%s]: committed\n",
+	    ckp_gen.value(), ckpj["min_epoch"].to_s().c_str(),
+	    ckpj["max_epoch"].to_s().c_str());
+
+    // delete old checkpoint files
+    for (int i = 0; i < nckthreads; i++) {
+	char path[256];
+	sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d", ckpdir[i % nckpdir],
+		ckp_gen.value() - 1, i);
+	unlink(path);
+    }
+}
+
+static kvepoch_t
+max_flushed_epoch()
+{
+    kvepoch_t mfe = 0, ge = global_log_epoch;
+    for (int i = 0; i < nlogger; ++i) {
+        loginfo& log = logs->log(i);
+	kvepoch_t fe = log.quiescent() ? ge : log.flushed_epoch();
+	if (!mfe || fe < mfe)
+	    mfe = fe;
+    }
+    return mfe;
+}
+
+// concurrent periodic checkpoint
+static void *
+conc_checkpointer(void *xarg)
+{
+  threadinfo *ti = (threadinfo *) xarg;
+  ti->enter();
+  recovercheckpoint(ti);
+  ckstate *c = &cks[ti->ti_index];
+  c->count = 0;
+  pthread_cond_init(&c->state_cond, NULL);
+  c->state = CKState_Ready;
+  while (recovering)
+    sleep(1);
+  if (checkpoint_interval <= 0)
+      return 0;
+  if (ti->ti_index == 0) {
+    for (int i = 1; i < nckthreads; i++)
+      while (cks[i].state != CKState_Ready)
+        ;
+    Str *pv = new Str[nckthreads + 1];
+    Json uncommitted_ckp;
+
+    while (1) {
+      struct timespec ts;
+      set_timespec(ts, now() + (uncommitted_ckp ? 0.25 : checkpoint_interval));
+
+      pthread_mutex_lock(&checkpoint_mu);
+      if (!ckp_quit)
+        pthread_cond_timedwait(&checkpoint_cond, &checkpoint_mu, &ts);
+      if (ckp_quit) {
+          for (int i = 0; i < nckthreads; i++) {
+              cks[i].state = CKState_Quit;
+              pthread_cond_signal(&cks[i].state_cond);
+          }
+          pthread_mutex_unlock(&checkpoint_mu);
+          break;
+      }
+      pthread_mutex_unlock(&checkpoint_mu);
+
+      if (uncommitted_ckp) {
+	  kvepoch_t mfe = max_flushed_epoch();
+	  if (!mfe || mfe > uncommitted_ckp["max_epoch"].to_u64()) {
+	      commit_checkpoint(uncommitted_ckp);
+	      uncommitted_ckp = Json();
+	  }
+	  continue;
+      }
+
+      double t0 = now();
+      ti->rcu_start();
+      for (int i = 0; i < nckthreads + 1; i++)
+        pv[i].assign(NULL, 0);
+      tree->findpivots(pv, nckthreads + 1);
+      ti->rcu_stop();
+
+      kvepoch_t min_epoch = global_log_epoch;
+      pthread_mutex_lock(&checkpoint_mu);
+      ckp_gen = ckp_gen.next_nonzero();
+      for (int i = 0; i < nckthreads; i++) {
+	  Str endkey = (i == nckthreads - 1 ? Str() : pv[i + 1]);
+	  cks[i].q.begin_checkpoint(&cks[i], pv[i], endkey);
+	  cks[i].state = CKState_Go;
+	  pthread_cond_signal(&cks[i].state_cond);
+      }
+      pthread_mutex_unlock(&checkpoint_mu);
+
+      ti->rcu_start();
+      conc_filecheckpoint(ti);
+      ti->rcu_stop();
+
+      cks[0].state = CKState_Ready;
+      uint64_t bytes = cks[0].bytes;
+      pthread_mutex_lock(&checkpoint_mu);
+      for (int i = 1; i < nckthreads; i++) {
+        while (cks[i].state != CKState_Ready)
+          pthread_cond_wait(&cks[i].state_cond, &checkpoint_mu);
+        bytes += cks[i].bytes;
+      }
+      pthread_mutex_unlock(&checkpoint_mu);
+
+      uncommitted_ckp = prepare_checkpoint(min_epoch, nckthreads, pv);
+
+      for (int i = 0; i < nckthreads + 1; i++)
+        if (pv[i].s)
+          free((void *)pv[i].s);
+      double t = now() - t0;
+      fprintf(stderr, "kvd-ckp-%" PRIu64 " [%s,%s]: prepared (%.2f sec, %" PRIu64 " MB, %" PRIu64 " MB/sec)\n",
+	      ckp_gen.value(), uncommitted_ckp["min_epoch"].to_s().c_str(),
+	      uncommitted_ckp["max_epoch"].to_s().c_str(),
+	      t, bytes / (1 << 20), (uint64_t)(bytes / t) >> 20);
+    }
+  } else {
+    while(1) {
+      pthread_mutex_lock(&checkpoint_mu);
+      while (c->state != CKState_Go && c->state != CKState_Quit)
+        pthread_cond_wait(&c->state_cond, &checkpoint_mu);
+      if (c->state == CKState_Quit) {
+        pthread_mutex_unlock(&checkpoint_mu);
+        break;
+      }
+      pthread_mutex_unlock(&checkpoint_mu);
+
+      ti->rcu_start();
+      conc_filecheckpoint(ti);
+      ti->rcu_stop();
+
+      pthread_mutex_lock(&checkpoint_mu);
+      c->state = CKState_Ready;
+      pthread_cond_signal(&c->state_cond);
+      pthread_mutex_unlock(&checkpoint_mu);
+    }
+  }
+  return 0;
+}
+
+void
+durable_init(const durable_config &c)
+{
+  nlogger = c.nlogger;
+  nckthreads = c.nckthreads;
+  for (const char *d : c.logdir) {
+      mandatory_assert(nlogdir < MaxCores);
+      logdir[nlogdir++] = d;
+  }
+  for (const char *d : c.ckpdir) {
+      mandatory_assert(nckpdir < MaxCores);
+      ckpdir[nckpdir++] = d;
+  }
+  if (nlogdir == 0) {
+    logdir[0] = ".";
+    nlogdir = 1;
+  }
+  if (nckpdir == 0) {
+    ckpdir[0] = ".";
+    nckpdir = 1;
+  }
+  for (int i = 0; i < nckpdir; ++i)
+      make_dir(ckpdir[i]);
+  checkpoint_interval = c.checkpoint_interval;
+  partitioned_replay = c.partitioned_replay;
+
+  // log epoch starts at 1
+  global_log_epoch = 1;
+  global_wake_epoch = 0;
+  log_epoch_interval.tv_sec = (time_t) c.log_epoch_interval;
+  log_epoch_interval.tv_usec =
+      (suseconds_t) ((c.log_epoch_interval - log_epoch_interval.tv_sec) * 1000000);
+
+  log_init();
+}
+
+void
+durable_recover(threadinfo *ti, durable_recovery_stats *stats)
+{
+  recover(ti, stats);
+}
+
+void
+durable_attach(threadinfo *ti)
+{
+  ti->ti_log = &logs->log(ti->ti_index % nlogger);
+}
+
+void
+durable_checkpoint()
+{
+  pthread_mutex_lock(&checkpoint_mu);
+  pthread_cond_broadcast(&checkpoint_cond);
+  pthread_mutex_unlock(&checkpoint_mu);
+}
+
+void
+durable_quit()
+{
+  pthread_mutex_lock(&checkpoint_mu);
+  ckp_quit = true;
+  pthread_cond_signal(&checkpoint_cond);
+  pthread_mutex_unlock(&checkpoint_mu);
+}
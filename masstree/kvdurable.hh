@@ -0,0 +1,62 @@
+/* Masstree
+ * Eddie Kohler, Yandong Mao, Robert Morris
+ * Copyright (c) 2012-2013 President and Fellows of Harvard College
+ * Copyright (c) 2012-2013 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Masstree LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Masstree LICENSE file; the license in that file
+ * is legally binding.
+ */
+#ifndef KVDURABLE_HH
+#define KVDURABLE_HH 1
+#include "kvthread.hh"
+#include <vector>
+
+// Durability for the global tree: per-thread logs with group commit,
+// concurrent checkpoints, and recovery from both at startup. Shared by mtd
+// and mttest.
+
+struct durable_config {
+    int nlogger;
+    int nckthreads;
+    std::vector<const char *> logdir;	// logs go round-robin over these
+    std::vector<const char *> ckpdir;
+    double log_epoch_interval;		// seconds per log epoch (group commit)
+    double checkpoint_interval;		// seconds between checkpoints; <= 0: none
+    bool partitioned_replay;		// replay logs by key range, not by log
+
+    durable_config()
+	: nlogger(1), nckthreads(1), log_epoch_interval(0.2),
+	  checkpoint_interval(-1), partitioned_replay(true) {
+    }
+};
+
+struct durable_recovery_stats {
+    uint64_t ckp_records;
+    uint64_t ckp_bytes;
+    double ckp_time;
+    uint64_t log_records;
+    uint64_t log_bytes;
+    uint64_t log_applied;		// log records not superseded by newer ones
+    double log_time;
+};
+
+// Start the logger and checkpoint threads. Must be followed by
+// durable_recover(), which the loggers and checkpointers wait for.
+void durable_init(const durable_config &c);
+// Load the latest committed checkpoint, then replay the logs past it.
+void durable_recover(threadinfo *ti, durable_recovery_stats *stats = 0);
+// Log ti's updates from now on.
+void durable_attach(threadinfo *ti);
+// Start a checkpoint now rather than at the next interval.
+void durable_checkpoint();
+// Stop the checkpoint threads at the next opportunity.
+void durable_quit();
+
+#endif
@@ -35,6 +35,19 @@ class kvrandom_lcg_nr_simple { public:
     value_type next() {
 	return (seed_ = seed_ * a + c);
     }
+    // Advance by n steps in O(log n) time.
+    void discard(uint64_t n) {
+	uint32_t mul = 1, add = 0, ak = a, ck = c;
+	for (; n; n >>= 1) {
+	    if (n & 1) {
+		mul *= ak;
+		add = add * ak + ck;
+	    }
+	    ck *= ak + 1;
+	    ak *= ak;
+	}
+	seed_ = seed_ * mul + add;
+    }
   private:
     uint32_t seed_;
     enum { default_seed = 819234718U, a = 1664525U, c = 1013904223U };
@@ -51,6 +64,9 @@ class kvrandom_lcg_nr : public kvrandom_lcg_nr_simple { public:
 	    x1 = kvrandom_lcg_nr_simple::next();
 	return (x0 >> 15) | ((x1 & 0x7FFE) << 16);
     }
+    void discard(uint64_t n) {
+	kvrandom_lcg_nr_simple::discard(2 * n);
+    }
 };
 
 // A random number generator taken from NR's ran4. Based on hashing.
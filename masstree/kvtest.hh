@@ -20,9 +20,12 @@
 #include "kvproto.hh"
 #include "mttest.hh"
 #include "tbench_server.h"
+#include "ycsb.hh"
 
+#include <atomic>
 #include <cstdlib>
 #include <iostream>
+#include <string>
 #include <vector>
 
 // Templated KV tests, so we can run them either client/server or linked with
@@ -1555,55 +1558,131 @@ void kvtest_splitremove1(C &client)
 //Helpers
 
 
+// The tbench tests split population across threads and start serving once
+// every thread is done. The harness ends the process when the run is over, so
+// served throughput is reported periodically rather than at the end.
+static std::atomic<int> tbench_npopulated(0);
+static std::atomic<uint64_t> tbench_nserved(0);
+static double tbench_tserve0;
+
+template <typename S>
+double tbench_populate_begin(S &server)
+{
+    static const double tpop0 = server.now();
+    return tpop0;
+}
+
+template <typename S>
+void tbench_populate_end(S &server, double tpop0, long nkeys)
+{
+    if (++tbench_npopulated == server.nthreads()) {
+        tbench_tserve0 = server.now();
+        server.notice("population: %ld keys with %d threads in %.3f s\n",
+                      nkeys, server.nthreads(), tbench_tserve0 - tpop0);
+        server.populated();
+    } else
+        while (tbench_npopulated != server.nthreads())
+            relax_fence();
+
+    server.notice("now getting\n");
+}
+
+template <typename S>
+void tbench_served(S &server, int opsPerReq)
+{
+    uint64_t served = ++tbench_nserved;
+    if (served % tbenchReportInterval == 0) {
+        double t = server.now() - tbench_tserve0;
+        server.notice("served %llu requests in %.3f s with %d threads: "
+                      "%.0f req/s, %.0f ops/s\n",
+                      (unsigned long long) served, t, server.nthreads(),
+                      served / t, served * opsPerReq / t);
+    }
+}
+
+// Runs a request's ops, batching GETs through many_get_sync so their tree
+// traversals overlap. A PUT runs when reached, except that the pending GETs
+// run first if one of them may read the PUT's key.
+template <typename S>
+void mycsba_run_interleaved(S &server, Request *req, int nops)
+{
+    enum { filter_bits = 4096 };
+    Str keys[mycsbaAggrFactor];
+    uint64_t filter[filter_bits / 64];
+    int nkeys = 0;
+
+    memset(filter, 0, sizeof(filter));
+    for (int op = 0; op < nops; ++op) {
+        Str k(req[op].key, strlen(req[op].key));
+        uint32_t h = k.hashcode() % filter_bits;
+
+        if (req[op].type == GET) {
+            keys[nkeys++] = k;
+            filter[h / 64] |= uint64_t(1) << (h % 64);
+        } else if (req[op].type == PUT) {
+            if (filter[h / 64] & (uint64_t(1) << (h % 64))) {
+                server.many_get_sync(keys, nkeys);
+                nkeys = 0;
+                memset(filter, 0, sizeof(filter));
+            }
+            server.put(k, Str(req[op].val, strlen(req[op].val)));
+        } else {
+            std::cerr << "Unknown Request type" << std::endl;
+            exit(-1);
+        }
+    }
+
+    if (nkeys)
+        server.many_get_sync(keys, nkeys);
+}
+
 template <typename S>
 void kvtest_mycsba(S &server)
 {
-    server.rand.reset(mycsbaSeed);
-    double tp0 = server.now();
-    int n;
+    double tpop0 = tbench_populate_begin(server);
+    int id = server.id();
+    int nth = server.nthreads();
     char key[mycsbaKeySize], val[mycsbaValSize];
 
-    //NOTE: Single-threaded for now (zsim/liblat)
-    //int id = server.id();
-    //int nth = server.nthreads();
+    // Populate: each thread inserts its own range of the key sequence (the
+    // same sequence the client draws requests from), skipping the generator
+    // ahead to the start of its range
+    int begin = (int64_t) mycsbaDbSize * id / nth;
+    int end = (int64_t) mycsbaDbSize * (id + 1) / nth;
+    server.rand.reset(mycsbaSeed);
+    server.rand.discard((uint64_t) begin * mycsbaDrawsPerKey);
 
-    //Populate
-    for (n = 0; n < mycsbaDbSize; n++) {
-        strcpy(key, "user");
-        int p = 4;
-        for (int i = 0; i < 18; i++, p++)
-            key[p] = '0' + (server.rand.next() % 10);
-        key[p] = 0;
-	int32_t v = (int32_t) server.rand.next();
-    sprintf(val, "%d", v);
-	server.put(Str(key, strlen(key)), Str(val, strlen(val)));
+    double tp0 = server.now();
+    for (int n = begin; n < end; ++n) {
+        genKeyVal(server.rand, key, val);
+        server.put(Str(key, strlen(key)), Str(val, strlen(val)));
     }
     server.wait_all();
     double tp1 = server.now();
-    
-    server.notice("now getting\n");
-    double tg0, tg1;
-    int g;
+    server.notice("populated %d keys in %.3f s\n", end - begin, tp1 - tp0);
 
-    server.rand.reset(mycsbaSeed);
-    tg0 = server.now();
+    tbench_populate_end(server, tpop0, mycsbaDbSize);
 
     while (true) { //run continuously
         Request* req = nullptr;
         size_t len = tBenchRecvReq(reinterpret_cast<void**>(&req));
         assert(len == sizeof(Request) * mycsbaAggrFactor);
 
-        for (int op = 0; op < mycsbaAggrFactor; ++op) {
-            Request* cur = &req[op];
-
-            if (cur->type == GET) {
-                server.get_sync(Str(cur->key, strlen(cur->key)));
-            } else if (cur->type == PUT) {
-                server.put(Str(cur->key, strlen(cur->key)), 
-                        Str(cur->val, strlen(cur->val)));
-            } else {
-                std::cerr << "Unknown Request type" << std::endl;
-                exit(-1);
+        if (server.interleave_gets()) {
+            mycsba_run_interleaved(server, req, mycsbaAggrFactor);
+        } else {
+            for (int op = 0; op < mycsbaAggrFactor; ++op) {
+                Request* cur = &req[op];
+
+                if (cur->type == GET) {
+                    server.get_sync(Str(cur->key, strlen(cur->key)));
+                } else if (cur->type == PUT) {
+                    server.put(Str(cur->key, strlen(cur->key)), 
+                            Str(cur->val, strlen(cur->val)));
+                } else {
+                    std::cerr << "Unknown Request type" << std::endl;
+                    exit(-1);
+                }
             }
         }
 
@@ -1611,37 +1690,132 @@ void kvtest_mycsba(S &server)
 
         tBenchSendResp(reinterpret_cast<void*>(&resp), sizeof(resp));
 
-        // lat_startRequest();
-        // for (g = 0; g < n; ++g) {
-        //     strcpy(key, "user");
-        //     int p = 4;
-        //     for (int i = 0; i < 18; i++, p++)
-        //         key[p] = '0' + (server.rand.next() % 10);
-        //     key[p] = 0;
-        //     int32_t v = (int32_t) server.rand.next();
-        //     sprintf(val, "%d", v);
-        //     if (g % 2 == 0) { //TODO: another rand seed for this...
-        //         server.get_check(Str(key, strlen(key)), Str(val, strlen(val)));
-        //     } else {
-        //         server.put(Str(key, strlen(key)), Str(val, strlen(val)));
-        //     }
-
-        //     if ((g & mycsbaAggrMask) == 0) {
-        //         lat_endRequest();
-        //         lat_startRequest();
-        //     }
-        // }
-
-        // lat_endRequest();
+        tbench_served(server, mycsbaAggrFactor);
     }
+}
 
+template <typename S>
+void kvtest_ycsb(S &server)
+{
+    double tpop0 = tbench_populate_begin(server);
+    YcsbConfig config = YcsbConfig::fromEnv();
+    int id = server.id();
+    int nth = server.nthreads();
+    char key[ycsbKeySize];
+
+    // Field contents do not matter, so every write stores the same record
+    std::string record(config.recordSize(), 0);
+    server.rand.reset(mycsbaSeed + id);
+    for (size_t i = 0; i < record.size(); ++i)
+        record[i] = 'a' + server.rand.next() % 26;
+    Str recordStr(record.data(), record.size());
+
+    uint64_t begin = config.recordCount * id / nth;
+    uint64_t end = config.recordCount * (id + 1) / nth;
+    double tp0 = server.now();
+    for (uint64_t n = begin; n < end; ++n) {
+        ycsbBuildKey(n, key);
+        server.put(Str(key, strlen(key)), recordStr);
+    }
     server.wait_all();
-    tg1 = server.now();
+    server.notice("populated %llu records in %.3f s\n",
+                  (unsigned long long) (end - begin), server.now() - tp0);
+
+    tbench_populate_end(server, tpop0, config.recordCount);
+
+    std::vector<Str> keys, values;
+    Str value;
+    Str readKeys[ycsbMaxBatch];
+    while (true) {
+        YcsbRequest* req = nullptr;
+        size_t len = tBenchRecvReq(reinterpret_cast<void**>(&req));
+        int nops = len / sizeof(YcsbRequest);
+        assert(nops > 0 && len == nops * sizeof(YcsbRequest));
+
+        // All ops in a request have the same type
+        if (req[0].op == YCSB_READ && server.interleave_gets()) {
+            for (int op = 0; op < nops; ++op)
+                readKeys[op] = Str(req[op].key, strlen(req[op].key));
+            server.many_get_sync(readKeys, nops);
+        } else {
+            for (int op = 0; op < nops; ++op) {
+                YcsbRequest* cur = &req[op];
+                Str k(cur->key, strlen(cur->key));
+
+                switch (cur->op) {
+                case YCSB_READ:
+                    server.get_sync(k);
+                    break;
+                case YCSB_UPDATE:
+                case YCSB_INSERT:
+                    server.put(k, recordStr);
+                    break;
+                case YCSB_SCAN:
+                    server.scan_sync(k, cur->scanLen, keys, values);
+                    break;
+                case YCSB_RMW:
+                    server.get_sync(k, value);
+                    server.put(k, recordStr);
+                    break;
+                case YCSB_DELETE:
+                    server.remove(k);
+                    break;
+                default:
+                    std::cerr << "Unknown YCSB op " << cur->op << std::endl;
+                    exit(-1);
+                }
+            }
+        }
+
+        Response resp = { SUCCESS };
+
+        tBenchSendResp(reinterpret_cast<void*>(&resp), sizeof(resp));
+
+        tbench_served(server, nops);
+    }
+}
+
+
+// Point-lookup microbenchmark: loads lookupDbSize 8-byte keys, then times
+// gets. With sequential keys (0, 1, ...), each thread looks keys up in order;
+// otherwise keys are hashed and looked up in random order. 8-byte keys keep
+// lookups within one trie layer, so leaf search is a large share of the cost.
+template <typename S>
+void kvtest_lookup(S &server, bool sequential)
+{
+    double tpop0 = tbench_populate_begin(server);
+    int id = server.id();
+    int nth = server.nthreads();
+    uint64_t ikey;
+    Str key(reinterpret_cast<const char *>(&ikey), sizeof(ikey));
+
+    long begin = lookupDbSize * id / nth;
+    long end = lookupDbSize * (id + 1) / nth;
+    for (long n = begin; n < end; ++n) {
+        ikey = host_to_net_order(sequential ? uint64_t(n) : ycsbHash(n));
+        server.put(key, n);
+    }
+    server.wait_all();
+    tbench_populate_end(server, tpop0, lookupDbSize);
+
+    long ngets = server.limit() != ~uint64_t(0) ? server.limit() : lookupGets;
+    long found = 0;
+    server.rand.reset(mycsbaSeed + id);
+    double tg0 = server.now();
+    for (long g = 0; g < ngets; ++g) {
+        long n = sequential ? (begin + g) % lookupDbSize
+            : server.rand.next() % lookupDbSize;
+        ikey = host_to_net_order(sequential ? uint64_t(n) : ycsbHash(n));
+        found += server.get_sync(key);
+    }
+    double tg1 = server.now();
+
+    if (found != ngets)
+        server.fail("%ld of %ld gets failed\n", ngets - found, ngets);
 
     Json result = Json();
-    kvtest_set_time(result, "puts", n, tp1 - tp0);
-    kvtest_set_time(result, "queries", g, tg1 - tg0);
-    kvtest_set_time(result, "ops", n + g, (tp1 - tp0) + (tg1 - tg0));
+    kvtest_set_time(result, "gets", ngets, tg1 - tg0);
+    result.set("ns_per_get", (tg1 - tg0) * 1e9 / ngets);
     server.report(result);
 }
 
@@ -18,10 +18,12 @@
 #include "kvrow.hh"
 #include "file.hh"
 #include "masstree_query.hh"
+#include "string_slice.hh"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <algorithm>
 
 kvepoch_t global_log_epoch;
 kvepoch_t global_wake_epoch;
@@ -32,9 +34,14 @@ extern Masstree::default_table* tree;
 kvepoch_t rec_ckp_min_epoch;
 kvepoch_t rec_ckp_max_epoch;
 logreplay::info_type *rec_log_infos;
+std::vector<logreplay *> rec_log_replays;
+std::vector<Str> rec_replay_keys;
 kvepoch_t rec_replay_min_epoch;
 kvepoch_t rec_replay_max_epoch;
 kvepoch_t rec_replay_min_quiescent_last_epoch;
+uint64_t rec_replay_nrecords;
+uint64_t rec_replay_nbytes;
+uint64_t rec_replay_napplied;
 
 struct logrec_base {
     uint32_t command_;
@@ -273,8 +280,15 @@ void loginfo::logger() {
 	    nb = x_pos;
 	} else
 	    release();
-	if (nb < len_ / 4)
-	    napms(200);
+	// Group commit: flush once per log epoch unless the buffer is filling.
+	// Sleep at microsecond resolution, so sub-millisecond epochs do not
+	// turn into a busy loop
+	if (nb < len_ / 4) {
+	    struct timespec nap;
+	    nap.tv_sec = log_epoch_interval.tv_sec;
+	    nap.tv_nsec = log_epoch_interval.tv_usec * 1000;
+	    nanosleep(&nap, 0);
+	}
 	if (ti_->ti_index == 0)
 	    check_epoch();
     }
@@ -361,8 +375,131 @@ void loginfo::record(int command, const query_times& qtimes,
 
 // replay
 
+// a replayable record
+struct logreplay::record_ref {
+    const char *rec;
+    const char *key;
+    int keylen;
+    hashcode_t hash;
+    kvtimestamp_t ts;		// marker timestamp for removes
+
+    bool same_key(const record_ref &x) const {
+	return hash == x.hash && keylen == x.keylen
+	    && memcmp(key, x.key, keylen) == 0;
+    }
+    bool operator<(const record_ref &x) const {
+	int c = String_generic::compare(key, keylen, x.key, x.keylen);
+	return c < 0 || (c == 0 && ts < x.ts);
+    }
+};
+
+// The records for one key range: the newest put or remove of each key, in
+// an open-addressed hash table, plus every modify. Older modifies are
+// harmless; replay_query::apply drops them.
+class logreplay::partition {
+  public:
+    partition()
+	: nkeys_(0) {
+    }
+
+    void reserve(size_t n) {
+	size_t size = 1024;
+	while (size < 2 * n)
+	    size *= 2;
+	if (size > slots_.size() && !nkeys_)
+	    slots_.resize(size);
+    }
+    void add(const record_ref &r) {
+	if (unlikely(2 * (nkeys_ + 1) > slots_.size()))
+	    grow();
+	size_t mask = slots_.size() - 1;
+	size_t i = r.hash & mask;
+	while (slots_[i].rec && !slots_[i].same_key(r))
+	    i = (i + 1) & mask;
+	if (!slots_[i].rec) {
+	    slots_[i] = r;
+	    ++nkeys_;
+	} else if (slots_[i].ts < r.ts)
+	    slots_[i] = r;
+    }
+    void add_modify(const record_ref &r) {
+	modifies_.push_back(r);
+    }
+    void merge(partition &x) {
+	if (x.nkeys_ > nkeys_)
+	    slots_.swap(x.slots_), std::swap(nkeys_, x.nkeys_);
+	for (size_t i = 0; i != x.slots_.size(); ++i)
+	    if (x.slots_[i].rec)
+		add(x.slots_[i]);
+	modifies_.insert(modifies_.end(), x.modifies_.begin(), x.modifies_.end());
+	x.clear();
+    }
+    void clear() {
+	std::vector<record_ref>().swap(slots_);
+	std::vector<record_ref>().swap(modifies_);
+	nkeys_ = 0;
+    }
+
+    // newest puts and removes in key order, followed by the modifies
+    void take_records(std::vector<record_ref> &rs) {
+	std::vector<sort_ref> sorted;
+	sorted.reserve(nkeys_);
+	for (size_t i = 0; i != slots_.size(); ++i)
+	    if (slots_[i].rec)
+		sorted.push_back(sort_ref(&slots_[i]));
+	std::sort(sorted.begin(), sorted.end());
+	rs.reserve(nkeys_ + modifies_.size());
+	for (size_t i = 0; i != sorted.size(); ++i)
+	    rs.push_back(*sorted[i].r);
+	std::sort(modifies_.begin(), modifies_.end());
+	rs.insert(rs.end(), modifies_.begin(), modifies_.end());
+	clear();
+    }
+
+  private:
+    // Sorts on the first 16 key bytes, as masstree compares key slices,
+    // so that most comparisons need not read the keys themselves.
+    struct sort_ref {
+	uint64_t ikey[2];
+	const record_ref *r;
+
+	explicit sort_ref(const record_ref *x)
+	    : r(x) {
+	    typedef string_slice<uint64_t> slice;
+	    ikey[0] = slice::make_comparable(x->key, x->keylen);
+	    ikey[1] = x->keylen > slice::size
+		? slice::make_comparable(x->key + slice::size,
+					 x->keylen - slice::size)
+		: 0;
+	}
+	bool operator<(const sort_ref &x) const {
+	    if (ikey[0] != x.ikey[0])
+		return ikey[0] < x.ikey[0];
+	    else if (ikey[1] != x.ikey[1])
+		return ikey[1] < x.ikey[1];
+	    else
+		return *r < *x.r;
+	}
+    };
+
+    std::vector<record_ref> slots_;
+    std::vector<record_ref> modifies_;
+    size_t nkeys_;
+
+    void grow() {
+	std::vector<record_ref> old;
+	old.swap(slots_);
+	slots_.resize(old.empty() ? 1024 : 2 * old.size());
+	nkeys_ = 0;
+	for (size_t i = 0; i != old.size(); ++i)
+	    if (old[i].rec)
+		add(old[i]);
+    }
+};
+
 logreplay::logreplay(const String &filename)
-    : filename_(filename), errno_(0), buf_()
+    : filename_(filename), errno_(0), buf_(), repbegin_(), repend_(),
+      parts_(), nparts_(0)
 {
     int fd = open(filename_.c_str(), O_RDONLY);
     if (fd == -1) {
@@ -395,6 +532,7 @@ logreplay::logreplay(const String &filename)
 logreplay::~logreplay()
 {
     unmap();
+    delete[] parts_;
 }
 
 int
@@ -463,9 +601,32 @@ logrecord::extract(const char *buf, const char *end)
     return buf + lr->size_;
 }
 
+static void
+replay_record(replay_query<row_type> &q, const logrecord &lr, threadinfo *ti)
+{
+    if (lr.command == logcmd_put) {
+	q.begin_replay_put(lr.key, lr.val, lr.ts);
+	tree->replay(q, ti);
+    } else if (lr.command == logcmd_put1) {
+	q.begin_replay_put1(lr.key, lr.val, lr.ts);
+	tree->replay(q, ti);
+    } else if (lr.command == logcmd_modify) {
+	q.begin_replay_modify(lr.key, lr.val, lr.ts, lr.prev_ts);
+	tree->replay(q, ti);
+    } else if (lr.command == logcmd_remove) {
+	q.begin_replay_remove(lr.key, lr.ts, ti);
+	tree->replay(q, ti);
+    }
+}
+
+// sample every Nth update when choosing partitioned replay key ranges
+static const off_t replay_sample_stride = 256;
+// presize each log's partition tables for at most this many keys in total
+static const size_t replay_reserve_keys = 1 << 21;
+
 
 logreplay::info_type
-logreplay::info() const
+logreplay::info(std::vector<Str> *sample) const
 {
     info_type x;
     x.first_epoch = x.last_epoch = x.wake_epoch = x.min_post_quiescent_wake_epoch = 0;
@@ -506,6 +667,14 @@ logreplay::info() const
 	    break;
 	}
 #endif
+	if (sample && nr % replay_sample_stride == 0
+	    && lr->command_ != logcmd_epoch && lr->command_ != logcmd_wake
+	    && lr->command_ != logcmd_quiesce) {
+	    logrecord lrec;
+	    lrec.extract(buf, end);
+	    if (lrec.command != logcmd_none && lrec.key.len)
+		sample->push_back(lrec.key);
+	}
 	buf += lr->size_;
 	++nr;
     }
@@ -550,9 +719,9 @@ logreplay::min_post_quiescent_wake_epoch(kvepoch_t quiescent_epoch) const
 }
 
 uint64_t
-logreplay::replayandclean1(replay_query<row_type> &q,
-			   kvepoch_t min_epoch, kvepoch_t max_epoch,
-			   threadinfo *ti)
+logreplay::replay1(replay_query<row_type> &q,
+		   kvepoch_t min_epoch, kvepoch_t max_epoch,
+		   threadinfo *ti)
 {
     uint64_t nr = 0;
     const char *pos = buf_, *end = buf_ + size_;
@@ -589,21 +758,20 @@ logreplay::replayandclean1(replay_query<row_type> &q,
 	assert(repbegin);
 	repend = nextpos;
 	if (lr.key.len) { // skip empty entry
-	    if (lr.command == logcmd_put) {
-		q.begin_replay_put(lr.key, lr.val, lr.ts);
-		tree->replay(q, ti);
-	    } else if (lr.command == logcmd_put1) {
-		q.begin_replay_put1(lr.key, lr.val, lr.ts);
-		tree->replay(q, ti);
-	    } else if (lr.command == logcmd_modify) {
-		q.begin_replay_modify(lr.key, lr.val, lr.ts, lr.prev_ts);
-		tree->replay(q, ti);
-	    } else if (lr.command == logcmd_remove) {
-		q.begin_replay_remove(lr.key, lr.ts, ti);
-		tree->replay(q, ti);
-	    }
+	    if (parts_) {
+		int p = std::upper_bound(rec_replay_keys.begin(),
+					 rec_replay_keys.end(), lr.key)
+		    - rec_replay_keys.begin();
+		record_ref r = { pos, lr.key.s, lr.key.len, lr.key.hashcode(),
+				 lr.command == logcmd_remove ? lr.ts | 1 : lr.ts };
+		if (lr.command == logcmd_modify)
+		    parts_[p].add_modify(r);
+		else
+		    parts_[p].add(r);
+	    } else
+		replay_record(q, lr, ti);
 	    ++nr;
-	    if (nr % 100000 == 0)
+	    if (!parts_ && nr % 100000 == 0)
 		fprintf(stderr,
 			"replay %s: %" PRIu64 " entries replayed\n",
 			filename_.c_str(), nr);
@@ -611,28 +779,59 @@ logreplay::replayandclean1(replay_query<row_type> &q,
 	pos = nextpos;
     }
 
-    // rewrite portion of log
     if (!repbegin)
 	repbegin = repend = buf_;
     else if (!repend) {
 	fprintf(stderr, "replay %s: surprise repend\n", filename_.c_str());
 	repend = pos;
     }
+    repbegin_ = repbegin;
+    repend_ = repend;
+    return nr;
+}
+
+// Apply key range `which` from every log: for each key, the newest put or
+// remove, then any modifies. Records are applied in key order.
+uint64_t
+logreplay::apply_partition(int which, replay_query<row_type> &q,
+			   threadinfo *ti)
+{
+    partition merged;
+    for (size_t i = 0; i != rec_log_replays.size(); ++i)
+	if (logreplay *l = rec_log_replays[i])
+	    if (which < l->nparts_)
+		merged.merge(l->parts_[which]);
+    std::vector<record_ref> rs;
+    merged.take_records(rs);
 
+    logrecord lr;
+    for (size_t i = 0; i != rs.size(); ++i) {
+	const logrec_base *lb =
+	    reinterpret_cast<const logrec_base *>(rs[i].rec);
+	lr.extract(rs[i].rec, rs[i].rec + lb->size_);
+	replay_record(q, lr, ti);
+    }
+    return rs.size();
+}
+
+// rewrite the log to hold only [repbegin_, repend_)
+void
+logreplay::clean1()
+{
     char tmplog[256];
     int r = snprintf(tmplog, sizeof(tmplog), "%s.tmp", filename_.c_str());
     mandatory_assert(r >= 0 && size_t(r) < sizeof(tmplog));
 
     printf("replay %s: truncate from %" PRIdOFF_T " to %" PRIdSIZE_T " [%" PRIdSIZE_T ",%" PRIdSIZE_T ")\n",
-	   filename_.c_str(), size_, repend - repbegin,
-	   repbegin - buf_, repend - buf_);
+	   filename_.c_str(), size_, repend_ - repbegin_,
+	   repbegin_ - buf_, repend_ - buf_);
 
-    bool need_copy = repbegin != buf_;
+    bool need_copy = repbegin_ != buf_;
     int fd;
     if (!need_copy)
-	fd = replay_truncate(repend - repbegin);
+	fd = replay_truncate(repend_ - repbegin_);
     else
-	fd = replay_copy(tmplog, repbegin, repend);
+	fd = replay_copy(tmplog, repbegin_, repend_);
 
     r = fsync(fd);
     mandatory_assert(r == 0);
@@ -650,8 +849,6 @@ logreplay::replayandclean1(replay_query<row_type> &q,
 	    abort();
 	}
     }
-
-    return nr;
 }
 
 int
@@ -708,13 +905,19 @@ logreplay::replay(int which, threadinfo *ti)
 {
     waituntilphase(REC_LOG_TS);
     replay_query<row_type> q;
+    bool partitioned = !rec_log_replays.empty();
+    std::vector<Str> sample;
     // find the maximum timestamp of entries in the log
     if (buf_) {
-	info_type x = info();
+	info_type x = info(partitioned ? &sample : 0);
 	pthread_mutex_lock(&rec_mu);
 	rec_log_infos[which] = x;
+	rec_replay_keys.insert(rec_replay_keys.end(),
+			       sample.begin(), sample.end());
 	pthread_mutex_unlock(&rec_mu);
     }
+    if (partitioned)
+	rec_log_replays[which] = this;
     inactive();
 
     waituntilphase(REC_LOG_ANALYZE_WAKE);
@@ -728,10 +931,46 @@ logreplay::replay(int which, threadinfo *ti)
 
     waituntilphase(REC_LOG_REPLAY);
     if (buf_) {
+	if (partitioned) {
+	    nparts_ = rec_replay_keys.size() + 1;
+	    parts_ = new partition[nparts_];
+	    // estimate each range's share of this log from our sample
+	    std::vector<size_t> nsample(nparts_, 0);
+	    for (size_t i = 0; i != sample.size(); ++i)
+		++nsample[std::upper_bound(rec_replay_keys.begin(),
+					   rec_replay_keys.end(), sample[i])
+			  - rec_replay_keys.begin()];
+	    for (int p = 0; p != nparts_; ++p)
+		parts_[p].reserve(std::min<size_t>(nsample[p] * replay_sample_stride,
+					   replay_reserve_keys / nparts_));
+	}
 	ti->rcu_start();
-	uint64_t nr = replayandclean1(q, rec_replay_min_epoch, rec_replay_max_epoch, ti);
+	off_t nbytes = size_;
+	uint64_t nr = replay1(q, rec_replay_min_epoch, rec_replay_max_epoch, ti);
+	if (!partitioned)
+	    clean1();
 	ti->rcu_stop();
-	printf("recovered %" PRIu64 " records from %s\n", nr, filename_.c_str());
+	fetch_and_add(&rec_replay_nrecords, nr);
+	fetch_and_add(&rec_replay_nbytes, (uint64_t) nbytes);
+	if (!partitioned) {
+	    fetch_and_add(&rec_replay_napplied, nr);
+	    printf("recovered %" PRIu64 " records from %s\n", nr, filename_.c_str());
+	}
     }
     inactive();
+
+    if (partitioned) {
+	waituntilphase(REC_LOG_APPLY);
+	ti->rcu_start();
+	uint64_t nr = apply_partition(which, q, ti);
+	ti->rcu_stop();
+	fetch_and_add(&rec_replay_napplied, nr);
+	printf("recovered %" PRIu64 " records in key range %d\n", nr, which);
+	inactive();
+
+	waituntilphase(REC_LOG_CLEAN);
+	if (buf_)
+	    clean1();
+	inactive();
+    }
 }
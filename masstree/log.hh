@@ -20,6 +20,7 @@
 #include "kvproto.hh"
 #include "serial_changeset.hh"
 #include <pthread.h>
+#include <vector>
 template <typename R> class replay_query;
 class logset;
 
@@ -139,36 +140,57 @@ class logreplay {
 	kvepoch_t min_post_quiescent_wake_epoch;
 	bool quiescent;
     };
-    info_type info() const;
+    info_type info(std::vector<Str> *sample = 0) const;
     kvepoch_t min_post_quiescent_wake_epoch(kvepoch_t quiescent_epoch) const;
 
     void replay(int i, threadinfo *ti);
 
   private:
+    struct record_ref;
+    class partition;
+
     String filename_;
     int errno_;
     off_t size_;
     char *buf_;
-
-    uint64_t replayandclean1(replay_query<row_type> &q,
-			     kvepoch_t min_epoch, kvepoch_t max_epoch,
+    const char *repbegin_;
+    const char *repend_;
+    partition *parts_;			// partitioned replay: by key range
+    int nparts_;
+
+    uint64_t replay1(replay_query<row_type> &q,
+		     kvepoch_t min_epoch, kvepoch_t max_epoch,
+		     threadinfo *ti);
+    uint64_t apply_partition(int which, replay_query<row_type> &q,
 			     threadinfo *ti);
+    void clean1();
     int replay_truncate(size_t len);
     int replay_copy(const char *tmpname, const char *first, const char *last);
 };
 
 enum { REC_NONE, REC_CKP, REC_LOG_TS, REC_LOG_ANALYZE_WAKE,
-       REC_LOG_REPLAY, REC_DONE };
+       REC_LOG_REPLAY, REC_LOG_APPLY, REC_LOG_CLEAN, REC_DONE };
 extern void recphase(int nactive, int state);
 extern void waituntilphase(int phase);
 extern void inactive();
 extern pthread_mutex_t rec_mu;
 extern logreplay::info_type *rec_log_infos;
+// Partitioned replay. If rec_log_replays is nonempty, loggers sample their
+// keys during REC_LOG_TS, and the sample is cut into one key range per logger
+// (rec_replay_keys then holds the range boundaries). REC_LOG_REPLAY only
+// sorts each log's records into those ranges. During REC_LOG_APPLY each
+// logger applies, for one key range across all logs, the newest version of
+// every key. REC_LOG_CLEAN rewrites the logs once no logger needs them.
+extern std::vector<logreplay *> rec_log_replays;
+extern std::vector<Str> rec_replay_keys;
 extern kvepoch_t rec_ckp_min_epoch;
 extern kvepoch_t rec_ckp_max_epoch;
 extern kvepoch_t rec_replay_min_epoch;
 extern kvepoch_t rec_replay_max_epoch;
 extern kvepoch_t rec_replay_min_quiescent_last_epoch;
+extern uint64_t rec_replay_nrecords;
+extern uint64_t rec_replay_nbytes;
+extern uint64_t rec_replay_napplied;
 
 
 inline void loginfo::acquire() {
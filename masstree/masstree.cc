@@ -114,6 +114,41 @@ bool query_table<P>::get(query<row_type>& q, threadinfo* ti) const {
     return found;
 }
 
+template <typename P>
+int query_table<P>::many_get(query<row_type>* q, int nq, threadinfo* ti) const {
+    ti->pstat.mark_get_begin();
+    unlocked_stepcursor<P> lp[many_get_width];
+    int lq[many_get_width];     // query index of each cursor
+    int active = 0, next = 0, nfound = 0;
+    for (; active < many_get_width && next < nq; ++active, ++next) {
+        lp[active].reset(table_, q[next].key_);
+        lq[active] = next;
+    }
+
+    // Step each lookup in turn; a finished lookup's slot takes the next query
+    while (active) {
+        for (int i = 0; i < active; ) {
+            if (!lp[i].step(ti)) {
+                ++i;
+                continue;
+            }
+            if (lp[i].found() && q[lq[i]].emitrow(lp[i].datum_, ti))
+                ++nfound;
+            if (next < nq) {
+                lp[i].reset(table_, q[next].key_);
+                lq[i] = next++;
+                ++i;
+            } else {
+                --active;
+                lp[i] = lp[active];
+                lq[i] = lq[active];
+            }
+        }
+    }
+    ti->pstat.mark_get_end();
+    return nfound;
+}
+
 template <typename P>
 result_t query_table<P>::put(query<row_type>& q, threadinfo* ti) {
     tcursor<P> lp(table_, q.key_);
@@ -523,6 +558,8 @@ void query_table<P>::print(FILE *f, int indent) const {
     table_.print(f, indent);
 }
 
+template <typename P> constexpr int query_table<P>::many_get_width;
+
 template class basic_table<default_table::param_type>;
 template class query_table<default_table::param_type>;
 
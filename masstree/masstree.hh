@@ -27,7 +27,7 @@ template <int LW = 15, int IW = LW> struct nodeparams {
     static constexpr int internode_width = IW;
     static constexpr bool concurrent = true;
     static constexpr bool prefetch = true;
-    static constexpr int bound_method = bound_method_binary;
+    static constexpr int bound_method = bound_method_simd;
     static constexpr int debug_level = 0;
     typedef uint64_t ikey_type;
 };
@@ -67,6 +67,95 @@ bool unlocked_tcursor<P>::find_unlocked(threadinfo *ti)
 	return false;
 }
 
+template <typename P>
+bool unlocked_stepcursor<P>::step(threadinfo *ti)
+{
+    if (state_ == s_value) {
+	state_ = s_found;
+	return true;
+    }
+
+    leafvalue<P> entry = leafvalue<P>::make_empty();
+    bool ksuf_match = false;
+    int kp, keylenx = 0;
+    leaf<P> *n;
+    nodeversion_type v;
+
+ retry:
+    // n_ was prefetched by the previous step. Check the parent after reading
+    // n_'s version, as reach_leaf() does; on any change, restart the layer.
+    v = n_->stable_annotated(ti->stable_fence());
+    if (parent_) {
+	if (parent_->has_changed(pv_)) {
+	    ti->mark(tc_internode_retry);
+	    start_layer(layer_root_);
+	    goto retry;
+	}
+    } else
+	while (v.has_split()) {
+	    ti->mark(tc_root_retry);
+	    n_ = n_->unsplit_ancestor();
+	    v = n_->stable_annotated(ti->stable_fence());
+	}
+
+    if (!v.isleaf()) {
+	const internode<P> *in = static_cast<const internode<P> *>(n_);
+	kp = internode<P>::bound_type::upper(ka_, *in);
+	const node_base<P> *child = in->child_[kp];
+	if (!child) {
+	    start_layer(layer_root_);
+	    goto retry;
+	}
+	parent_ = in;
+	pv_ = v;
+	n_ = child;
+	n_->prefetch_full();
+	return false;
+    }
+
+    n = const_cast<leaf<P> *>(static_cast<const leaf<P> *>(n_));
+
+ forward:
+    if (v.deleted()) {
+	start_layer(layer_root_);
+	goto retry;
+    }
+
+    kp = leaf<P>::bound_type::lower_check(ka_, *n);
+    if (kp >= 0) {
+	keylenx = n->keylenx_[kp];
+	fence();		// see note in check_leaf_insert()
+	entry = n->lv_[kp];
+	ksuf_match = n->ksuf_equals(kp, ka_, keylenx);
+    }
+    if (n->has_changed(v)) {
+	ti->mark(threadcounter(tc_stable_leaf_insert + n->simple_has_split(v)));
+	n = forward_at_leaf(n, v, ka_, ti);
+	goto forward;
+    }
+
+    if (kp < 0) {
+	state_ = s_notfound;
+	return true;
+    } else if (n->keylenx_is_node(keylenx)) {
+	if (likely(n->keylenx_is_stable_node(keylenx))) {
+	    ka_.shift();
+	    start_layer(entry.node());
+	    return false;
+	} else
+	    goto forward;
+    } else if (ksuf_match) {
+	// Let the value load while other lookups step
+	datum_ = entry.value();
+	entry.prefetch(keylenx);
+	state_ = s_value;
+	return false;
+    } else {
+	state_ = s_notfound;
+	return true;
+    }
+}
+
 template <typename P>
 inline bool basic_table<P>::get(Str key, value_type &value,
                                 threadinfo *ti) const
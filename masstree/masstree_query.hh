@@ -44,6 +44,9 @@ class query_table {
     }
 
     bool get(query<row_type>& q, threadinfo* ti) const;
+    // Gets q[0..nq), interleaving up to many_get_width traversals at a time.
+    // Returns the number of keys found.
+    int many_get(query<row_type>* q, int nq, threadinfo* ti) const;
     void scan(query<row_type>& q, threadinfo* ti) const;
     void rscan(query<row_type>& q, threadinfo* ti) const;
 
@@ -68,6 +71,8 @@ class query_table {
 	return "mb";
     }
 
+    static constexpr int many_get_width = 8;
+
   private:
     basic_table<P> table_;
 };
@@ -42,6 +42,50 @@ class unlocked_tcursor {
     const basic_table<P> *tablep_;
 };
 
+// A lookup that advances one node per step(), so that the traversals of
+// several independent lookups can be interleaved (as in AMAC, Kocberber et
+// al., VLDB 2015). Each step prefetches the node the next step reads, and the
+// caller steps other lookups while it loads. Same semantics as
+// find_unlocked().
+template <typename P>
+class unlocked_stepcursor {
+  public:
+    typedef typename P::value_type value_type;
+    typedef key<typename P::ikey_type> key_type;
+    typedef typename node_base<P>::nodeversion_type nodeversion_type;
+
+    value_type datum_;
+
+    void reset(const basic_table<P> &table, Str str) {
+	ka_ = key_type(str);
+	state_ = s_descend;
+	start_layer(table.root());
+    }
+
+    // Returns true once the lookup is done
+    bool step(threadinfo *ti);
+
+    bool found() const {
+	return state_ == s_found;
+    }
+
+  private:
+    enum { s_descend, s_value, s_found, s_notfound };
+
+    key_type ka_;
+    const node_base<P> *layer_root_;
+    const node_base<P> *n_;
+    const internode<P> *parent_;
+    nodeversion_type pv_;
+    int state_;
+
+    void start_layer(const node_base<P> *root) {
+	layer_root_ = n_ = root;
+	parent_ = 0;
+	n_->prefetch_full();
+    }
+};
+
 template <typename P>
 class tcursor {
   public:
@@ -52,13 +52,12 @@
 #include "clp.h"
 #include "log.hh"
 #include "checkpoint.hh"
+#include "kvdurable.hh"
 #include "file.hh"
 #include "kvproto.hh"
 #include "masstree_query.hh"
 #include <algorithm>
 
-enum { CKState_Quit, CKState_Uninit, CKState_Ready, CKState_Go };
-
 volatile bool timeout[2] = {false, false};
 double duration[2] = {10, 0};
 
@@ -67,9 +66,7 @@ Masstree::default_table *tree;
 // all default to the number of cores
 static int udpthreads = 0;
 static int tcpthreads = 0;
-static int nckthreads = 0;
 static int testthreads = 0;
-static int nlogger = 0;
 static std::vector<int> cores;
 
 static bool logging = true;
@@ -80,29 +77,13 @@ static int port = 2117;
 static uint64_t test_limit = ~uint64_t(0);
 static int doprint = 0;
 
-static volatile sig_atomic_t go_quit = 0;
 static int quit_pipe[2];
 
-static const char *logdir[MaxCores];
-static const char *ckpdir[MaxCores];
-static int nlogdir = 0;
-static int nckpdir = 0;
-
-static logset* logs;
+static durable_config durable;
 volatile bool recovering = false; // so don't add log entries, and free old value immediately
 
-static double checkpoint_interval = 1000000;
-static kvepoch_t ckp_gen = 0; // recover from checkpoint
-static ckstate *cks = NULL; // checkpoint status of all checkpointing threads
-static pthread_cond_t rec_cond;
-pthread_mutex_t rec_mu;
-static int rec_nactive;
-static int rec_state = REC_NONE;
-
 kvtimestamp_t initial_timestamp;
 
-static pthread_cond_t checkpoint_cond;
-static pthread_mutex_t checkpoint_mu;
 static struct ckstate *cktable;
 
 static void prepare_thread(threadinfo *ti);
@@ -111,16 +92,6 @@ static void *udpgo(void *);
 static int handshake(struct kvin *kvin, struct kvout *kvout, threadinfo *ti, bool &ok);
 static int onego(query<row_type> &q, struct kvin *kvin, struct kvout *kvout, reqst_machine &rsm, threadinfo *ti);
 
-static void log_init();
-static void recover(threadinfo *);
-static kvepoch_t read_checkpoint(threadinfo *, const char *path);
-static uint64_t traverse_checkpoint_inorder(uint64_t off, uint64_t n,
-                                            char *base, uint64_t *ind,
-                                            uint64_t max, threadinfo *ti);
-
-static void *conc_checkpointer(void *);
-static void recovercheckpoint(threadinfo *ti);
-
 static void *canceling(void *);
 static void catchint(int);
 static void epochinc(int);
@@ -466,7 +437,8 @@ void runtest(const char *testname, int nthreads) {
 enum { clp_val_suffixdouble = Clp_ValFirstUser };
 enum { opt_nolog = 1, opt_pin, opt_logdir, opt_port, opt_ckpdir, opt_duration,
        opt_test, opt_test_name, opt_threads, opt_cores,
-       opt_print, opt_norun, opt_checkpoint, opt_limit };
+       opt_print, opt_norun, opt_checkpoint, opt_limit,
+       opt_partitioned_replay };
 static const Clp_Option options[] = {
     { "no-log", 0, opt_nolog, 0, 0 },
     { 0, 'n', opt_nolog, 0, 0 },
@@ -494,7 +466,8 @@ static const Clp_Option options[] = {
     { "test-rw1fixed", 0, opt_test_name, 0, 0 },
     { "threads", 'j', opt_threads, Clp_ValInt, 0 },
     { "cores", 0, opt_cores, Clp_ValString, 0 },
-    { "print", 0, opt_print, 0, Clp_Negate }
+    { "print", 0, opt_print, 0, Clp_Negate },
+    { "partitioned-replay", 0, opt_partitioned_replay, 0, Clp_Negate }
 };
 
 int
@@ -502,7 +475,8 @@ main(int argc, char *argv[])
 {
   int s, ret, yes = 1, i = 1, firstcore = -1, corestride = 1;
   const char *dotest = 0;
-  nlogger = tcpthreads = udpthreads = nckthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  durable.nlogger = tcpthreads = udpthreads = durable.nckthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  durable.checkpoint_interval = 1000000;
   Clp_Parser *clp = Clp_NewParser(argc, argv, (int) arraysize(options), options);
   Clp_AddType(clp, clp_val_suffixdouble, Clp_DisallowOptions, clp_parse_suffixdouble, 0);
   int opt;
@@ -515,13 +489,12 @@ main(int argc, char *argv[])
 	  pinthreads = !clp->negated;
 	  break;
       case opt_threads:
-	  nlogger = tcpthreads = udpthreads = nckthreads = clp->val.i;
+	  durable.nlogger = tcpthreads = udpthreads = durable.nckthreads = clp->val.i;
 	  break;
       case opt_logdir: {
 	  const char *s = strtok((char *) clp->vstr, ",");
 	  while (s) {
-	      mandatory_assert(nlogdir < MaxCores);
-	      logdir[nlogdir++] = s;
+	      durable.logdir.push_back(s);
 	      s = strtok(NULL, ",");
 	  }
 	  break;
@@ -529,19 +502,18 @@ main(int argc, char *argv[])
       case opt_ckpdir: {
 	  const char *s = strtok((char *) clp->vstr, ",");
 	  while (s) {
-	      mandatory_assert(nckpdir < MaxCores);
-	      ckpdir[nckpdir++] = s;
+	      durable.ckpdir.push_back(s);
 	      s = strtok(NULL, ",");
 	  }
 	  break;
       }
       case opt_checkpoint:
 	  if (clp->negated || (clp->have_val && clp->val.d <= 0))
-	      checkpoint_interval = -1;
+	      durable.checkpoint_interval = -1;
 	  else if (clp->have_val)
-	      checkpoint_interval = clp->val.d;
+	      durable.checkpoint_interval = clp->val.d;
 	  else
-	      checkpoint_interval = 30;
+	      durable.checkpoint_interval = 30;
 	  break;
       case opt_port:
 	  port = clp->val.i;
@@ -590,6 +562,9 @@ main(int argc, char *argv[])
       case opt_norun:
 	  recovery_only = true;
 	  break;
+      case opt_partitioned_replay:
+	  durable.partitioned_replay = !clp->negated;
+	  break;
       default:
 	  fprintf(stderr, "Usage: kvd [-np] [--ld dir1[,dir2,...]] [--cd dir1[,dir2,...]]\n");
 	  exit(EXIT_FAILURE);
@@ -597,14 +572,6 @@ main(int argc, char *argv[])
   }
   Clp_DeleteParser(clp);
   Perf::stat::initmain(pinthreads);
-  if (nlogdir == 0) {
-    logdir[0] = ".";
-    nlogdir = 1;
-  }
-  if (nckpdir == 0) {
-    ckpdir[0] = ".";
-    nckpdir = 1;
-  }
   if (firstcore < 0)
       firstcore = cores.size() ? cores.back() + 1 : 0;
   for (; (int) cores.size() < udpthreads; firstcore += corestride)
@@ -613,12 +580,6 @@ main(int argc, char *argv[])
   // for -pg profiling
   signal(SIGINT, catchint);
 
-  // log epoch starts at 1
-  global_log_epoch = 1;
-  global_wake_epoch = 0;
-  log_epoch_interval.tv_sec = 0;
-  log_epoch_interval.tv_usec = 200000;
-
   // increment the global epoch every second
   if (!dotest) {
       signal(SIGALRM, epochinc);
@@ -635,18 +596,6 @@ main(int argc, char *argv[])
   ret = pthread_key_create(&threadinfo::key, 0);
   mandatory_assert(ret == 0);
 
-  // for parallel recovery
-  ret = pthread_cond_init(&rec_cond, 0);
-  mandatory_assert(ret == 0);
-  ret = pthread_mutex_init(&rec_mu, 0);
-  mandatory_assert(ret == 0);
-
-  // for waking up the checkpoint thread
-  ret = pthread_cond_init(&checkpoint_cond, 0);
-  mandatory_assert(ret == 0);
-  ret = pthread_mutex_init(&checkpoint_mu, 0);
-  mandatory_assert(ret == 0);
-
   threadinfo *main_ti = threadinfo::make(threadinfo::TI_MAIN, -1);
   main_ti->enter();
 
@@ -657,8 +606,10 @@ main(int argc, char *argv[])
          pinthreads ? "enabled" : "disabled");
   if(logging){
     printf("logging enabled\n");
-    log_init();
-    recover(main_ti);
+    durable_init(durable);
+    durable_recover(main_ti);
+    if (recovery_only)
+      exit(0);
   } else {
     printf("logging disabled\n");
   }
@@ -761,7 +712,6 @@ main(int argc, char *argv[])
 void
 catchint(int)
 {
-    go_quit = 1;
     char cmd = 0;
     // Does not matter if the write fails (when the pipe is full)
     int r = write(quit_pipe[1], &cmd, sizeof(cmd));
@@ -804,14 +754,12 @@ canceling(void *)
     (void) r;
     assert(r == sizeof(cmd) && cmd == 0);
     // Cancel wake up checkpointing threads
-    pthread_mutex_lock(&checkpoint_mu);
-    pthread_cond_signal(&checkpoint_cond);
-    pthread_mutex_unlock(&checkpoint_mu);
+    durable_quit();
 
     pthread_t me = pthread_self();
     fprintf(stderr, "\n");
     // cancel outstanding threads. Checkpointing threads will exit safely
-    // when the checkpointing thread 0 sees go_quit, and don't need cancel
+    // when the checkpointing thread 0 sees durable_quit(), and don't need cancel
     for (threadinfo *ti = threadinfo::allthreads; ti; ti = ti->ti_next)
         if (ti->ti_purpose != threadinfo::TI_MAIN
             && ti->ti_purpose != threadinfo::TI_CHECKPOINT
@@ -958,9 +906,7 @@ onego(query<row_type> &q, struct kvin *kvin, struct kvout *kvout,
     return r;
   if(rsm.cmd == Cmd_Checkpoint){
     // force checkpoint
-    pthread_mutex_lock(&checkpoint_mu);
-    pthread_cond_broadcast(&checkpoint_cond);
-    pthread_mutex_unlock(&checkpoint_mu);
+    durable_checkpoint();
   }
   else if(rsm.cmd == Cmd_Get){
     KVW(kvout, rsm.seq);
@@ -1105,7 +1051,7 @@ prepare_thread(threadinfo *ti)
     mandatory_assert(!pinthreads && "pinthreads not supported\n");
 #endif
     if (logging)
-	ti->ti_log = &logs->log(ti->ti_index % nlogger);
+	durable_attach(ti);
 }
 
 void *
@@ -1226,514 +1172,3 @@ udpgo(void *xarg)
   }
   return 0;
 }
-
-static String log_filename(const char* logdir, int logindex) {
-    struct stat sb;
-    int r = stat(logdir, &sb);
-    if (r < 0 && errno == ENOENT) {
-	r = mkdir(logdir, 0777);
-	if (r < 0) {
-	    fprintf(stderr, "%s: %s\n", logdir, strerror(errno));
-	    mandatory_assert(0);
-	}
-    }
-
-    StringAccum sa;
-    sa.snprintf(strlen(logdir) + 24, "%s/kvd-log-%d", logdir, logindex);
-    return sa.take_string();
-}
-
-void log_init() {
-  int ret, i;
-
-  logs = logset::make(nlogger);
-  for (i = 0; i < nlogger; i++)
-      logs->log(i).initialize(log_filename(logdir[i % nlogdir], i));
-
-  cks = (ckstate *)malloc(sizeof(ckstate) * nckthreads);
-  for (i = 0; i < nckthreads; i++) {
-    threadinfo *ti = threadinfo::make(threadinfo::TI_CHECKPOINT, i);
-    cks[i].state = CKState_Uninit;
-    cks[i].ti = ti;
-    ret = pthread_create(&ti->ti_threadid, 0, conc_checkpointer, ti);
-    mandatory_assert(ret == 0);
-  }
-}
-
-// p points to key\0val\0
-void insert_from_checkpoint(char *p, threadinfo *ti) {
-    int keylen = strlen(p);
-    mandatory_assert(keylen >= 0 && keylen < MaxKeyLen);
-    kvtimestamp_t ts = *(kvtimestamp_t*)(p + keylen + 1);
-    int vlen = *(int*)(p + keylen + 1 + sizeof(ts));
-    Str key(p, keylen);
-    Str value(p + keylen + 1 + sizeof(ts) + sizeof(vlen), vlen);
-    tree->checkpoint_restore(key, value, ts, ti);
-}
-
-// read a checkpoint, insert key/value pairs into tree.
-// must be followed by a read of the log!
-// since checkpoint is not consistent
-// with any one point in time.
-// returns the timestamp of the first log record that needs
-// to come from the log.
-kvepoch_t read_checkpoint(threadinfo *ti, const char *path) {
-  double t0 = now();
-
-  int fd = open(path, 0);
-  if(fd < 0){
-    printf("no %s\n", path);
-    return 0;
-  }
-  struct stat sb;
-  int ret = fstat(fd, &sb);
-  mandatory_assert(ret == 0);
-  char *p = (char *) mmap(0, sb.st_size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
-  mandatory_assert(p != MAP_FAILED);
-  close(fd);
-
-  uint64_t gen = *(uint64_t *)p;
-  uint64_t n = *(uint64_t *)(p + 8);
-  printf("reading checkpoint with %" PRIu64 " nodes\n", n);
-
-  char *keyjunk = p + 2*8; // array of key prefixes, ignore for now
-  uint64_t *ind = (uint64_t *)(keyjunk + CkpKeyPrefixLen*n);
-  char *keyval = (char *)(ind + n);
-  query<row_type> q;
-
-  // round n up to power of two
-  uint64_t n2 = pow(2, ceil(log(n) / log(2)));
-  mandatory_assert(n2 >= n);
-  traverse_checkpoint_inorder(0, n2, keyval, ind, n, ti);
-  munmap(p, sb.st_size);
-
-  double t1 = now();
-
-  printf("%.1f MB, %.2f sec, %.1f MB/sec\n",
-         sb.st_size / 1000000.0,
-         t1 - t0,
-         (sb.st_size / 1000000.0) / (t1 - t0));
-
-  return gen;
-}
-
-void
-waituntilphase(int phase)
-{
-  mandatory_assert(pthread_mutex_lock(&rec_mu) == 0);
-  while (rec_state != phase)
-    mandatory_assert(pthread_cond_wait(&rec_cond, &rec_mu) == 0);
-  mandatory_assert(pthread_mutex_unlock(&rec_mu) == 0);
-}
-
-void
-inactive(void)
-{
-  mandatory_assert(pthread_mutex_lock(&rec_mu) == 0);
-  rec_nactive --;
-  mandatory_assert(pthread_cond_broadcast(&rec_cond) == 0);
-  mandatory_assert(pthread_mutex_unlock(&rec_mu) == 0);
-}
-
-uint64_t
-traverse_checkpoint_inorder(uint64_t off, uint64_t n,
-                            char *base, uint64_t *ind, uint64_t max,
-                            threadinfo *ti)
-{
-    mandatory_assert(off == 0);
-    for (uint64_t i = 0; i < max; i++)
-        insert_from_checkpoint(base + ind[i], ti);
-    return n;
-}
-
-void recovercheckpoint(threadinfo *ti) {
-    waituntilphase(REC_CKP);
-    char path[256];
-    sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d", ckpdir[ti->ti_index % nckpdir],
-            ckp_gen.value(), ti->ti_index);
-    kvepoch_t gen = read_checkpoint(ti, path);
-    mandatory_assert(ckp_gen == gen);
-    inactive();
-}
-
-void
-recphase(int nactive, int state)
-{
-  rec_nactive = nactive;
-  rec_state = state;
-  mandatory_assert(pthread_cond_broadcast(&rec_cond) == 0);
-  while (rec_nactive)
-    mandatory_assert(pthread_cond_wait(&rec_cond, &rec_mu) == 0);
-}
-
-// read the checkpoint file.
-// read each log file.
-// insert will ignore attempts to update with timestamps
-// less than what was in the entry from the checkpoint file.
-// so we don't have to do an explicit merge by time of the log files.
-void
-recover(threadinfo *)
-{
-  recovering = true;
-  // XXX: discard temporary checkpoint and ckp-gen files generated before crash
-
-  // get the generation of the checkpoint from ckp-gen, if any
-  char path[256];
-  sprintf(path, "%s/kvd-ckp-gen", ckpdir[0]);
-  ckp_gen = 0;
-  rec_ckp_min_epoch = rec_ckp_max_epoch = 0;
-  int fd = open(path, O_RDONLY);
-  if (fd >= 0) {
-      Json ckpj = Json::parse(read_file_contents(fd));
-      close(fd);
-      if (ckpj && ckpj["kvdb_checkpoint"] && ckpj["generation"].is_number()) {
-	  ckp_gen = ckpj["generation"].to_u64();
-	  rec_ckp_min_epoch = ckpj["min_epoch"].to_u64();
-	  rec_ckp_max_epoch = ckpj["max_epoch"].to_u64();
-	  printf("recover from checkpoint %" PRIu64 " [%" PRIu64 ", %" PRIu64 "]\n", ckp_gen.value(), rec_ckp_min_epoch.value(), rec_ckp_max_epoch.value());
-      }
-  } else {
-    printf("no %s\n", path);
-  }
-  mandatory_assert(pthread_mutex_lock(&rec_mu) == 0);
-
-  // recover from checkpoint, and set timestamp of the checkpoint
-  recphase(nckthreads, REC_CKP);
-
-  // find minimum maximum timestamp of entries in each log
-  rec_log_infos = new logreplay::info_type[nlogger];
-  recphase(nlogger, REC_LOG_TS);
-
-  // replay log entries, remove inconsistent entries, and append
-  // an empty log entry with minimum timestamp
-
-  // calculate log range
-
-  // Maximum epoch seen in the union of the logs and the checkpoint. (We
-  // don't commit a checkpoint until all logs are flushed past the
-  // checkpoint's max_epoch.)
-  kvepoch_t max_epoch = rec_ckp_max_epoch;
-  if (max_epoch)
-      max_epoch = max_epoch.next_nonzero();
-  for (logreplay::info_type *it = rec_log_infos;
-       it != rec_log_infos + nlogger; ++it)
-      if (it->last_epoch
-	  && (!max_epoch || max_epoch < it->last_epoch))
-	  max_epoch = it->last_epoch;
-
-  // Maximum first_epoch seen in the logs. Full log information is not
-  // available for epochs before max_first_epoch.
-  kvepoch_t max_first_epoch = 0;
-  for (logreplay::info_type *it = rec_log_infos;
-       it != rec_log_infos + nlogger; ++it)
-      if (it->first_epoch
-	  && (!max_first_epoch || max_first_epoch < it->first_epoch))
-	  max_first_epoch = it->first_epoch;
-
-  // Maximum epoch of all logged wake commands.
-  kvepoch_t max_wake_epoch = 0;
-  for (logreplay::info_type *it = rec_log_infos;
-       it != rec_log_infos + nlogger; ++it)
-      if (it->wake_epoch
-	  && (!max_wake_epoch || max_wake_epoch < it->wake_epoch))
-	  max_wake_epoch = it->wake_epoch;
-
-  // Minimum last_epoch seen in QUIESCENT logs.
-  kvepoch_t min_quiescent_last_epoch = 0;
-  for (logreplay::info_type *it = rec_log_infos;
-       it != rec_log_infos + nlogger; ++it)
-      if (it->quiescent
-	  && (!min_quiescent_last_epoch || min_quiescent_last_epoch > it->last_epoch))
-	  min_quiescent_last_epoch = it->last_epoch;
-
-  // If max_wake_epoch && min_quiescent_last_epoch <= max_wake_epoch, then a
-  // wake command was missed by at least one quiescent log. We can't replay
-  // anything at or beyond the minimum missed wake epoch. So record, for
-  // each log, the minimum wake command that at least one quiescent thread
-  // missed.
-  if (max_wake_epoch && min_quiescent_last_epoch <= max_wake_epoch)
-      rec_replay_min_quiescent_last_epoch = min_quiescent_last_epoch;
-  else
-      rec_replay_min_quiescent_last_epoch = 0;
-  recphase(nlogger, REC_LOG_ANALYZE_WAKE);
-
-  // Calculate upper bound of epochs to replay.
-  // This is the minimum of min_post_quiescent_wake_epoch (if any) and the
-  // last_epoch of all non-quiescent logs.
-  rec_replay_max_epoch = max_epoch;
-  for (logreplay::info_type *it = rec_log_infos;
-       it != rec_log_infos + nlogger; ++it) {
-      if (!it->quiescent
-          && it->last_epoch
-	  && it->last_epoch < rec_replay_max_epoch)
-	  rec_replay_max_epoch = it->last_epoch;
-      if (it->min_post_quiescent_wake_epoch
-          && it->min_post_quiescent_wake_epoch < rec_replay_max_epoch)
-          rec_replay_max_epoch = it->min_post_quiescent_wake_epoch;
-  }
-
-  // Calculate lower bound of epochs to replay.
-  rec_replay_min_epoch = rec_ckp_min_epoch;
-  // XXX what about max_first_epoch?
-
-  // Checks.
-  if (rec_ckp_min_epoch) {
-      mandatory_assert(rec_ckp_min_epoch > max_first_epoch);
-      mandatory_assert(rec_ckp_min_epoch < rec_replay_max_epoch);
-      mandatory_assert(rec_ckp_max_epoch < rec_replay_max_epoch);
-      fprintf(stderr, "replay [%" PRIu64 ",%" PRIu64 ") from [%" PRIu64 ",%" PRIu64 ") into ckp [%" PRIu64 ",%" PRIu64 "]\n",
-	      rec_replay_min_epoch.value(), rec_replay_max_epoch.value(),
-	      max_first_epoch.value(), max_epoch.value(),
-	      rec_ckp_min_epoch.value(), rec_ckp_max_epoch.value());
-  }
-
-  // Actually replay.
-  delete[] rec_log_infos;
-  rec_log_infos = 0;
-  recphase(nlogger, REC_LOG_REPLAY);
-
-  // done recovering
-  recphase(0, REC_DONE);
-#if !NDEBUG
-  // check that all delta markers have been recycled (leaving only remove
-  // markers and real values)
-  uint64_t deltas_created = 0, deltas_removed = 0;
-  for (threadinfo *ti = threadinfo::allthreads; ti; ti = ti->ti_next) {
-      deltas_created += ti->pstat.deltas_created;
-      deltas_removed += ti->pstat.deltas_removed;
-  }
-  if (deltas_created)
-      fprintf(stderr, "deltas created: %" PRIu64 ", removed: %" PRIu64 "\n", deltas_created, deltas_removed);
-  mandatory_assert(deltas_created == deltas_removed);
-#endif
-
-  global_log_epoch = rec_replay_max_epoch.next_nonzero();
-
-  mandatory_assert(pthread_mutex_unlock(&rec_mu) == 0);
-  recovering = false;
-  if (recovery_only)
-      exit(0);
-}
-
-void
-writecheckpoint(const char *path, ckstate *c, double t0)
-{
-  double t1 = now();
-  printf("memory phase: %" PRIu64 " nodes, %.2f sec\n", c->count, t1 - t0);
-
-  int fd = creat(path, 0666);
-  mandatory_assert(fd >= 0);
-
-  // checkpoint file format:
-  //   ckp_gen (64 bits)
-  //   #keys (64 bits)
-  //   #keys * CKKEYLEN key prefixes, in lexical order
-  //   #keys * CKKEYLEN 64-bit indices, in lexical order, into...
-  //   key/val pairs
-
-  checked_write(fd, &ckp_gen, sizeof(ckp_gen));
-  checked_write(fd, &c->count, sizeof(c->count));
-  checked_write(fd, c->keys->buf, c->keys->n);
-  checked_write(fd, c->ind->buf, c->ind->n);
-  checked_write(fd, c->vals->buf, c->vals->n);
-
-  int ret = fsync(fd);
-  mandatory_assert(ret == 0);
-  ret = close(fd);
-  mandatory_assert(ret == 0);
-
-  double t2 = now();
-  c->bytes = c->keys->n + c->ind->n + c->vals->n;
-  printf("file phase (%s): %" PRIu64 " bytes, %.2f sec, %.1f MB/sec\n",
-         path,
-         c->bytes,
-         t2 - t1,
-         (c->bytes / 1000000.0) / (t2 - t1));
-}
-
-void
-conc_filecheckpoint(threadinfo *ti)
-{
-  ckstate *c = &cks[ti->ti_index];
-  c->keys = new_bufkvout();
-  c->vals = new_bufkvout();
-  c->ind = new_bufkvout();
-  double t0 = now();
-  tree->scan(c->q, ti);
-  char path[256];
-  sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d", ckpdir[ti->ti_index % nckpdir],
-          ckp_gen.value(), ti->ti_index);
-  writecheckpoint(path, c, t0);
-  c->count = 0;
-  free(c->keys);
-  free(c->vals);
-  free(c->ind);
-}
-
-static Json
-prepare_checkpoint(kvepoch_t min_epoch, int nckthreads, const Str *pv)
-{
-    Json j;
-    j.set("kvdb_checkpoint", true)
-	.set("min_epoch", min_epoch.value())
-	.set("max_epoch", global_log_epoch.value())
-	.set("generation", ckp_gen.value())
-	.set("nckthreads", nckthreads);
-
-    Json pvj;
-    for (int i = 1; i < nckthreads; ++i)
-	pvj.push_back(Json::make_string(pv[i].s, pv[i].len));
-    j.set("pivots", pvj);
-
-    return j;
-}
-
-static void
-commit_checkpoint(Json ckpj)
-{
-    // atomically commit a set of checkpoint files by incrementing
-    // the checkpoint generation on disk
-    char path[256];
-    sprintf(path, "%s/kvd-ckp-gen", ckpdir[0]);
-    int r = atomic_write_file_contents(path, ckpj.unparse());
-    mandatory_assert(r == 0);
-    fprintf(stderr, "kvd-ckp-%" PRIu64 " [%s,%s]: committed\n",
-	    ckp_gen.value(), ckpj["min_epoch"].to_s().c_str(),
-	    ckpj["max_epoch"].to_s().c_str());
-
-    // delete old checkpoint files
-    for (int i = 0; i < nckthreads; i++) {
-	char path[256];
-	sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d", ckpdir[i % nckpdir],
-		ckp_gen.value() - 1, i);
-	unlink(path);
-    }
-}
-
-static kvepoch_t
-max_flushed_epoch()
-{
-    kvepoch_t mfe = 0, ge = global_log_epoch;
-    for (int i = 0; i < nlogger; ++i) {
-        loginfo& log = logs->log(i);
-	kvepoch_t fe = log.quiescent() ? ge : log.flushed_epoch();
-	if (!mfe || fe < mfe)
-	    mfe = fe;
-    }
-    return mfe;
-}
-
-// concurrent periodic checkpoint
-void *
-conc_checkpointer(void *xarg)
-{
-  threadinfo *ti = (threadinfo *) xarg;
-  ti->enter();
-  recovercheckpoint(ti);
-  ckstate *c = &cks[ti->ti_index];
-  c->count = 0;
-  pthread_cond_init(&c->state_cond, NULL);
-  c->state = CKState_Ready;
-  while (recovering)
-    sleep(1);
-  if (checkpoint_interval <= 0)
-      return 0;
-  if (ti->ti_index == 0) {
-    for (int i = 1; i < nckthreads; i++)
-      while (cks[i].state != CKState_Ready)
-        ;
-    Str *pv = new Str[nckthreads + 1];
-    Json uncommitted_ckp;
-
-    while (1) {
-      struct timespec ts;
-      set_timespec(ts, now() + (uncommitted_ckp ? 0.25 : checkpoint_interval));
-
-      pthread_mutex_lock(&checkpoint_mu);
-      if (!go_quit)
-        pthread_cond_timedwait(&checkpoint_cond, &checkpoint_mu, &ts);
-      if (go_quit) {
-          for (int i = 0; i < nckthreads; i++) {
-              cks[i].state = CKState_Quit;
-              pthread_cond_signal(&cks[i].state_cond);
-          }
-          pthread_mutex_unlock(&checkpoint_mu);
-          break;
-      }
-      pthread_mutex_unlock(&checkpoint_mu);
-
-      if (uncommitted_ckp) {
-	  kvepoch_t mfe = max_flushed_epoch();
-	  if (!mfe || mfe > uncommitted_ckp["max_epoch"].to_u64()) {
-	      commit_checkpoint(uncommitted_ckp);
-	      uncommitted_ckp = Json();
-	  }
-	  continue;
-      }
-
-      double t0 = now();
-      ti->rcu_start();
-      for (int i = 0; i < nckthreads + 1; i++)
-        pv[i].assign(NULL, 0);
-      tree->findpivots(pv, nckthreads + 1);
-      ti->rcu_stop();
-
-      kvepoch_t min_epoch = global_log_epoch;
-      pthread_mutex_lock(&checkpoint_mu);
-      ckp_gen = ckp_gen.next_nonzero();
-      for (int i = 0; i < nckthreads; i++) {
-	  Str endkey = (i == nckthreads - 1 ? Str() : pv[i + 1]);
-	  cks[i].q.begin_checkpoint(&cks[i], pv[i], endkey);
-	  cks[i].state = CKState_Go;
-	  pthread_cond_signal(&cks[i].state_cond);
-      }
-      pthread_mutex_unlock(&checkpoint_mu);
-
-      ti->rcu_start();
-      conc_filecheckpoint(ti);
-      ti->rcu_stop();
-
-      cks[0].state = CKState_Ready;
-      uint64_t bytes = cks[0].bytes;
-      pthread_mutex_lock(&checkpoint_mu);
-      for (int i = 1; i < nckthreads; i++) {
-        while (cks[i].state != CKState_Ready)
-          pthread_cond_wait(&cks[i].state_cond, &checkpoint_mu);
-        bytes += cks[i].bytes;
-      }
-      pthread_mutex_unlock(&checkpoint_mu);
-
-      uncommitted_ckp = prepare_checkpoint(min_epoch, nckthreads, pv);
-
-      for (int i = 0; i < nckthreads + 1; i++)
-        if (pv[i].s)
-          free((void *)pv[i].s);
-      double t = now() - t0;
-      fprintf(stderr, "kvd-ckp-%" PRIu64 " [%s,%s]: prepared (%.2f sec, %" PRIu64 " MB, %" PRIu64 " MB/sec)\n",
-	      ckp_gen.value(), uncommitted_ckp["min_epoch"].to_s().c_str(),
-	      uncommitted_ckp["max_epoch"].to_s().c_str(),
-	      t, bytes / (1 << 20), (uint64_t)(bytes / t) >> 20);
-    }
-  } else {
-    while(1) {
-      pthread_mutex_lock(&checkpoint_mu);
-      while (c->state != CKState_Go && c->state != CKState_Quit)
-        pthread_cond_wait(&c->state_cond, &checkpoint_mu);
-      if (c->state == CKState_Quit) {
-        pthread_mutex_unlock(&checkpoint_mu);
-        break;
-      }
-      pthread_mutex_unlock(&checkpoint_mu);
-
-      ti->rcu_start();
-      conc_filecheckpoint(ti);
-      ti->rcu_stop();
-
-      pthread_mutex_lock(&checkpoint_mu);
-      c->state = CKState_Ready;
-      pthread_cond_signal(&c->state_cond);
-      pthread_mutex_unlock(&checkpoint_mu);
-    }
-  }
-  return 0;
-}
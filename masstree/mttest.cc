@@ -56,6 +56,8 @@
 #include "kvtest.hh"
 #include "kvrandom.hh"
 #include "kvrow.hh"
+#include "kvdurable.hh"
+#include "log.hh"
 #include "clp.h"
 #include <algorithm>
 
@@ -74,11 +76,13 @@ static const char *gid = NULL;
 static int udpthreads = 0;
 static int tcpthreads = 0;
 
+static bool interleave = false; // tbench tests batch gets with many_get
 static bool tree_stats = false;
 static bool json_stats = false;
 static bool pinthreads = false;
+static bool logging = false;
+static durable_config durable;
 volatile uint64_t globalepoch = 1;     // global epoch, updated by main thread regularly
-kvepoch_t global_log_epoch = 0;
 static int port = 2117;
 static int rscale_ncores = 0;
 
@@ -89,6 +93,7 @@ static struct {
 } numa[MaxNumaNode];
 #endif
 
+Masstree::default_table *tree; // the table being tested, for recovery
 volatile bool recovering = false; // so don't add log entries, and free old value immediately
 kvtimestamp_t initial_timestamp;
 
@@ -200,6 +205,9 @@ struct kvtest_server {
     }
 
     void many_get_check(int nk, long ikey[], long iexpected[]);
+    int many_get_sync(const Str *keys, int nk);
+
+    bool interleave_gets() const { return ::interleave; }
     void scan_sync(const Str &firstkey, int n,
 		   std::vector<Str> &keys, std::vector<Str> &values);
     void rscan_sync(const Str &firstkey, int n,
@@ -269,6 +277,12 @@ struct kvtest_server {
 
     void wait_all() {}
 
+    // Called once the tree is populated, as the measured run begins
+    void populated() {
+        if (logging && durable.checkpoint_interval > 0)
+            durable_checkpoint();
+    }
+
     void rcu_quiesce() {
         uint64_t e = timestamp() >> 16;
         if (e != globalepoch)
@@ -303,6 +317,7 @@ struct kvtest_server {
     Json json_;
     int ncores_;
     kvout *kvo_;
+    std::vector<query<row_type> > mq_;
 
   private:
     void output_scan(std::vector<Str> &keys, std::vector<Str> &values) const;
@@ -395,6 +410,15 @@ void kvtest_server<T>::many_get_check(int nk, long ikey[], long iexpected[]) {
     }
 }
 
+template <typename T>
+int kvtest_server<T>::many_get_sync(const Str *keys, int nk) {
+    if ((int) mq_.size() < nk)
+        mq_.resize(nk);
+    for (int i = 0; i < nk; ++i)
+        mq_[i].begin_get1(keys[i]);
+    return table_->many_get(mq_.data(), nk, ti_);
+}
+
 template <typename T>
 void kvtest_server<T>::scan_sync(const Str &firstkey, int n,
 				 std::vector<Str> &keys,
@@ -443,6 +467,8 @@ template <typename T>
 void kvtest_server<T>::put(const Str &key, const Str &value) {
     q_[0].begin_replace(key, value);
     table_->replace(q_[0], ti_);
+    if (ti_->ti_log) // NB may block
+	ti_->ti_log->record(logcmd_put1, q_[0].query_times(), key, value);
 }
 
 template <typename T>
@@ -450,8 +476,11 @@ void kvtest_server<T>::put_col(const Str &key, int col, const Str &value) {
 #if !KVDB_ROW_TYPE_STR
     if (!kvo_)
 	kvo_ = new_kvout(-1, 2048);
-    q_[0].begin_put(key, row_type::make_put_col_request(kvo_, col, value));
+    Str req = row_type::make_put_col_request(kvo_, col, value);
+    q_[0].begin_put(key, req);
     table_->put(q_[0], ti_);
+    if (ti_->ti_log) // NB may block
+	ti_->ti_log->record(logcmd_put, q_[0].query_times(), key, req);
 #else
     (void) key, (void) col, (void) value;
     assert(0);
@@ -460,7 +489,10 @@ void kvtest_server<T>::put_col(const Str &key, int col, const Str &value) {
 
 template <typename T> inline bool kvtest_remove(kvtest_server<T> &server, const Str &key) {
     server.q_[0].begin_remove(key);
-    return server.table_->remove(server.q_[0], server.ti_);
+    bool removed = server.table_->remove(server.q_[0], server.ti_);
+    if (removed && server.ti_->ti_log) // NB may block
+	server.ti_->ti_log->record(logcmd_remove, server.q_[0].query_times(), key, Str());
+    return removed;
 }
 
 template <typename T>
@@ -533,6 +565,8 @@ struct test_thread {
     test_thread(void *arg) {
 	server_.set_table(table_, (threadinfo *) arg);
 	server_.ti_->enter();
+	if (logging)
+	    durable_attach(server_.ti_);
 	server_.ti_->rcu_start();
     }
     ~test_thread() {
@@ -614,9 +648,18 @@ struct test_thread {
     }
     void run(const String &test) {
 
-        assert(test == "mycsba");
-
-        kvtest_mycsba(server_);
+        if (test == "mycsba")
+            kvtest_mycsba(server_);
+        else if (test == "ycsb")
+            kvtest_ycsb(server_);
+        else if (test == "lookup_seq")
+            kvtest_lookup(server_, true);
+        else if (test == "lookup_rand")
+            kvtest_lookup(server_, false);
+        else if (test == "recover")
+            /* recovery is measured at startup */;
+        else
+            server_.fail("unknown test %s", test.c_str());
 
         // if (test == "rw1")
         //     kvtest_rw1(server_);
@@ -755,7 +798,8 @@ enum { opt_pin = 1, opt_port, opt_duration,
        opt_test, opt_test_name, opt_threads, opt_trials, opt_quiet, opt_print,
        opt_normalize, opt_limit, opt_notebook, opt_compare, opt_no_run,
        opt_lazy_timer, opt_gid, opt_tree_stats, opt_rscale_ncores, opt_cores,
-       opt_stats };
+       opt_stats, opt_interleave, opt_log, opt_logdir, opt_ckpdir,
+       opt_log_epoch, opt_checkpoint, opt_partitioned_replay };
 static const Clp_Option options[] = {
     { "pin", 'p', opt_pin, 0, Clp_Negate },
     { "port", 0, opt_port, Clp_ValInt, 0 },
@@ -780,7 +824,16 @@ static const Clp_Option options[] = {
     { "stats", 0, opt_stats, 0, 0 },
     { "compare", 'c', opt_compare, Clp_ValString, 0 },
     { "cores", 0, opt_cores, Clp_ValString, 0 },
-    { "no-run", 0, opt_no_run, 0, 0 }
+    { "no-run", 0, opt_no_run, 0, 0 },
+    { "interleave", 0, opt_interleave, 0, Clp_Negate },
+    { "log", 0, opt_log, 0, Clp_Negate },
+    { "logdir", 0, opt_logdir, Clp_ValString, 0 },
+    { "ld", 0, opt_logdir, Clp_ValString, 0 },
+    { "ckpdir", 0, opt_ckpdir, Clp_ValString, 0 },
+    { "cd", 0, opt_ckpdir, Clp_ValString, 0 },
+    { "log-epoch", 0, opt_log_epoch, Clp_ValDouble, 0 },
+    { "checkpoint", 0, opt_checkpoint, Clp_ValDouble, Clp_Optional | Clp_Negate },
+    { "partitioned-replay", 0, opt_partitioned_replay, 0, Clp_Negate }
 };
 
 static void run_one_test(int trial, const char *treetype, const char *test,
@@ -868,6 +921,45 @@ main(int argc, char *argv[])
         case opt_stats:
             json_stats = true;
             break;
+        case opt_interleave:
+            interleave = !clp->negated;
+            break;
+        case opt_log:
+            logging = !clp->negated;
+            break;
+        case opt_logdir:
+        case opt_ckpdir: {
+            std::vector<const char *> &dirs =
+                opt == opt_logdir ? durable.logdir : durable.ckpdir;
+            const char *s = strtok((char *) clp->vstr, ",");
+            while (s) {
+                dirs.push_back(s);
+                s = strtok(NULL, ",");
+            }
+            logging = true;
+            break;
+        }
+        case opt_log_epoch:
+            // the logger naps for one epoch at a time, at microsecond
+            // resolution
+            if (clp->val.d < 1e-6) {
+                Clp_OptionError(clp, "bad %<%O%>, expected at least 0.000001 (seconds)");
+                exit(EXIT_FAILURE);
+            }
+            durable.log_epoch_interval = clp->val.d;
+            logging = true;
+            break;
+        case opt_checkpoint:
+            if (clp->negated || (clp->have_val && clp->val.d <= 0))
+                durable.checkpoint_interval = -1;
+            else {
+                durable.checkpoint_interval = clp->have_val ? clp->val.d : 30;
+                logging = true;
+            }
+            break;
+        case opt_partitioned_replay:
+            durable.partitioned_replay = !clp->negated;
+            break;
 	case opt_notebook:
 	    if (clp->negated)
 		notebook = 0;
@@ -925,6 +1017,7 @@ main(int argc, char *argv[])
         firstcore = cores.size() ? cores.back() + 1 : 0;
     for (; (int) cores.size() < udpthreads; firstcore += corestride)
         cores.push_back(firstcore);
+    durable.nlogger = durable.nckthreads = udpthreads;
 
 #if PMC_ENABLED
     mandatory_assert(pinthreads && "Using performance counter requires pinning threads to cores!");
@@ -1011,6 +1104,25 @@ main(int argc, char *argv[])
     exit(0);
 }
 
+// Start logging and checkpointing, first recovering the tree from any
+// previous run's checkpoint and logs. Reports recovery throughput.
+static void recover_table(threadinfo *main_ti) {
+    tree = test_thread<Masstree::default_table>::table_;
+    durable_init(durable);
+    durable_recovery_stats rs;
+    durable_recover(main_ti, &rs);
+    fprintf(stderr, "recovery: checkpoint %" PRIu64 " records, %.1f MB in %.3f s"
+            " (%.0f records/s, %.1f MB/s)\n", rs.ckp_records,
+            rs.ckp_bytes / 1e6, rs.ckp_time,
+            rs.ckp_time ? rs.ckp_records / rs.ckp_time : 0,
+            rs.ckp_time ? rs.ckp_bytes / 1e6 / rs.ckp_time : 0);
+    fprintf(stderr, "recovery: log %" PRIu64 " records (%" PRIu64 " applied),"
+            " %.1f MB in %.3f s (%.0f records/s, %.1f MB/s)\n", rs.log_records,
+            rs.log_applied, rs.log_bytes / 1e6, rs.log_time,
+            rs.log_time ? rs.log_records / rs.log_time : 0,
+            rs.log_time ? rs.log_bytes / 1e6 / rs.log_time : 0);
+}
+
 static void run_one_test_body(int trial, const char *treetype, const char *test) {
     threadinfo *main_ti = threadinfo::make(threadinfo::TI_MAIN, -1);
     main_ti->enter();
@@ -1020,6 +1132,8 @@ static void run_one_test_body(int trial, const char *treetype, const char *test)
 	    current_test_name = test;
 	    current_trial = trial;
 	    test_thread_map[i].func(main_ti); // initialize table
+	    if (logging)
+		recover_table(main_ti);
 	    runtest(tcpthreads, test_thread_map[i].func);
             if (tree_stats)
                 test_thread_map[i].func(0); // print tree_stats
@@ -10,6 +10,10 @@ const long mycsbaSeed = 3242323423L;
 const int mycsbaDbSize = 1000000;
 const int mycsbaKeySize = 4 + 18 + 1;
 const int mycsbaValSize = 12; // int32_t can be up to 2B => 10 digits + minus sign
+const int mycsbaDrawsPerKey = 18 + 1; // genKeyVal: 18 key digits + 1 value
+const uint64_t tbenchReportInterval = 10000; // requests between reports
+const long lookupDbSize = 1000000;
+const long lookupGets = 10000000; // per thread, unless set with --limit
 
 enum ReqType { GET, PUT };
 enum Status { SUCCESS, FAILURE };
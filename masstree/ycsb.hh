@@ -0,0 +1,69 @@
+#ifndef __YCSB_HH
+#define __YCSB_HH
+
+#include "getopt.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+// YCSB core workloads for the tbench client and server. The client draws
+// operations and keys; the server loads the initial records and executes
+// operations. Both read the record layout from the environment.
+
+const int ycsbKeySize = 4 + 20 + 1; // "user" + 64-bit hash in decimal
+const int ycsbMaxBatch = 256;
+
+// Also used as the request class, so latencies can be reported per op type
+enum YcsbOp {
+    YCSB_READ = 1,
+    YCSB_UPDATE,
+    YCSB_INSERT,
+    YCSB_SCAN,
+    YCSB_RMW,     // read-modify-write
+    YCSB_DELETE,
+    YCSB_NUM_OPS
+};
+
+struct YcsbRequest {
+    YcsbOp op;
+    uint32_t scanLen;
+    char key[ycsbKeySize];
+};
+
+struct YcsbConfig {
+    uint64_t recordCount;
+    int fieldCount;
+    int fieldLength;
+    int maxScanLength;
+
+    static YcsbConfig fromEnv() {
+        YcsbConfig c;
+        c.recordCount = getOpt<uint64_t>("TBENCH_YCSB_RECORDS", 1000000);
+        c.fieldCount = getOpt<int>("TBENCH_YCSB_FIELDS", 10);
+        c.fieldLength = getOpt<int>("TBENCH_YCSB_FIELD_LEN", 100);
+        c.maxScanLength = getOpt<int>("TBENCH_YCSB_MAX_SCAN", 100);
+        return c;
+    }
+
+    // Records are stored as a single value holding all fields
+    int recordSize() const { return fieldCount * fieldLength; }
+};
+
+// 64-bit FNV-1a over the bytes of v, as YCSB's Utils.fnvhash64
+static inline uint64_t ycsbHash(uint64_t v) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; ++i) {
+        h ^= v & 0xFF;
+        h *= 1099511628211ULL;
+        v >>= 8;
+    }
+    return h;
+}
+
+// Record keynum's key. Keys are hashed, so inserts are not in key order.
+static inline void ycsbBuildKey(uint64_t keynum, char* key) {
+    snprintf(key, ycsbKeySize, "user%llu",
+             (unsigned long long) ycsbHash(keynum));
+}
+
+#endif
@@ -16,7 +16,7 @@
 // behavior- the default implementation is just nops
 template <template <typename> class Transaction>
 struct base_txn_btree_handler {
-  static inline void on_construct() {} // called when initializing
+  static inline void on_construct(concurrent_btree *btr) {} // called when initializing
   static const bool has_background_task = false;
 };
 
@@ -36,7 +36,7 @@ public:
       name(name),
       been_destructed(false)
   {
-    base_txn_btree_handler<Transaction>::on_construct();
+    base_txn_btree_handler<Transaction>::on_construct(&underlying_btree);
   }
 
   ~base_txn_btree()
@@ -67,6 +67,14 @@ public:
     underlying_btree.print();
   }
 
+  // gets of present keys go through a hash (see
+  // concurrent_btree::init_point_hash()). call before the table is used
+  inline void
+  init_point_hash(size_t expected_nkeys)
+  {
+    underlying_btree.init_point_hash(expected_nkeys);
+  }
+
   /**
    * only call when you are sure there are no concurrent modifications on the
    * tree. is neither threadsafe nor transactional
@@ -168,6 +176,19 @@ protected:
             const typename P::Key &k,
             ValueReader &value_reader);
 
+  // looks up keys[0, n) as n do_search() calls would, reading the tuples
+  // in key order, but lets the underlying tree overlap the traversals.
+  // value_readers[i] reads the value of keys[i]. n <= MultiSearchMaxKeys
+  template <typename Traits, typename ValueReaders>
+  inline void
+  do_multi_search(Transaction<Traits> &t,
+                  const typename P::Key *keys,
+                  ValueReaders &value_readers,
+                  bool *found,
+                  size_t n);
+
+  static const size_t MultiSearchMaxKeys = 32;
+
   template <typename Traits, typename Callback,
             typename KeyReader, typename ValueReader>
   inline void
@@ -239,6 +260,40 @@ base_txn_btree<Transaction, P>::do_search(
   }
 }
 
+template <template <typename> class Transaction, typename P>
+template <typename Traits, typename ValueReaders>
+void
+base_txn_btree<Transaction, P>::do_multi_search(
+    Transaction<Traits> &t,
+    const typename P::Key *keys,
+    ValueReaders &value_readers,
+    bool *found,
+    size_t n)
+{
+  INVARIANT(n <= MultiSearchMaxKeys);
+  t.ensure_active();
+
+  varkey key_strs[MultiSearchMaxKeys];
+  for (size_t i = 0; i < n; i++) {
+    typename P::KeyWriter key_writer(&keys[i]);
+    key_strs[i] = varkey(*key_writer.fully_materialize(true, t.string_allocator()));
+  }
+
+  typename concurrent_btree::value_type underlying_vs[MultiSearchMaxKeys];
+  concurrent_btree::versioned_node_t search_infos[MultiSearchMaxKeys];
+  this->underlying_btree.multi_search(key_strs, n, underlying_vs, found, search_infos);
+
+  // the read and absent sets end up as n do_search() calls would leave them
+  for (size_t i = 0; i < n; i++) {
+    if (found[i]) {
+      const dbtuple * const tuple = reinterpret_cast<const dbtuple *>(underlying_vs[i]);
+      found[i] = t.do_tuple_read(tuple, value_readers[i]);
+    } else {
+      t.do_node_read(search_infos[i].first, search_infos[i].second);
+    }
+  }
+}
+
 template <template <typename> class Transaction, typename P>
 std::map<std::string, uint64_t>
 base_txn_btree<Transaction, P>::unsafe_purge(bool dump_stats)
@@ -7,6 +7,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "abstract_ordered_index.h"
 #include "../str_arena.h"
@@ -56,6 +57,35 @@ public:
    */
   virtual void do_txn_finish() const {}
 
+  /**
+   * rebuild the open tables from the checkpoint (if checkpoint_dir is not
+   * empty) and logs of an earlier run, in place of loading them. returns
+   * false if this db cannot recover
+   */
+  virtual bool
+  do_txn_recover(const std::string &checkpoint_dir,
+                 const std::vector<std::string> &logfiles, bool compressed)
+  {
+    return false;
+  }
+
+  /**
+   * checkpoint the open tables into dir every interval_ms while txns run,
+   * with nthreads threads reading at most max_bytes_per_sec between them
+   * (0 for no limit). returns false if this db cannot checkpoint
+   */
+  virtual bool
+  do_txn_checkpoint_start(const std::string &dir, uint64_t interval_ms,
+                          size_t nthreads, uint64_t max_bytes_per_sec)
+  {
+    return false;
+  }
+
+  /**
+   * stop checkpointing, once txns have stopped
+   */
+  virtual void do_txn_checkpoint_stop() {}
+
   /** loader should be used as a performance hint, not for correctness */
   virtual void thread_init(bool loader) {}
 
@@ -67,6 +97,15 @@ public:
 
   virtual void reset_ntxn_persisted() { }
 
+  /**
+   * for acknowledging txns only once they are durable: every txn the calling
+   * thread has committed so far is in an epoch <= get_txn_epoch(), and every
+   * txn in an epoch <= get_persisted_epoch() is durable
+   */
+  virtual uint64_t get_txn_epoch() const { return 0; }
+
+  virtual uint64_t get_persisted_epoch() const { return 0; }
+
   enum TxnProfileHint {
     HINT_DEFAULT,
 
@@ -130,6 +169,21 @@ public:
              size_t value_size_hint,
              bool mostly_append = false) = 0;
 
+  /**
+   * Opens a table which txns only access by exact key: get(), put(),
+   * insert() and remove(). Such a table may be hash indexed, in which case
+   * scans on it are rejected. expected_nkeys sizes the hash.
+   *
+   * The default opens an ordered index
+   */
+  virtual abstract_ordered_index *
+  open_hash_index(const std::string &name,
+                  size_t value_size_hint,
+                  size_t expected_nkeys)
+  {
+    return open_index(name, value_size_hint);
+  }
+
   virtual void
   close_index(abstract_ordered_index *idx) = 0;
 };
@@ -29,6 +29,24 @@ public:
       std::string &value,
       size_t max_bytes_read = std::string::npos) = 0;
 
+  /**
+   * Get n keys at once: found[i] and values[i] are set as
+   * get(txn, keys[i], values[i], max_bytes_read) would set them. The keys are
+   * read in order, so a key may repeat, but a put() made later in the txn is
+   * not seen. Indexes may overlap the lookups; the default does not
+   */
+  virtual void multi_get(
+      void *txn,
+      const std::string *keys,
+      std::string *values,
+      bool *found,
+      size_t n,
+      size_t max_bytes_read = std::string::npos)
+  {
+    for (size_t i = 0; i < n; i++)
+      found[i] = get(txn, keys[i], values[i], max_bytes_read);
+  }
+
   class scan_callback {
   public:
     virtual ~scan_callback() {}
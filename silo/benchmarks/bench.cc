@@ -4,10 +4,14 @@
 #include <vector>
 #include <utility>
 #include <string>
+#include <thread>
+#include <limits>
+#include <functional>
 
 #include <stdlib.h>
 #include <sched.h>
 #include <unistd.h>
+#include <numa.h>
 #include <sys/sysinfo.h>
 
 #include "bench.h"
@@ -15,6 +19,7 @@
 #include "../counter.h"
 #include "../scopedperf.hh"
 #include "../allocator.h"
+#include "../lockguard.h"
 
 #ifdef USE_JEMALLOC
 //cannot include this header b/c conflicts with malloc.h
@@ -46,6 +51,18 @@ int slow_exit = 0;
 int retry_aborted_transaction = 0;
 int no_reset_counters = 0;
 int backoff_aborted_transaction = 0;
+vector<string> recover_logfiles;
+int recover_compressed = 0;
+string recover_checkpoint_dir;
+string checkpoint_dir;
+uint64_t checkpoint_interval_ms = 10000;
+size_t checkpoint_threads = 1;
+uint64_t checkpoint_max_bytes_per_sec = 0;
+int durable_acks = 0;
+int partition_dispatch = 0;
+size_t snapshot_workers = 0;
+int contention_manager = 0;
+int numa_aware = 0;
 
 template <typename T>
 static void
@@ -107,6 +124,114 @@ write_cb(void *p, const char *s)
 
 static event_avg_counter evt_avg_abort_spins("avg_abort_spins");
 
+void
+request_queue::push(const Request &req, void *handle)
+{
+  {
+    std::lock_guard<std::mutex> l(lock);
+    entries.push_back(entry());
+    entries.back().req = req;
+    entries.back().handle = handle;
+  }
+  nonempty.notify_one();
+}
+
+bool
+request_queue::pop(entry &e)
+{
+  std::unique_lock<std::mutex> l(lock);
+  // wake up now and then to notice that the run is over
+  while (entries.empty())
+    if (!nonempty.wait_for(l, chrono::milliseconds(10),
+                           [this] { return !entries.empty(); }) &&
+        !running)
+      return false;
+  e = entries.front();
+  entries.pop_front();
+  return true;
+}
+
+bool
+request_queue::try_pop(entry &e, uint64_t wait_us)
+{
+  std::unique_lock<std::mutex> l(lock);
+  if (entries.empty() &&
+      (!wait_us ||
+       !nonempty.wait_for(l, chrono::microseconds(wait_us),
+                          [this] { return !entries.empty(); })))
+    return false;
+  e = entries.front();
+  entries.pop_front();
+  return true;
+}
+
+// with contention_manager, the txns of a conflict key (see
+// bench_worker::conflict_key()) run one at a time, in arrival order: a worker
+// that finds a key's txns running queues its request for the worker running
+// them, and moves on to its next request
+class conflict_queues {
+public:
+  // returns true if the caller is now the one running key's txns. otherwise,
+  // req has been queued for the worker that is, with a response handle
+  bool
+  acquire(size_t key, const Request &req, void *handle)
+  {
+    slot &sl = slots[key % NSlots].elem;
+    ::lock_guard<spinlock> l(sl.lock);
+    if (!sl.running) {
+      sl.running = true;
+      return true;
+    }
+    request_queue::entry e;
+    e.req = req;
+    e.handle = handle ? handle : tBenchDeferResp();
+    sl.waiting.push_back(e);
+    return false;
+  }
+
+  // called by the worker running key's txns after each one. returns the
+  // next queued request in e, or false (and stops running key's txns) if
+  // there is none
+  bool
+  release(size_t key, request_queue::entry &e)
+  {
+    slot &sl = slots[key % NSlots].elem;
+    ::lock_guard<spinlock> l(sl.lock);
+    if (sl.waiting.empty()) {
+      sl.running = false;
+      return false;
+    }
+    e = sl.waiting.front();
+    sl.waiting.pop_front();
+    return true;
+  }
+
+private:
+  // keys that share a slot are run one at a time too
+  static const size_t NSlots = 1024;
+
+  struct slot {
+    slot() : running(false) {}
+    spinlock lock;
+    bool running;
+    deque<request_queue::entry> waiting;
+  };
+  aligned_padded_elem<slot, false> slots[NSlots];
+};
+
+static conflict_queues g_conflict_queues;
+
+// answers a request, also telling the harness how many attempts it took
+static void
+send_resp(const Response &resp, void *handle)
+{
+  tBenchSetRespAttempts(resp.attempts, resp.aborted_us * 1000);
+  if (handle)
+    tBenchSendDeferredResp(handle, &resp, sizeof(resp));
+  else
+    tBenchSendResp(&resp, sizeof(resp));
+}
+
 void
 bench_worker::run()
 {
@@ -118,64 +243,266 @@ bench_worker::run()
     scoped_rcu_region r; // register this thread in rcu region
   }
   on_run_setup();
+  // on_run_setup() pins the worker, if it is to be pinned
+  if (numa_aware)
+    numa_node = numa_node_of_cpu(sched_getcpu());
   scoped_db_thread_ctx ctx(db, false);
   const workload_desc_vec workload = get_workload();
   txn_counts.resize(workload.size());
   barrier_a->count_down();
   barrier_b->wait_for();
 
-  tBenchServerThreadStart();
+  // with a queue, only the dispatcher receives from the harness
+  if (!queue)
+    tBenchServerThreadStart();
 
   while (running && (run_mode != RUNMODE_OPS || ntxn_commits < ops_per_worker)) {
     Request* req;
-    tBenchRecvReq(reinterpret_cast<void**>(&req));
-    Response resp;
-retry:
-    timer t;
+    void *handle = nullptr;
+    request_queue::entry e;
+    if (queue) {
+      if (!pop_request(e))
+        break;
+      req = &e.req;
+      handle = e.handle;
+    } else {
+      tBenchRecvReq(reinterpret_cast<void**>(&req));
+    }
+    // req is freed once it is answered, possibly by another thread
+    const size_t key = contention_manager ? conflict_key(*req) : NoConflictKey;
+    if (key != NoConflictKey && !g_conflict_queues.acquire(key, *req, handle))
+      continue;
+    serve(workload, *req, handle);
+    if (key != NoConflictKey)
+      // the txns queued on key while this one ran, in order
+      while (g_conflict_queues.release(key, e))
+        serve(workload, e.req, e.handle);
+  }
+}
+
+bool
+bench_worker::pop_request(request_queue::entry &e)
+{
+  if (steal_queues.empty()) {
+    if (!queue->pop(e))
+      return false;
+    nreqs_popped++;
+    return true;
+  }
+  // how long to wait on our own queue before looking at the others again
+  static const uint64_t StealWaitUs = 100;
+  for (;;) {
+    if (queue->try_pop(e)) {
+      nreqs_popped++;
+      return true;
+    }
+    for (auto q : steal_queues)
+      if (q->try_pop(e)) {
+        nreqs_popped++;
+        nreqs_stolen++;
+        return true;
+      }
+    if (queue->try_pop(e, StealWaitUs)) {
+      nreqs_popped++;
+      return true;
+    }
+    if (!running)
+      return false;
+  }
+}
+
+void
+bench_worker::serve(const workload_desc_vec &workload, const Request &req,
+                    void *handle)
+{
+  const uint32_t type = req.type;
+  cur_req = &req;
+  Response resp;
+  resp.attempts = 0;
+  resp.aborted_us = 0;
+  if (unlikely(rejects(req))) {
+    // retrying would not help
+    resp.success = false;
+    send_resp(resp, handle);
+    return;
+  }
+  timer t;
+  for (;;) {
+    resp.attempts++;
     const unsigned long old_seed = r.get_seed();
-    const auto ret = workload[req->type].fn(this);
+    const auto ret = workload[type].fn(this);
     if (likely(ret.first)) {
-        ++ntxn_commits;
-        latency_numer_us += t.lap();
-        backoff_shifts >>= 1;
-        resp.success = true;
-        tBenchSendResp(&resp, sizeof(resp));
-    } else {
-        ++ntxn_aborts;
-        if (retry_aborted_transaction && running) {
-            if (backoff_aborted_transaction) {
-                if (backoff_shifts < 63)
-                    backoff_shifts++;
-                uint64_t spins = 1UL << backoff_shifts;
-                spins *= 100; // XXX: tuned pretty arbitrarily
-                evt_avg_abort_spins.offer(spins);
-                while (spins) {
-                    nop_pause();
-                    spins--;
-                }
-            }
-            r.set_seed(old_seed);
-            goto retry;
-        }
+      ++ntxn_commits;
+      latency_numer_us += t.lap();
+      backoff_shifts >>= 1;
+      resp.success = true;
+      size_delta += ret.second;
+      break;
     }
-    size_delta += ret.second; // should be zero on abort
-    txn_counts[req->type]++; // txn_counts aren't used to compute throughput (is
-    // just an informative number to print to the console
-    // in verbose mode)
+    ++ntxn_aborts;
+    if (!retry_aborted_transaction || !running) {
+      resp.success = false;
+      resp.aborted_us += t.lap();
+      break;
+    }
+    if (backoff_aborted_transaction) {
+      if (backoff_shifts < 63)
+        backoff_shifts++;
+      uint64_t spins = 1UL << backoff_shifts;
+      spins *= 100; // XXX: tuned pretty arbitrarily
+      evt_avg_abort_spins.offer(spins);
+      while (spins) {
+        nop_pause();
+        spins--;
+      }
+    }
+    r.set_seed(old_seed);
+    resp.aborted_us += t.lap();
   }
+  txn_counts[type]++; // txn_counts aren't used to compute throughput (is
+  // just an informative number to print to the console
+  // in verbose mode)
+
+  // an aborted txn has nothing to make durable
+  if (durable_acks && resp.success)
+    defer_resp(resp, handle ? handle : tBenchDeferResp());
+  else
+    send_resp(resp, handle);
 }
 
 void
-bench_runner::run()
+bench_worker::defer_resp(const Response &resp, void *handle)
+{
+  pending_ack a;
+  a.epoch = db->get_txn_epoch();
+  a.handle = handle;
+  a.resp = resp;
+  ::lock_guard<spinlock> l(acks_lock);
+  pending_acks.push_back(a);
+}
+
+void
+bench_worker::release_acks(uint64_t epoch)
+{
+  // send outside of acks_lock, so the worker does not wait on the harness
+  vector<pending_ack> ready;
+  {
+    ::lock_guard<spinlock> l(acks_lock);
+    while (!pending_acks.empty() && pending_acks.front().epoch <= epoch) {
+      ready.push_back(pending_acks.front());
+      pending_acks.pop_front();
+    }
+  }
+  for (auto &a : ready)
+    send_resp(a.resp, a.handle);
+}
+
+// with durable_acks, answers the workers' txns as their epochs persist. once
+// stop is set (after the workers' txns have all been made durable), answers
+// whatever is left and returns
+static void
+durable_acker(abstract_db *db, const vector<bench_worker *> &workers,
+              const volatile bool *stop)
+{
+  uint64_t last_epoch = 0;
+  for (;;) {
+    const bool stopping = *stop;
+    const uint64_t epoch = stopping ?
+      numeric_limits<uint64_t>::max() : db->get_persisted_epoch();
+    if (epoch != last_epoch) {
+      for (auto w : workers)
+        w->release_acks(epoch);
+      last_epoch = epoch;
+    }
+    if (stopping)
+      return;
+    usleep(100);
+  }
+}
+
+size_t
+bench_runner::partition_of(const Request &req) const
+{
+  ALWAYS_ASSERT(false); // benchmarks with partitions override this
+  return 0;
+}
+
+bool
+bench_runner::is_snapshot_txn(const Request &req) const
+{
+  ALWAYS_ASSERT(false); // benchmarks with snapshot txns override this
+  return false;
+}
+
+// with partition_dispatch, snapshot_workers or numa_aware, receives every
+// request and queues it on queues[queue_of(req)]. never returns: the harness
+// ends the process once it has seen its last response
+static void
+dispatcher(function<size_t (const Request &)> queue_of,
+           const vector<request_queue *> &queues)
+{
+  tBenchServerThreadStart();
+  for (;;) {
+    Request *req;
+    tBenchRecvReq(reinterpret_cast<void**>(&req));
+    const size_t p = queue_of(*req);
+    ALWAYS_ASSERT(p < queues.size());
+    queues[p]->push(*req, tBenchDeferResp());
+  }
+}
+
+vector<size_t>
+bench_runner::make_node_queues(const vector<bench_worker *> &workers)
 {
-  tBenchServerInit(nthreads);
+  // a partition belongs to the node of the first worker serving it
+  map<int, size_t> node_index;
+  vector<size_t> partition_node_queues(queues.size(), size_t(-1));
+  for (auto w : workers) {
+    if (!node_index.count(w->get_numa_node())) {
+      const size_t n = node_queues.size();
+      node_index[w->get_numa_node()] = n;
+      node_queues.push_back(new request_queue);
+    }
+    const size_t p =
+      find(queues.begin(), queues.end(), w->get_queue()) - queues.begin();
+    ALWAYS_ASSERT(p < queues.size());
+    if (partition_node_queues[p] == size_t(-1))
+      partition_node_queues[p] = node_index[w->get_numa_node()];
+  }
+  for (auto w : workers) {
+    const size_t n = node_index[w->get_numa_node()];
+    vector<request_queue *> others;
+    for (size_t i = 1; i < node_queues.size(); i++)
+      others.push_back(node_queues[(n + i) % node_queues.size()]);
+    w->set_node_queues(node_queues[n], others);
+  }
+  if (verbose)
+    cerr << "[numa] " << queues.size() << " partitions over "
+         << node_queues.size() << " nodes" << endl;
+  return partition_node_queues;
+}
 
-  // load data
-  const vector<bench_loader *> loaders = make_loaders();
+void
+bench_runner::run()
+{
+  // with partition_dispatch, snapshot_workers or numa_aware, the dispatcher
+  // is the only thread that receives
+  tBenchServerInit(
+      partition_dispatch || snapshot_workers || numa_aware ? 1 : nthreads);
+
+  // load data, or recover it from the checkpoint and logs of an earlier run
+  const bool recover =
+    !recover_logfiles.empty() || !recover_checkpoint_dir.empty();
+  const vector<bench_loader *> loaders =
+    recover ? vector<bench_loader *>() : make_loaders();
   {
-    spin_barrier b(loaders.size());
     const pair<uint64_t, uint64_t> mem_info_before = get_system_memory_info();
-    {
+    if (recover) {
+      scoped_timer t("recovery", verbose);
+      ALWAYS_ASSERT(db->do_txn_recover(
+            recover_checkpoint_dir, recover_logfiles, recover_compressed));
+    } else {
+      spin_barrier b(loaders.size());
       scoped_timer t("dataloading", verbose);
       for (vector<bench_loader *>::const_iterator it = loaders.begin();
           it != loaders.end(); ++it) {
@@ -234,13 +561,56 @@ bench_runner::run()
 
   const vector<bench_worker *> workers = make_workers();
   ALWAYS_ASSERT(!workers.empty());
+  if (partition_dispatch && queues.empty()) {
+    cerr << "[ERROR] benchmark does not support --partition-dispatch" << endl;
+    ALWAYS_ASSERT(false);
+  }
+  if (numa_aware && queues.empty()) {
+    cerr << "[ERROR] benchmark does not support --numa-aware" << endl;
+    ALWAYS_ASSERT(false);
+  }
+  if (snapshot_workers) {
+    // a long snapshot txn then never holds up an update queued behind it
+    ALWAYS_ASSERT(snapshot_workers < workers.size());
+    queues.push_back(new request_queue); // updates
+    queues.push_back(new request_queue); // snapshot txns
+    for (size_t i = 0; i < workers.size(); i++)
+      workers[i]->set_queue(
+          queues[i >= workers.size() - snapshot_workers ? 1 : 0]);
+  }
   for (vector<bench_worker *>::const_iterator it = workers.begin();
        it != workers.end(); ++it)
     (*it)->start();
+  if (!checkpoint_dir.empty())
+    ALWAYS_ASSERT(db->do_txn_checkpoint_start(
+          checkpoint_dir, checkpoint_interval_ms, checkpoint_threads,
+          checkpoint_max_bytes_per_sec));
+  volatile bool acker_stop = false;
+  thread acker;
+  if (durable_acks)
+    acker = thread(durable_acker, db, cref(workers), &acker_stop);
 
   barrier_a.wait_for(); // wait for all threads to start up
+  // the workers are now pinned, and wait on barrier_b
+  vector<size_t> partition_node_queues;
+  if (numa_aware)
+    partition_node_queues = make_node_queues(workers);
   timer t, t_nosync;
   barrier_b.count_down(); // bombs away!
+  if (numa_aware)
+    thread(dispatcher,
+           [this, partition_node_queues] (const Request &req) {
+             return partition_node_queues[partition_of(req)];
+           },
+           cref(node_queues)).detach();
+  else if (partition_dispatch)
+    thread(dispatcher,
+           [this] (const Request &req) { return partition_of(req); },
+           cref(queues)).detach();
+  else if (snapshot_workers)
+    thread(dispatcher,
+           [this] (const Request &req) { return size_t(is_snapshot_txn(req)); },
+           cref(queues)).detach();
   if (run_mode == RUNMODE_TIME) {
     sleep(runtime);
     running = false;
@@ -249,7 +619,24 @@ bench_runner::run()
   for (size_t i = 0; i < nthreads; i++)
     workers[i]->join();
   const unsigned long elapsed_nosync = t_nosync.lap();
+  if (!checkpoint_dir.empty())
+    db->do_txn_checkpoint_stop();
+  if (numa_aware) {
+    size_t npopped = 0, nstolen = 0;
+    for (auto w : workers) {
+      npopped += w->get_nreqs_popped();
+      nstolen += w->get_nreqs_stolen();
+    }
+    cerr << "[numa] " << node_queues.size() << " nodes, " << nstolen
+         << " of " << npopped << " requests served off their partition's node ("
+         << (npopped ? 100.0 * double(nstolen) / double(npopped) : 0.0)
+         << "% remote)" << endl;
+  }
   db->do_txn_finish(); // waits for all worker txns to persist
+  if (durable_acks) {
+    acker_stop = true;
+    acker.join();
+  }
   size_t n_commits = 0;
   size_t n_aborts = 0;
   uint64_t latency_numer_us = 0;
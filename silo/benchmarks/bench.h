@@ -3,16 +3,21 @@
 
 #include <stdint.h>
 
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <utility>
 #include <string>
 
 #include "abstract_db.h"
+#include "request.h"
 #include "../macros.h"
 #include "../thread.h"
 #include "../util.h"
 #include "../spinbarrier.h"
+#include "../spinlock.h"
 #include "../rcu.h"
 
 extern void ycsb_do_test(abstract_db *db, int argc, char **argv);
@@ -41,6 +46,18 @@ extern int slow_exit;
 extern int retry_aborted_transaction;
 extern int no_reset_counters;
 extern int backoff_aborted_transaction;
+extern std::vector<std::string> recover_logfiles; // recover instead of loading
+extern int recover_compressed;
+extern std::string recover_checkpoint_dir; // load this checkpoint first
+extern std::string checkpoint_dir; // checkpoint while the workers run
+extern uint64_t checkpoint_interval_ms;
+extern size_t checkpoint_threads;
+extern uint64_t checkpoint_max_bytes_per_sec; // 0 for no limit
+extern int durable_acks; // respond only once a txn's epoch is persisted
+extern int partition_dispatch; // queue each request for its partition's workers
+extern size_t snapshot_workers; // the last of the workers serve only snapshot txns
+extern int contention_manager; // run the txns of a conflict key one at a time
+extern int numa_aware; // serve each request on the NUMA node of its partition
 
 class scoped_db_thread_ctx {
 public:
@@ -101,6 +118,30 @@ protected:
   str_arena arena;
 };
 
+// with partition_dispatch, snapshot_workers or numa_aware, a dispatcher
+// thread receives every request and queues it, with its response handle
+// (from tBenchDeferResp()), for the workers that serve it
+class request_queue {
+public:
+  struct entry {
+    Request req; // a copy: the harness may reuse the buffer it received into
+    void *handle;
+  };
+
+  void push(const Request &req, void *handle);
+
+  // waits for an entry. returns false if running was cleared first
+  bool pop(entry &e);
+
+  // waits at most wait_us for an entry. returns false if there was none
+  bool try_pop(entry &e, uint64_t wait_us = 0);
+
+private:
+  std::mutex lock;
+  std::condition_variable nonempty;
+  std::deque<entry> entries;
+};
+
 class bench_worker : public ndb_thread {
 public:
 
@@ -111,11 +152,13 @@ public:
                spin_barrier *barrier_a, spin_barrier *barrier_b)
     : worker_id(worker_id), set_core_id(set_core_id),
       r(seed), db(db), open_tables(open_tables),
-      barrier_a(barrier_a), barrier_b(barrier_b),
+      barrier_a(barrier_a), barrier_b(barrier_b), cur_req(nullptr),
       // the ntxn_* numbers are per worker
       ntxn_commits(0), ntxn_aborts(0),
       latency_numer_us(0),
       backoff_shifts(0), // spin between [0, 2^backoff_shifts) times before retry
+      queue(nullptr),
+      numa_node(-1), nreqs_popped(0), nreqs_stolen(0),
       size_delta(0)
   {
     txn_obj_buf.reserve(str_arena::MinStrReserveLength);
@@ -128,12 +171,14 @@ public:
   typedef std::pair<bool, ssize_t> txn_result;
   typedef txn_result (*txn_fn_t)(bench_worker *);
 
+  // requests name their txn by its index in the workload. a txn of
+  // frequency 0 runs only when a request asks for it
   struct workload_desc {
     workload_desc() {}
     workload_desc(const std::string &name, double frequency, txn_fn_t fn)
       : name(name), frequency(frequency), fn(fn)
     {
-      ALWAYS_ASSERT(frequency > 0.0);
+      ALWAYS_ASSERT(frequency >= 0.0);
       ALWAYS_ASSERT(frequency <= 1.0);
     }
     std::string name;
@@ -171,10 +216,48 @@ public:
 
   inline ssize_t get_size_delta() const { return size_delta; }
 
+  // with durable_acks, sends the queued responses of txns in epochs <=
+  // epoch. can be called from any thread
+  void release_acks(uint64_t epoch);
+
+  // with partition_dispatch or snapshot_workers, serve the requests of q
+  // instead of receiving from the harness. set before the worker starts
+  inline void set_queue(request_queue *q) { queue = q; }
+  inline request_queue *get_queue() const { return queue; }
+
+  // with numa_aware, the node the worker runs on, once it has started
+  inline int get_numa_node() const { return numa_node; }
+
+  // with numa_aware, serve the requests of q, the queue of this worker's
+  // node, and those of others only while q is empty. set while the worker
+  // waits on barrier_b
+  inline void
+  set_node_queues(request_queue *q, const std::vector<request_queue *> &others)
+  {
+    queue = q;
+    steal_queues = others;
+  }
+
+  // requests taken from a queue, and those of them taken from another
+  // node's queue
+  inline size_t get_nreqs_popped() const { return nreqs_popped; }
+  inline size_t get_nreqs_stolen() const { return nreqs_stolen; }
+
+  static const size_t NoConflictKey = size_t(-1);
+
 protected:
 
   virtual void on_run_setup() {}
 
+  // with contention_manager, txns with the same key (e.g. the NewOrders of
+  // one district) are likely to abort each other, so they are run one at a
+  // time instead. NoConflictKey if req can run with anything
+  virtual size_t conflict_key(const Request &req) const { return NoConflictKey; }
+
+  // whether req asks for a txn this benchmark's configuration cannot run
+  // (e.g. a scan of a hash index). such a request fails without running
+  virtual bool rejects(const Request &req) const { return false; }
+
   inline void *txn_buf() { return (void *) txn_obj_buf.data(); }
 
   unsigned int worker_id;
@@ -184,6 +267,7 @@ protected:
   std::map<std::string, abstract_ordered_index *> open_tables;
   spin_barrier *const barrier_a;
   spin_barrier *const barrier_b;
+  const Request *cur_req; // the request being served
 
 private:
   size_t ntxn_commits;
@@ -191,6 +275,33 @@ private:
   uint64_t latency_numer_us;
   unsigned backoff_shifts;
 
+  request_queue *queue;
+
+  int numa_node;
+  std::vector<request_queue *> steal_queues;
+  size_t nreqs_popped;
+  size_t nreqs_stolen;
+
+  // takes the next request from queue or, if it is empty, steal_queues.
+  // returns false once running is cleared
+  bool pop_request(request_queue::entry &e);
+
+  // runs req, retrying it on abort, and answers it. a nullptr handle
+  // answers the request this thread received last
+  void serve(const workload_desc_vec &workload, const Request &req,
+             void *handle);
+
+  // queues resp until the txn it answers is durable
+  void defer_resp(const Response &resp, void *handle);
+
+  struct pending_ack {
+    uint64_t epoch;
+    void *handle; // from tBenchDeferResp()
+    Response resp;
+  };
+  spinlock acks_lock;
+  std::deque<pending_ack> pending_acks; // in epoch order
+
 protected:
 
 #ifdef ENABLE_BENCH_TXN_COUNTERS
@@ -224,9 +335,31 @@ protected:
   // only called once
   virtual std::vector<bench_worker*> make_workers() = 0;
 
+  // with partition_dispatch or numa_aware, the index in queues of the
+  // partition that serves req
+  virtual size_t partition_of(const Request &req) const;
+
+  // with snapshot_workers, whether req is a read-only txn that runs on a
+  // snapshot, and so is served by the snapshot workers
+  virtual bool is_snapshot_txn(const Request &req) const;
+
+  // with numa_aware, makes node_queues and hands each worker the queue of its
+  // node. returns, for each partition, the index of its node's queue
+  std::vector<size_t> make_node_queues(const std::vector<bench_worker *> &workers);
+
   abstract_db *const db;
   std::map<std::string, abstract_ordered_index *> open_tables;
 
+  // with partition_dispatch (or numa_aware), one per partition.
+  // make_workers() creates them and hands each worker the queue of its
+  // partition. with snapshot_workers, run() makes one for updates and one
+  // for snapshot txns
+  std::vector<request_queue *> queues;
+
+  // with numa_aware, one per node the workers run on. run() hands each
+  // worker the queue of its node in place of its partition's
+  std::vector<request_queue *> node_queues;
+
   // barriers for actual benchmark execution
   spin_barrier barrier_a;
   spin_barrier barrier_b;
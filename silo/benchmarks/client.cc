@@ -2,9 +2,32 @@
 #include "../macros.h"
 #include "request.h"
 #include "tbench_client.h"
+#include "tpcc_inputs.h"
+#include "ycsb_inputs.h"
 #include "../util.h"
 
+#include <cstdlib>
 #include <cstring>
+#include <string>
+#include <iostream>
+
+/*******************************************************************************
+ * Helpers
+ *******************************************************************************/
+// The client's settings come from the environment, like the harness's own
+static unsigned long getEnvOpt(const char* name, unsigned long defVal) {
+    const char* opt = getenv(name);
+    if (!opt || !*opt) return defVal;
+    std::cout << name << " = " << opt << std::endl;
+    return strtoul(opt, nullptr, 10);
+}
+
+static std::string getEnvStr(const char* name, const std::string& defVal) {
+    const char* opt = getenv(name);
+    if (!opt || !*opt) return defVal;
+    std::cout << name << " = " << opt << std::endl;
+    return opt;
+}
 
 /*******************************************************************************
  * Class Definitions
@@ -23,13 +46,106 @@ class Client {
         std::vector<WorkloadDesc> workload;
         util::fast_random randgen;
 
-        Client() : randgen(seed) 
+        // The inputs of each txn are drawn here, unless serverInputs is set.
+        // nwarehouses must match the server's --scale-factor. hotPct% of
+        // txns run at one of the first hotWarehouses warehouses, the rest at
+        // any warehouse
+        unsigned nwarehouses;
+        unsigned hotWarehouses;
+        unsigned hotPct;
+        bool serverInputs;
+        tpcc_input_generator inputGen;
+
+        // With TBENCH_BENCH=ycsb, requests are YCSB ops for a server run
+        // with --bench ycsb instead, drawn by ycsbGen
+        ycsb_input_generator* ycsbGen;
+
+        Client()
+            : randgen(seed)
+            , nwarehouses(getEnvOpt("TBENCH_TPCC_WAREHOUSES", 1))
+            , hotWarehouses(getEnvOpt("TBENCH_TPCC_HOT_WAREHOUSES", 0))
+            , hotPct(getEnvOpt("TBENCH_TPCC_HOT_PCT", 0))
+            , serverInputs(getEnvOpt("TBENCH_TPCC_SERVER_INPUTS", 0))
+            , inputGen(nwarehouses,
+                    getEnvOpt("TBENCH_TPCC_REMOTE_ITEM_PCT", 1),
+                    getEnvOpt("TBENCH_TPCC_REMOTE_PAYMENT_PCT", 15),
+                    getEnvOpt("TBENCH_TPCC_UNIFORM_ITEMS", 0))
+            , ycsbGen(nullptr)
         { 
             for (size_t i = 0; i < ARRAY_NELEMS(g_txn_workload_mix); ++i) {
                 WorkloadDesc w = { .type = static_cast<ReqType>(i), 
                     .frequency = static_cast<double>(g_txn_workload_mix[i]) / 100.0 };
                 workload.push_back(w);
             }
+
+            if (hotWarehouses > nwarehouses || hotPct > 100) {
+                std::cerr << "TBENCH_TPCC_HOT_WAREHOUSES must be at most "
+                    << "TBENCH_TPCC_WAREHOUSES, and TBENCH_TPCC_HOT_PCT at "
+                    << "most 100" << std::endl;
+                exit(-1);
+            }
+
+            std::string bench = getEnvStr("TBENCH_BENCH", "tpcc");
+            if (bench == "ycsb") {
+                ycsbGen = makeYcsbGen();
+            } else if (bench != "tpcc") {
+                std::cerr << "TBENCH_BENCH must be tpcc or ycsb" << std::endl;
+                exit(-1);
+            }
+        }
+
+        // The records must match the server's: --scale-factor * 1000
+        static ycsb_input_generator* makeYcsbGen() {
+            // % of reads, updates, inserts, scans and read-modify-writes
+            unsigned mix[YCSB_NUM_OPS] = { 50, 50, 0, 0, 0 };
+            std::string mixStr = getEnvStr("TBENCH_YCSB_MIX", "");
+            if (!mixStr.empty()) {
+                std::vector<std::string> toks = util::split(mixStr, ',');
+                unsigned s = 0;
+                for (size_t i = 0; i < toks.size() && i < YCSB_NUM_OPS; ++i) {
+                    mix[i] = strtoul(toks[i].c_str(), nullptr, 10);
+                    s += mix[i];
+                }
+                if (toks.size() != YCSB_NUM_OPS || s != 100) {
+                    std::cerr << "TBENCH_YCSB_MIX must be 5 percentages "
+                        << "summing to 100" << std::endl;
+                    exit(-1);
+                }
+            }
+
+            ycsb_input_generator::key_dist dist;
+            std::string distStr = getEnvStr("TBENCH_YCSB_DIST", "zipfian");
+            if (distStr == "uniform") {
+                dist = ycsb_input_generator::UNIFORM;
+            } else if (distStr == "zipfian") {
+                dist = ycsb_input_generator::ZIPFIAN;
+            } else if (distStr == "latest") {
+                dist = ycsb_input_generator::LATEST;
+            } else {
+                std::cerr << "TBENCH_YCSB_DIST must be uniform, zipfian or "
+                    << "latest" << std::endl;
+                exit(-1);
+            }
+
+            // YCSB's zipfian constant
+            double theta = strtod(
+                    getEnvStr("TBENCH_YCSB_THETA", "0.99").c_str(), nullptr);
+            if (!(theta > 0 && theta < 1)) {
+                std::cerr << "TBENCH_YCSB_THETA must be in (0, 1)" << std::endl;
+                exit(-1);
+            }
+
+            return new ycsb_input_generator(mix,
+                    getEnvOpt("TBENCH_YCSB_RECORDS", 1000), dist, theta,
+                    getEnvOpt("TBENCH_YCSB_MAX_SCAN_LEN", 100));
+        }
+
+        unsigned pickWarehouse() {
+            if (hotWarehouses > 0 &&
+                    RandomNumber(randgen, 1, 100) <= static_cast<int>(hotPct)) {
+                return RandomNumber(randgen, 1, hotWarehouses);
+            }
+            return RandomNumber(randgen, 1, nwarehouses);
         }
 
     public:
@@ -42,6 +158,11 @@ class Client {
         Request getReq() {
             Request req;
 
+            if (ycsbGen) {
+                ycsbGen->generate(randgen, req);
+                return req;
+            }
+
             double d = randgen.next_uniform();
             for (size_t i = 0; i < workload.size(); ++i) {
                 if (((i + 1) == workload.size()) ||
@@ -52,6 +173,12 @@ class Client {
 
                 d -= workload[i].frequency;
             }
+
+            if (serverInputs) {
+                req.has_inputs = false;
+            } else {
+                inputGen.generate(randgen, pickWarehouse(), req);
+            }
             
             return req;
         }
@@ -73,6 +200,8 @@ void tBenchClientInit() {
 
 size_t tBenchClientGenReq(void* data) {
     Request req = Client::getSingleton()->getReq();
+    // so that lats_classes.bin splits the latencies by txn type (or op)
+    tBenchClientSetReqClass(req.type);
     memcpy(data, reinterpret_cast<const void*>(&req), sizeof(req));
     return sizeof(req);
 }
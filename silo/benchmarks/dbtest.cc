@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -9,6 +10,7 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <numa.h>
 #include <sys/sysinfo.h>
 
 #include "../allocator.h"
@@ -73,6 +75,8 @@ main(int argc, char **argv)
   int fake_writes = 0;
   int disable_gc = 0;
   int disable_snapshots = 0;
+  uint64_t epoch_us = 0;
+  uint64_t snapshot_epoch_ticks = 0;
   vector<string> logfiles;
   vector<vector<unsigned>> assignments;
   string stats_server_sockfile;
@@ -100,6 +104,20 @@ main(int argc, char **argv)
       {"log-nofsync"                , no_argument       , &nofsync                   , 1}   ,
       {"log-compress"               , no_argument       , &do_compress               , 1}   ,
       {"log-fake-writes"            , no_argument       , &fake_writes               , 1}   ,
+      {"recover-logfile"            , required_argument , 0                          , 'R'} ,
+      {"recover-compressed"         , no_argument       , &recover_compressed        , 1}   ,
+      {"recover-checkpoint"         , required_argument , 0                          , 'K'} ,
+      {"checkpoint-dir"             , required_argument , 0                          , 'C'} ,
+      {"checkpoint-interval-ms"     , required_argument , 0                          , 'I'} ,
+      {"checkpoint-threads"         , required_argument , 0                          , 'T'} ,
+      {"checkpoint-rate-mb"         , required_argument , 0                          , 'M'} , // MB/sec, 0 for no limit
+      {"durable-acks"               , no_argument       , &durable_acks              , 1}   ,
+      {"epoch-us"                   , required_argument , 0                          , 'e'} ,
+      {"partition-dispatch"         , no_argument       , &partition_dispatch        , 1}   ,
+      {"snapshot-workers"           , required_argument , 0                          , 'S'} ,
+      {"snapshot-epoch-ticks"       , required_argument , 0                          , 'E'} ,
+      {"contention-manager"         , no_argument       , &contention_manager        , 1}   ,
+      {"numa-aware"                 , no_argument       , &numa_aware                , 1}   , // needs --numa-memory
       {"disable-gc"                 , no_argument       , &disable_gc                , 1}   ,
       {"disable-snapshots"          , no_argument       , &disable_snapshots         , 1}   ,
       {"stats-server-sockfile"      , required_argument , 0                          , 'x'} ,
@@ -107,7 +125,7 @@ main(int argc, char **argv)
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    int c = getopt_long(argc, argv, "b:s:t:d:B:f:r:n:o:m:l:a:x:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "b:s:t:d:B:f:r:n:o:m:l:a:R:K:C:I:T:M:e:S:E:x:", long_options, &option_index);
     if (c == -1)
       break;
 
@@ -181,6 +199,46 @@ main(int argc, char **argv)
           ParseCSVString<unsigned, RangeAwareParser<unsigned>>(optarg));
       break;
 
+    case 'R':
+      recover_logfiles.emplace_back(optarg);
+      break;
+
+    case 'K':
+      recover_checkpoint_dir = optarg;
+      break;
+
+    case 'C':
+      checkpoint_dir = optarg;
+      break;
+
+    case 'I':
+      checkpoint_interval_ms = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(checkpoint_interval_ms > 0);
+      break;
+
+    case 'T':
+      checkpoint_threads = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(checkpoint_threads > 0);
+      break;
+
+    case 'M':
+      checkpoint_max_bytes_per_sec = strtoul(optarg, NULL, 10) << 20;
+      break;
+
+    case 'e':
+      epoch_us = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(epoch_us > 0);
+      break;
+
+    case 'S':
+      snapshot_workers = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'E':
+      snapshot_epoch_ticks = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(snapshot_epoch_ticks > 0);
+      break;
+
     case 'x':
       stats_server_sockfile = optarg;
       break;
@@ -226,6 +284,72 @@ main(int argc, char **argv)
     cerr << "[WARNING] --log-nofsync has no effect with --log-fake-writes enabled" << endl;
   }
 
+  if (recover_compressed && recover_logfiles.empty()) {
+    cerr << "[ERROR] --recover-compressed specified without --recover-logfile" << endl;
+    return 1;
+  }
+
+  if ((!checkpoint_dir.empty() || !recover_checkpoint_dir.empty()) &&
+      db_type != "ndb-proto2") {
+    cerr << "[ERROR] benchmark " << db_type
+         << " does not have checkpoints" << endl;
+    return 1;
+  }
+
+  if (!checkpoint_dir.empty() && disable_snapshots) {
+    cerr << "[ERROR] --checkpoint-dir specified with snapshots disabled" << endl;
+    return 1;
+  }
+
+  if (durable_acks && logfiles.empty()) {
+    cerr << "[ERROR] --durable-acks specified without logging enabled" << endl;
+    return 1;
+  }
+
+  // logging truncates its logfiles before the benchmark starts
+  for (auto &fname : recover_logfiles)
+    if (find(logfiles.begin(), logfiles.end(), fname) != logfiles.end()) {
+      cerr << "[ERROR] cannot recover from " << fname
+           << ", which is also a --logfile" << endl;
+      return 1;
+    }
+
+  if (snapshot_workers && snapshot_workers >= nthreads) {
+    cerr << "[ERROR] --snapshot-workers must leave at least one of the "
+         << nthreads << " workers for updates" << endl;
+    return 1;
+  }
+
+  if (snapshot_workers && partition_dispatch) {
+    cerr << "[ERROR] --snapshot-workers cannot be combined with --partition-dispatch" << endl;
+    return 1;
+  }
+
+  if (numa_aware && (partition_dispatch || snapshot_workers)) {
+    cerr << "[ERROR] --numa-aware cannot be combined with --partition-dispatch "
+         << "or --snapshot-workers" << endl;
+    return 1;
+  }
+
+  // with a single node, every worker is on the node of every partition
+  if (numa_aware &&
+      (numa_available() < 0 || numa_num_configured_nodes() < 2)) {
+    cerr << "[WARNING] --numa-aware on a host with a single NUMA node, "
+         << "running without it" << endl;
+    numa_aware = 0;
+  }
+
+  // the workers of a partition run, and its loaders allocate, on the node of
+  // the CPU whose --numa-memory region it is loaded into
+  if (numa_aware && !numa_memory) {
+    cerr << "[ERROR] --numa-aware needs --numa-memory" << endl;
+    return 1;
+  }
+
+  // nothing has run yet, so the new length takes effect from the next tick
+  if (epoch_us)
+    ticker::tick_us = epoch_us;
+
 #ifndef ENABLE_EVENT_COUNTERS
   if (!stats_server_sockfile.empty()) {
     cerr << "[WARNING] --stats-server-sockfile with no event counters enabled is useless" << endl;
@@ -241,7 +365,8 @@ main(int argc, char **argv)
   }
 
   const set<string> can_persist({"ndb-proto2"});
-  if (!logfiles.empty() && !can_persist.count(db_type)) {
+  if ((!logfiles.empty() || !recover_logfiles.empty()) &&
+      !can_persist.count(db_type)) {
     cerr << "[ERROR] benchmark " << db_type
          << " does not have persistence implemented" << endl;
     return 1;
@@ -275,6 +400,21 @@ main(int argc, char **argv)
   }
 #endif
 
+  if ((snapshot_workers || snapshot_epoch_ticks) && db_type != "ndb-proto2") {
+    cerr << "[ERROR] benchmark " << db_type
+         << " does not have snapshot txns" << endl;
+    return 1;
+  }
+
+  if (snapshot_workers && disable_snapshots) {
+    cerr << "[ERROR] --snapshot-workers specified with snapshots disabled" << endl;
+    return 1;
+  }
+
+  // as with epoch_us, nothing has run yet
+  if (snapshot_epoch_ticks)
+    transaction_proto2_static::ReadOnlyEpochMultiplier = snapshot_epoch_ticks;
+
   if (db_type == "bdb") {
     const string cmd = "rm -rf " + basedir + "/db/*";
     // XXX(stephentu): laziness
@@ -283,7 +423,8 @@ main(int argc, char **argv)
   } else if (db_type == "ndb-proto1") {
     // XXX: hacky simulation of proto1
     db = new ndb_wrapper<transaction_proto2>(
-        logfiles, assignments, !nofsync, do_compress, fake_writes);
+        logfiles, assignments, !nofsync, do_compress, fake_writes,
+        numa_aware);
     transaction_proto2_static::set_hack_status(true);
     ALWAYS_ASSERT(transaction_proto2_static::get_hack_status());
 #ifdef PROTO2_CAN_DISABLE_GC
@@ -292,7 +433,8 @@ main(int argc, char **argv)
 #endif
   } else if (db_type == "ndb-proto2") {
     db = new ndb_wrapper<transaction_proto2>(
-        logfiles, assignments, !nofsync, do_compress, fake_writes);
+        logfiles, assignments, !nofsync, do_compress, fake_writes,
+        numa_aware);
     ALWAYS_ASSERT(!transaction_proto2_static::get_hack_status());
 #ifdef PROTO2_CAN_DISABLE_GC
     if (!disable_gc)
@@ -368,6 +510,21 @@ main(int argc, char **argv)
     }
     cerr << "  logfiles : " << logfiles                     << endl;
     cerr << "  assignments : " << assignments               << endl;
+    cerr << "  recover-logfiles : " << recover_logfiles     << endl;
+    cerr << "  recover-compressed : " << recover_compressed << endl;
+    cerr << "  recover-checkpoint : " << recover_checkpoint_dir << endl;
+    cerr << "  checkpoint-dir : " << checkpoint_dir             << endl;
+    cerr << "  checkpoint-interval-ms : " << checkpoint_interval_ms << endl;
+    cerr << "  checkpoint-threads : " << checkpoint_threads     << endl;
+    cerr << "  checkpoint-rate-mb : " << (checkpoint_max_bytes_per_sec >> 20) << endl;
+    cerr << "  durable-acks : " << durable_acks             << endl;
+    cerr << "  epoch-us : " << ticker::tick_us.load()       << endl;
+    cerr << "  partition-dispatch : " << partition_dispatch << endl;
+    cerr << "  snapshot-workers : " << snapshot_workers     << endl;
+    cerr << "  contention-manager : " << contention_manager << endl;
+    cerr << "  numa-aware : " << numa_aware                 << endl;
+    cerr << "  snapshot-epoch-ticks : "
+         << transaction_proto2_static::ReadOnlyEpochMultiplier.load() << endl;
     cerr << "  disable-gc : " << disable_gc                 << endl;
     cerr << "  disable-snapshots : " << disable_snapshots   << endl;
     cerr << "  stats-server-sockfile: " << stats_server_sockfile << endl;
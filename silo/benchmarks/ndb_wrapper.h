@@ -44,7 +44,8 @@ public:
       const std::vector<std::vector<unsigned>> &assignments_given,
       bool call_fsync,
       bool use_compression,
-      bool fake_writes);
+      bool fake_writes,
+      bool pin_loggers_to_numa_nodes = false);
 
   virtual ssize_t txn_max_batch_size() const OVERRIDE { return 100; }
 
@@ -60,6 +61,17 @@ public:
     txn_epoch_sync<Transaction>::finish();
   }
 
+  virtual bool
+  do_txn_recover(const std::string &checkpoint_dir,
+                 const std::vector<std::string> &logfiles, bool compressed);
+
+  virtual bool
+  do_txn_checkpoint_start(const std::string &dir, uint64_t interval_ms,
+                          size_t nthreads, uint64_t max_bytes_per_sec);
+
+  virtual void
+  do_txn_checkpoint_stop();
+
   virtual void
   thread_init(bool loader)
   {
@@ -84,6 +96,18 @@ public:
     txn_epoch_sync<Transaction>::reset_ntxn_persisted();
   }
 
+  virtual uint64_t
+  get_txn_epoch() const
+  {
+    return txn_epoch_sync<Transaction>::current_epoch();
+  }
+
+  virtual uint64_t
+  get_persisted_epoch() const
+  {
+    return txn_epoch_sync<Transaction>::persisted_epoch();
+  }
+
   virtual size_t
   sizeof_txn_object(uint64_t txn_flags) const;
 
@@ -102,6 +126,11 @@ public:
              size_t value_size_hint,
              bool mostly_append);
 
+  virtual abstract_ordered_index *
+  open_hash_index(const std::string &name,
+                  size_t value_size_hint,
+                  size_t expected_nkeys);
+
   virtual void
   close_index(abstract_ordered_index *idx);
 
@@ -120,6 +149,12 @@ public:
       void *txn,
       const std::string &key,
       std::string &value, size_t max_bytes_read);
+  virtual void multi_get(
+      void *txn,
+      const std::string *keys,
+      std::string *values,
+      bool *found,
+      size_t n, size_t max_bytes_read);
   virtual const char * put(
       void *txn,
       const std::string &key,
@@ -156,9 +191,29 @@ public:
       std::string &&key);
   virtual size_t size() const;
   virtual std::map<std::string, uint64_t> clear();
-private:
+protected:
   std::string name;
   txn_btree<Transaction> btr;
 };
 
+// a table that is only accessed by exact key. gets of present keys go
+// through a hash instead of descending the tree, and scans are rejected
+template <template <typename> class Transaction>
+class ndb_hash_index : public ndb_ordered_index<Transaction> {
+public:
+  ndb_hash_index(const std::string &name, size_t value_size_hint, size_t expected_nkeys);
+  virtual void scan(
+      void *txn,
+      const std::string &start_key,
+      const std::string *end_key,
+      abstract_ordered_index::scan_callback &callback,
+      str_arena *arena);
+  virtual void rscan(
+      void *txn,
+      const std::string &start_key,
+      const std::string *end_key,
+      abstract_ordered_index::scan_callback &callback,
+      str_arena *arena);
+};
+
 #endif /* _NDB_WRAPPER_H_ */
@@ -127,7 +127,8 @@ ndb_wrapper<Transaction>::ndb_wrapper(
     const std::vector<std::vector<unsigned>> &assignments_given,
     bool call_fsync,
     bool use_compression,
-    bool fake_writes)
+    bool fake_writes,
+    bool pin_loggers_to_numa_nodes)
 {
   if (logfiles.empty())
     return;
@@ -136,16 +137,77 @@ ndb_wrapper<Transaction>::ndb_wrapper(
       nthreads, logfiles, assignments_given, &assignments_used,
       call_fsync,
       use_compression,
-      fake_writes);
+      fake_writes,
+      pin_loggers_to_numa_nodes);
   if (verbose) {
     std::cerr << "[logging subsystem]" << std::endl;
     std::cerr << "  assignments: " << assignments_used << std::endl;
     std::cerr << "  call fsync : " << call_fsync       << std::endl;
     std::cerr << "  compression: " << use_compression  << std::endl;
     std::cerr << "  fake_writes: " << fake_writes      << std::endl;
+    std::cerr << "  numa pinning: " << pin_loggers_to_numa_nodes << std::endl;
   }
 }
 
+template <template <typename> class Transaction>
+bool
+ndb_wrapper<Transaction>::do_txn_recover(
+    const std::string &checkpoint_dir,
+    const std::vector<std::string> &logfiles, bool compressed)
+{
+  const txn_logger::recovery_stats stats =
+    txn_logger::Recover(checkpoint_dir, logfiles, compressed);
+  const double elapsed_sec = double(stats.elapsed_us_) / 1000000.0;
+  if (!checkpoint_dir.empty())
+    std::cerr << "[recovery] " << stats.nckpt_records_ << " records ("
+              << stats.nckpt_bytes_ << " bytes) from the checkpoint in "
+              << checkpoint_dir << std::endl;
+  std::cerr << "[recovery] " << stats.nrecords_ << " records ("
+            << stats.ntxns_ << " txns, " << stats.nbuffers_ << " buffers) from "
+            << logfiles.size() << " logs in " << elapsed_sec << " sec" << std::endl;
+  std::cerr << "  throughput: "
+            << (double(stats.nbytes_ + stats.nckpt_bytes_) / 1e9) / elapsed_sec
+            << " GB/s, "
+            << double(stats.nrecords_ + stats.nckpt_records_) / elapsed_sec
+            << " records/s" << std::endl;
+  if (verbose) {
+    std::cerr << "  log bytes  : " << stats.nbytes_     << std::endl;
+    std::cerr << "  installed  : " << stats.ninstalled_ << std::endl;
+    std::cerr << "  deleted    : " << stats.nremoved_   << std::endl;
+  }
+  if (stats.ntorn_)
+    std::cerr << "[WARNING] " << stats.ntorn_
+              << " logs end in a partially written buffer" << std::endl;
+  return true;
+}
+
+template <template <typename> class Transaction>
+bool
+ndb_wrapper<Transaction>::do_txn_checkpoint_start(
+    const std::string &dir, uint64_t interval_ms,
+    size_t nthreads, uint64_t max_bytes_per_sec)
+{
+  txn_logger::StartCheckpointer(dir, interval_ms, nthreads, max_bytes_per_sec);
+  return true;
+}
+
+template <template <typename> class Transaction>
+void
+ndb_wrapper<Transaction>::do_txn_checkpoint_stop()
+{
+  const txn_logger::checkpoint_stats stats = txn_logger::StopCheckpointer();
+  std::cerr << "[checkpoint] " << stats.ncheckpoints_ << " checkpoints, "
+            << stats.nrecords_ << " records, "
+            << stats.ncompressed_bytes_ << " bytes ("
+            << stats.nbytes_ << " uncompressed)" << std::endl;
+  if (stats.ncheckpoints_)
+    std::cerr << "  duration: avg "
+              << double(stats.total_us_) / stats.ncheckpoints_ / 1000.0
+              << " ms, max " << double(stats.max_us_) / 1000.0 << " ms"
+              << std::endl;
+  std::cerr << "  log bytes dropped: " << stats.ntruncated_bytes_ << std::endl;
+}
+
 template <template <typename> class Transaction>
 size_t
 ndb_wrapper<Transaction>::sizeof_txn_object(uint64_t txn_flags) const
@@ -283,6 +345,13 @@ ndb_wrapper<Transaction>::open_index(const std::string &name, size_t value_size_
   return new ndb_ordered_index<Transaction>(name, value_size_hint, mostly_append);
 }
 
+template <template <typename> class Transaction>
+abstract_ordered_index *
+ndb_wrapper<Transaction>::open_hash_index(const std::string &name, size_t value_size_hint, size_t expected_nkeys)
+{
+  return new ndb_hash_index<Transaction>(name, value_size_hint, expected_nkeys);
+}
+
 template <template <typename> class Transaction>
 void
 ndb_wrapper<Transaction>::close_index(abstract_ordered_index *idx)
@@ -333,6 +402,35 @@ ndb_ordered_index<Transaction>::get(
   }
 }
 
+template <template <typename> class Transaction>
+void
+ndb_ordered_index<Transaction>::multi_get(
+    void *txn,
+    const std::string *keys,
+    std::string *values,
+    bool *found,
+    size_t n, size_t max_bytes_read)
+{
+  ndbtxn * const p = reinterpret_cast<ndbtxn *>(txn);
+  try {
+#define MY_OP_X(a, b) \
+  case a: \
+    { \
+      auto t = cast< b >()(p); \
+      btr.multi_search(*t, keys, values, found, n, max_bytes_read); \
+      return; \
+    }
+    switch (p->hint) {
+      TXN_PROFILE_HINT_OP(MY_OP_X)
+    default:
+      ALWAYS_ASSERT(false);
+    }
+#undef MY_OP_X
+  } catch (transaction_abort_exception &ex) {
+    throw abstract_db::abstract_abort_exception();
+  }
+}
+
 // XXX: find way to remove code duplication below using C++ templates!
 
 template <template <typename> class Transaction>
@@ -597,4 +695,38 @@ ndb_ordered_index<Transaction>::clear()
   return btr.unsafe_purge(true);
 }
 
+template <template <typename> class Transaction>
+ndb_hash_index<Transaction>::ndb_hash_index(
+    const std::string &name, size_t value_size_hint, size_t expected_nkeys)
+  : ndb_ordered_index<Transaction>(name, value_size_hint, false)
+{
+  this->btr.init_point_hash(expected_nkeys);
+}
+
+template <template <typename> class Transaction>
+void
+ndb_hash_index<Transaction>::scan(
+    void *txn,
+    const std::string &start_key,
+    const std::string *end_key,
+    abstract_ordered_index::scan_callback &callback,
+    str_arena *arena)
+{
+  std::cerr << "scan of hash index " << this->name << std::endl;
+  NDB_UNIMPLEMENTED("scan");
+}
+
+template <template <typename> class Transaction>
+void
+ndb_hash_index<Transaction>::rscan(
+    void *txn,
+    const std::string &start_key,
+    const std::string *end_key,
+    abstract_ordered_index::scan_callback &callback,
+    str_arena *arena)
+{
+  std::cerr << "rscan of hash index " << this->name << std::endl;
+  NDB_UNIMPLEMENTED("rscan");
+}
+
 #endif /* _NDB_WRAPPER_IMPL_H_ */
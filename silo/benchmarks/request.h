@@ -1,15 +1,79 @@
 #ifndef __REQUEST_H
 #define __REQUEST_H
 
-enum ReqType { NEW_ORDER = 0, PAYMENT = 1, DELIVERY = 2, ORDER_STATUS = 3, 
+#include <stdint.h>
+
+enum ReqType { NEW_ORDER = 0, PAYMENT = 1, DELIVERY = 2, ORDER_STATUS = 3,
     STOCK_LEVEL = 4};
 
+// YCSB ops (see ycsb_inputs.h)
+enum YcsbOp { YCSB_READ = 0, YCSB_UPDATE = 1, YCSB_INSERT = 2, YCSB_SCAN = 3,
+    YCSB_RMW = 4, YCSB_NUM_OPS = 5 };
+
+// TPC-C txn inputs, as drawn by the client (see tpcc_inputs.h). Ids are
+// 1-based, as in the tables
+struct NewOrderInputs {
+    uint32_t warehouse_id;
+    uint32_t district_id;
+    uint32_t customer_id;
+    uint32_t num_items; // 5 to 15
+    uint32_t item_ids[15];
+    uint32_t supplier_warehouse_ids[15];
+    uint32_t order_quantities[15];
+};
+
+struct PaymentInputs {
+    uint32_t warehouse_id;
+    uint32_t district_id;
+    uint32_t customer_warehouse_id;
+    uint32_t customer_district_id;
+    uint32_t customer_id; // 0 to look the customer up by last name
+    uint32_t customer_last_name; // the name's number, 0 to 999
+    float payment_amount;
+};
+
+struct DeliveryInputs {
+    uint32_t warehouse_id;
+    uint32_t carrier_id;
+};
+
+struct OrderStatusInputs {
+    uint32_t warehouse_id;
+    uint32_t district_id;
+    uint32_t customer_id; // 0 to look the customer up by last name
+    uint32_t customer_last_name;
+};
+
+struct StockLevelInputs {
+    uint32_t warehouse_id;
+    uint32_t district_id;
+    uint32_t threshold;
+};
+
+// YCSB op inputs. Keys are record numbers: the loaded records are
+// [0, --scale-factor * 1000), and inserts add records past them
+struct YcsbInputs {
+    uint64_t key; // for a scan, the first key
+    uint32_t scan_len; // the number of keys a scan covers
+};
+
 struct Request {
-    ReqType type;
+    uint32_t type; // a ReqType, or a YcsbOp for ycsb
+    bool has_inputs; // if false, the worker draws the inputs itself
+    union {
+        NewOrderInputs new_order;
+        PaymentInputs payment;
+        DeliveryInputs delivery;
+        OrderStatusInputs order_status;
+        StockLevelInputs stock_level;
+        YcsbInputs ycsb;
+    };
 };
 
 struct Response {
     bool success;
+    uint32_t attempts; // 1 + the aborted attempts that were retried
+    uint64_t aborted_us; // time spent in aborted attempts, and backing off
 };
 
 #endif
@@ -23,6 +23,7 @@
 
 #include "bench.h"
 #include "tpcc.h"
+#include "tpcc_inputs.h"
 
 using namespace std;
 using namespace util;
@@ -47,26 +48,6 @@ NumWarehouses()
   return (size_t) scale_factor;
 }
 
-// config constants
-
-static constexpr inline ALWAYS_INLINE size_t
-NumItems()
-{
-  return 100000;
-}
-
-static constexpr inline ALWAYS_INLINE size_t
-NumDistrictsPerWarehouse()
-{
-  return 10;
-}
-
-static constexpr inline ALWAYS_INLINE size_t
-NumCustomersPerDistrict()
-{
-  return 3000;
-}
-
 // T must implement lock()/unlock(). Both must *not* throw exceptions
 template <typename T>
 class scoped_multilock {
@@ -149,6 +130,8 @@ static int g_new_order_remote_item_pct = 1;
 static int g_new_order_fast_id_gen = 0;
 static int g_uniform_item_dist = 0;
 static int g_order_status_scan_hack = 0;
+static int g_disable_multi_get = 0;
+static int g_enable_hash_point_tables = 0;
 static unsigned g_txn_workload_mix[] = { 45, 43, 4, 4, 4 }; // default TPC-C workload mix
 
 static aligned_padded_elem<spinlock> *g_partition_locks = nullptr;
@@ -341,42 +324,6 @@ public:
 
   // utils for generating random #s and strings
 
-  static inline ALWAYS_INLINE int
-  CheckBetweenInclusive(int v, int lower, int upper)
-  {
-    INVARIANT(v >= lower);
-    INVARIANT(v <= upper);
-    return v;
-  }
-
-  static inline ALWAYS_INLINE int
-  RandomNumber(fast_random &r, int min, int max)
-  {
-    return CheckBetweenInclusive((int) (r.next_uniform() * (max - min + 1) + min), min, max);
-  }
-
-  static inline ALWAYS_INLINE int
-  NonUniformRandom(fast_random &r, int A, int C, int min, int max)
-  {
-    return (((RandomNumber(r, 0, A) | RandomNumber(r, min, max)) + C) % (max - min + 1)) + min;
-  }
-
-  static inline ALWAYS_INLINE int
-  GetItemId(fast_random &r)
-  {
-    return CheckBetweenInclusive(
-        g_uniform_item_dist ?
-          RandomNumber(r, 1, NumItems()) :
-          NonUniformRandom(r, 8191, 7911, 1, NumItems()),
-        1, NumItems());
-  }
-
-  static inline ALWAYS_INLINE int
-  GetCustomerId(fast_random &r)
-  {
-    return CheckBetweenInclusive(NonUniformRandom(r, 1023, 259, 1, NumCustomersPerDistrict()), 1, NumCustomersPerDistrict());
-  }
-
   // pick a number between [start, end)
   static inline ALWAYS_INLINE unsigned
   PickWarehouseId(fast_random &r, unsigned start, unsigned end)
@@ -430,24 +377,6 @@ public:
     return GetCustomerLastName(r, NonUniformRandom(r, 255, 157, 0, 999));
   }
 
-  static inline ALWAYS_INLINE size_t
-  GetNonUniformCustomerLastNameRun(uint8_t *buf, fast_random &r)
-  {
-    return GetCustomerLastName(buf, r, NonUniformRandom(r, 255, 223, 0, 999));
-  }
-
-  static inline ALWAYS_INLINE size_t
-  GetNonUniformCustomerLastNameRun(char *buf, fast_random &r)
-  {
-    return GetNonUniformCustomerLastNameRun((uint8_t *) buf, r);
-  }
-
-  static inline ALWAYS_INLINE string
-  GetNonUniformCustomerLastNameRun(fast_random &r)
-  {
-    return GetCustomerLastName(r, NonUniformRandom(r, 255, 223, 0, 999));
-  }
-
   // following oltpbench, we really generate strings of len - 1...
   static inline string
   RandomStr(fast_random &r, uint len)
@@ -510,7 +439,12 @@ public:
                    open_tables, barrier_a, barrier_b),
       tpcc_worker_mixin(partitions),
       warehouse_id_start(warehouse_id_start),
-      warehouse_id_end(warehouse_id_end)
+      warehouse_id_end(warehouse_id_end),
+      input_gen(NumWarehouses(),
+                g_disable_xpartition_txn ? 0 : g_new_order_remote_item_pct,
+                g_disable_xpartition_txn ? 0 : 15,
+                g_uniform_item_dist),
+      warned_invalid(false)
   {
     INVARIANT(warehouse_id_start >= 1);
     INVARIANT(warehouse_id_start <= NumWarehouses());
@@ -531,6 +465,8 @@ public:
   // XXX(stephentu): tune this
   static const size_t NMaxCustomerIdxScanElems = 512;
 
+  inline uint get_warehouse_id_start() const { return warehouse_id_start; }
+
   txn_result txn_new_order();
 
   static txn_result
@@ -616,21 +552,85 @@ protected:
     rcu::s_instance.fault_region();
   }
 
+  // the NewOrders of a district all update its d_next_o_id, so any two of
+  // them conflict. the other txns abort far less often
+  virtual size_t
+  conflict_key(const Request &req) const OVERRIDE
+  {
+    if (req.type != NEW_ORDER || !req.has_inputs ||
+        !tpcc_input_generator::InputsValid(req, NumWarehouses()))
+      return NoConflictKey;
+    return (req.new_order.warehouse_id - 1) * NumDistrictsPerWarehouse() +
+           (req.new_order.district_id - 1);
+  }
+
+  // a request whose inputs name rows that were not loaded fails without
+  // running
+  virtual bool
+  rejects(const Request &req) const OVERRIDE
+  {
+    if (likely(tpcc_input_generator::InputsValid(req, NumWarehouses())))
+      return false;
+    if (!warned_invalid) {
+      cerr << "tpcc: failing requests with invalid inputs; is the client's "
+           << "TBENCH_TPCC_WAREHOUSES larger than --scale-factor ("
+           << NumWarehouses() << ")?" << endl;
+      warned_invalid = true;
+    }
+    return true;
+  }
+
   inline ALWAYS_INLINE string &
   str()
   {
     return *arena.next();
   }
 
+  // the inputs of the current txn: the client's, or drawn here if the
+  // request carries none. drawn from r, so a retry draws the same ones
+  const Request &
+  txn_inputs()
+  {
+    if (cur_req->has_inputs) {
+      INVARIANT(tpcc_input_generator::InputsValid(*cur_req, NumWarehouses()));
+      return *cur_req;
+    }
+    local_req.type = cur_req->type;
+    input_gen.generate(
+        r, PickWarehouseId(r, warehouse_id_start, warehouse_id_end), local_req);
+    return local_req;
+  }
+
 private:
   const uint warehouse_id_start;
   const uint warehouse_id_end;
+  const tpcc_input_generator input_gen;
+  Request local_req;
+  mutable bool warned_invalid; // see rejects()
   int32_t last_no_o_ids[10]; // XXX(stephentu): hack
 
+  // idx->multi_get(), or idx->get() n times with --disable-multi-get
+  inline void
+  multi_get(abstract_ordered_index *idx, void *txn,
+            const string *keys, string *values, bool *found, size_t n,
+            size_t max_bytes_read = string::npos)
+  {
+    if (g_disable_multi_get)
+      idx->abstract_ordered_index::multi_get(txn, keys, values, found, n, max_bytes_read);
+    else
+      idx->multi_get(txn, keys, values, found, n, max_bytes_read);
+  }
+
   // some scratch buffer space
   string obj_key0;
   string obj_key1;
   string obj_v;
+
+  // for multi_get(). new order puts its items' keys at [0, 15) and its
+  // stocks' keys at [15, 30)
+  string obj_keys[32];
+  string obj_vs[32];
+  bool obj_found[32];
 };
 
 class tpcc_warehouse_loader : public bench_loader, public tpcc_worker_mixin {
@@ -1232,27 +1232,18 @@ static event_counter evt_tpcc_cross_partition_payment_txns("tpcc_cross_partition
 tpcc_worker::txn_result
 tpcc_worker::txn_new_order()
 {
-  const uint warehouse_id = PickWarehouseId(r, warehouse_id_start, warehouse_id_end);
-  const uint districtID = RandomNumber(r, 1, 10);
-  const uint customerID = GetCustomerId(r);
-  const uint numItems = RandomNumber(r, 5, 15);
-  uint itemIDs[15], supplierWarehouseIDs[15], orderQuantities[15];
+  const NewOrderInputs &in = txn_inputs().new_order;
+  const uint warehouse_id = in.warehouse_id;
+  const uint districtID = in.district_id;
+  const uint customerID = in.customer_id;
+  const uint numItems = in.num_items;
+  const uint32_t *const itemIDs = in.item_ids;
+  const uint32_t *const supplierWarehouseIDs = in.supplier_warehouse_ids;
+  const uint32_t *const orderQuantities = in.order_quantities;
   bool allLocal = true;
-  for (uint i = 0; i < numItems; i++) {
-    itemIDs[i] = GetItemId(r);
-    if (likely(g_disable_xpartition_txn ||
-               NumWarehouses() == 1 ||
-               RandomNumber(r, 1, 100) > g_new_order_remote_item_pct)) {
-      supplierWarehouseIDs[i] = warehouse_id;
-    } else {
-      do {
-       supplierWarehouseIDs[i] = RandomNumber(r, 1, NumWarehouses());
-      } while (supplierWarehouseIDs[i] == warehouse_id);
+  for (uint i = 0; i < numItems; i++)
+    if (supplierWarehouseIDs[i] != warehouse_id)
       allLocal = false;
-    }
-    orderQuantities[i] = RandomNumber(r, 1, 10);
-  }
-  INVARIANT(!g_disable_xpartition_txn || allLocal);
   if (!allLocal)
     ++evt_tpcc_cross_partition_new_order_txns;
 
@@ -1350,21 +1341,48 @@ tpcc_worker::txn_new_order()
 
     tbl_oorder_c_id_idx(warehouse_id)->insert(txn, Encode(str(), k_oo_idx), Encode(str(), v_oo_idx));
 
+    // get the items and stocks up front, so their lookups overlap. a stock
+    // an earlier line also orders is got in the loop instead, after that
+    // line's put, as is one in another partition's tree
+    abstract_ordered_index * const stock_idx = tbl_stock(warehouse_id);
+    int stock_slots[15];
+    size_t nstocks = 0;
+    for (uint i = 0; i < numItems; i++) {
+      Encode(obj_keys[i], item::key(itemIDs[i]));
+      stock_slots[i] = -1;
+      if (tbl_stock(supplierWarehouseIDs[i]) != stock_idx)
+        continue;
+      bool repeated = false;
+      for (uint j = 0; j < i && !repeated; j++)
+        repeated = itemIDs[j] == itemIDs[i] &&
+                   supplierWarehouseIDs[j] == supplierWarehouseIDs[i];
+      if (repeated)
+        continue;
+      stock_slots[i] = 15 + nstocks;
+      Encode(obj_keys[15 + nstocks++], stock::key(supplierWarehouseIDs[i], itemIDs[i]));
+    }
+    multi_get(tbl_item(1), txn, &obj_keys[0], &obj_vs[0], &obj_found[0], numItems);
+    multi_get(stock_idx, txn, &obj_keys[15], &obj_vs[15], &obj_found[15], nstocks);
+
     for (uint ol_number = 1; ol_number <= numItems; ol_number++) {
       const uint ol_supply_w_id = supplierWarehouseIDs[ol_number - 1];
       const uint ol_i_id = itemIDs[ol_number - 1];
       const uint ol_quantity = orderQuantities[ol_number - 1];
 
       const item::key k_i(ol_i_id);
-      ALWAYS_ASSERT(tbl_item(1)->get(txn, Encode(obj_key0, k_i), obj_v));
+      ALWAYS_ASSERT(obj_found[ol_number - 1]);
       item::value v_i_temp;
-      const item::value *v_i = Decode(obj_v, v_i_temp);
+      const item::value *v_i = Decode(obj_vs[ol_number - 1], v_i_temp);
       checker::SanityCheckItem(&k_i, v_i);
 
       const stock::key k_s(ol_supply_w_id, ol_i_id);
-      ALWAYS_ASSERT(tbl_stock(ol_supply_w_id)->get(txn, Encode(obj_key0, k_s), obj_v));
+      const int stock_slot = stock_slots[ol_number - 1];
+      if (stock_slot >= 0)
+        ALWAYS_ASSERT(obj_found[stock_slot]);
+      else
+        ALWAYS_ASSERT(tbl_stock(ol_supply_w_id)->get(txn, Encode(obj_key0, k_s), obj_v));
       stock::value v_s_temp;
-      const stock::value *v_s = Decode(obj_v, v_s_temp);
+      const stock::value *v_s = Decode(stock_slot >= 0 ? obj_vs[stock_slot] : obj_v, v_s_temp);
       checker::SanityCheckStock(&k_s, v_s);
 
       stock::value v_s_new(*v_s);
@@ -1431,8 +1449,9 @@ STATIC_COUNTER_DECL(scopedperf::tod_ctr, delivery_probe0_tod, delivery_probe0_cg
 tpcc_worker::txn_result
 tpcc_worker::txn_delivery()
 {
-  const uint warehouse_id = PickWarehouseId(r, warehouse_id_start, warehouse_id_end);
-  const uint o_carrier_id = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+  const DeliveryInputs &in = txn_inputs().delivery;
+  const uint warehouse_id = in.warehouse_id;
+  const uint o_carrier_id = in.carrier_id;
   const uint32_t ts = GetCurrentTimeMillis();
 
   // worst case txn profile:
@@ -1545,23 +1564,13 @@ static event_avg_counter evt_avg_cust_name_idx_scan_size("avg_cust_name_idx_scan
 tpcc_worker::txn_result
 tpcc_worker::txn_payment()
 {
-  const uint warehouse_id = PickWarehouseId(r, warehouse_id_start, warehouse_id_end);
-  const uint districtID = RandomNumber(r, 1, NumDistrictsPerWarehouse());
-  uint customerDistrictID, customerWarehouseID;
-  if (likely(g_disable_xpartition_txn ||
-             NumWarehouses() == 1 ||
-             RandomNumber(r, 1, 100) <= 85)) {
-    customerDistrictID = districtID;
-    customerWarehouseID = warehouse_id;
-  } else {
-    customerDistrictID = RandomNumber(r, 1, NumDistrictsPerWarehouse());
-    do {
-      customerWarehouseID = RandomNumber(r, 1, NumWarehouses());
-    } while (customerWarehouseID == warehouse_id);
-  }
-  const float paymentAmount = (float) (RandomNumber(r, 100, 500000) / 100.0);
+  const PaymentInputs &in = txn_inputs().payment;
+  const uint warehouse_id = in.warehouse_id;
+  const uint districtID = in.district_id;
+  const uint customerDistrictID = in.customer_district_id;
+  const uint customerWarehouseID = in.customer_warehouse_id;
+  const float paymentAmount = in.payment_amount;
   const uint32_t ts = GetCurrentTimeMillis();
-  INVARIANT(!g_disable_xpartition_txn || customerWarehouseID == warehouse_id);
 
   // output from txn counters:
   //   max_absent_range_set_size : 0
@@ -1606,12 +1615,12 @@ tpcc_worker::txn_payment()
 
     customer::key k_c;
     customer::value v_c;
-    if (RandomNumber(r, 1, 100) <= 60) {
+    if (!in.customer_id) {
       // cust by name
       uint8_t lastname_buf[CustomerLastNameMaxSize + 1];
       static_assert(sizeof(lastname_buf) == 16, "xx");
       NDB_MEMSET(lastname_buf, 0, sizeof(lastname_buf));
-      GetNonUniformCustomerLastNameRun(lastname_buf, r);
+      GetCustomerLastName(lastname_buf, r, in.customer_last_name);
 
       static const string zeros(16, 0);
       static const string ones(16, 255);
@@ -1648,7 +1657,7 @@ tpcc_worker::txn_payment()
 
     } else {
       // cust by ID
-      const uint customerID = GetCustomerId(r);
+      const uint customerID = in.customer_id;
       k_c.c_w_id = customerWarehouseID;
       k_c.c_d_id = customerDistrictID;
       k_c.c_id = customerID;
@@ -1727,8 +1736,9 @@ STATIC_COUNTER_DECL(scopedperf::tod_ctr, order_status_probe0_tod, order_status_p
 tpcc_worker::txn_result
 tpcc_worker::txn_order_status()
 {
-  const uint warehouse_id = PickWarehouseId(r, warehouse_id_start, warehouse_id_end);
-  const uint districtID = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+  const OrderStatusInputs &in = txn_inputs().order_status;
+  const uint warehouse_id = in.warehouse_id;
+  const uint districtID = in.district_id;
 
   // output from txn counters:
   //   max_absent_range_set_size : 0
@@ -1751,12 +1761,12 @@ tpcc_worker::txn_order_status()
 
     customer::key k_c;
     customer::value v_c;
-    if (RandomNumber(r, 1, 100) <= 60) {
+    if (!in.customer_id) {
       // cust by name
       uint8_t lastname_buf[CustomerLastNameMaxSize + 1];
       static_assert(sizeof(lastname_buf) == 16, "xx");
       NDB_MEMSET(lastname_buf, 0, sizeof(lastname_buf));
-      GetNonUniformCustomerLastNameRun(lastname_buf, r);
+      GetCustomerLastName(lastname_buf, r, in.customer_last_name);
 
       static const string zeros(16, 0);
       static const string ones(16, 255);
@@ -1793,7 +1803,7 @@ tpcc_worker::txn_order_status()
 
     } else {
       // cust by ID
-      const uint customerID = GetCustomerId(r);
+      const uint customerID = in.customer_id;
       k_c.c_w_id = warehouse_id;
       k_c.c_d_id = districtID;
       k_c.c_id = customerID;
@@ -1881,9 +1891,10 @@ static event_avg_counter evt_avg_stock_level_loop_join_lookups("stock_level_loop
 tpcc_worker::txn_result
 tpcc_worker::txn_stock_level()
 {
-  const uint warehouse_id = PickWarehouseId(r, warehouse_id_start, warehouse_id_end);
-  const uint threshold = RandomNumber(r, 10, 20);
-  const uint districtID = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+  const StockLevelInputs &in = txn_inputs().stock_level;
+  const uint warehouse_id = in.warehouse_id;
+  const uint threshold = in.threshold;
+  const uint districtID = in.district_id;
 
   // output from txn counters:
   //   max_absent_range_set_size : 0
@@ -1926,23 +1937,32 @@ tpcc_worker::txn_stock_level()
     }
     {
       small_unordered_map<uint, bool, 512> s_i_ids_distinct;
-      for (auto &p : c.s_i_ids) {
+      const size_t nbytesread = serializer<int16_t, true>::max_nbytes();
+      auto it = c.s_i_ids.begin();
+      while (it != c.s_i_ids.end()) {
         ANON_REGION("StockLevelLoopJoinIter:", &stock_level_probe1_cg);
 
-        const size_t nbytesread = serializer<int16_t, true>::max_nbytes();
-
-        const stock::key k_s(warehouse_id, p.first);
-        INVARIANT(p.first >= 1 && p.first <= NumItems());
+        // the stocks are got ARRAY_NELEMS(obj_keys) at a time
+        uint s_i_ids[ARRAY_NELEMS(obj_keys)];
+        size_t n = 0;
+        for (; it != c.s_i_ids.end() && n < ARRAY_NELEMS(obj_keys); ++it, n++) {
+          INVARIANT(it->first >= 1 && it->first <= NumItems());
+          s_i_ids[n] = it->first;
+          Encode(obj_keys[n], stock::key(warehouse_id, it->first));
+        }
         {
           ANON_REGION("StockLevelLoopJoinGet:", &stock_level_probe2_cg);
-          ALWAYS_ASSERT(tbl_stock(warehouse_id)->get(txn, Encode(obj_key0, k_s), obj_v, nbytesread));
+          multi_get(tbl_stock(warehouse_id), txn, obj_keys, obj_vs, obj_found, n, nbytesread);
+        }
+        for (size_t i = 0; i < n; i++) {
+          ALWAYS_ASSERT(obj_found[i]);
+          INVARIANT(obj_vs[i].size() <= nbytesread);
+          const uint8_t *ptr = (const uint8_t *) obj_vs[i].data();
+          int16_t i16tmp;
+          ptr = serializer<int16_t, true>::read(ptr, &i16tmp);
+          if (i16tmp < int(threshold))
+            s_i_ids_distinct[s_i_ids[i]] = 1;
         }
-        INVARIANT(obj_v.size() <= nbytesread);
-        const uint8_t *ptr = (const uint8_t *) obj_v.data();
-        int16_t i16tmp;
-        ptr = serializer<int16_t, true>::read(ptr, &i16tmp);
-        if (i16tmp < int(threshold))
-          s_i_ids_distinct[p.first] = 1;
       }
       evt_avg_stock_level_loop_join_lookups.offer(c.s_i_ids.size());
       // NB(stephentu): s_i_ids_distinct.size() is the computed result of this txn
@@ -1986,17 +2006,47 @@ private:
            strcmp("oorder_c_id_idx", name) == 0;
   }
 
+  // the number of keys of a table which txns only access by exact key, when
+  // it holds nwarehouses warehouses (item holds no warehouses). 0 for the
+  // tables that are scanned
+  static size_t
+  PointTableKeys(const char *name, size_t nwarehouses)
+  {
+    if (strcmp("item", name) == 0)
+      return NumItems();
+    if (strcmp("warehouse", name) == 0)
+      return nwarehouses;
+    if (strcmp("district", name) == 0)
+      return nwarehouses * NumDistrictsPerWarehouse();
+    if (strcmp("customer", name) == 0)
+      return nwarehouses * NumDistrictsPerWarehouse() * NumCustomersPerDistrict();
+    if (strcmp("stock", name) == 0 ||
+        strcmp("stock_data", name) == 0)
+      return nwarehouses * NumItems();
+    return 0;
+  }
+
+  static abstract_ordered_index *
+  OpenTable(abstract_db *db, const char *name, const string &idx_name,
+            size_t expected_size, size_t nwarehouses)
+  {
+    const size_t nkeys = g_enable_hash_point_tables ?
+      PointTableKeys(name, nwarehouses) : 0;
+    if (nkeys)
+      return db->open_hash_index(idx_name, expected_size, nkeys);
+    return db->open_index(idx_name, expected_size, IsTableAppendOnly(name));
+  }
+
   static vector<abstract_ordered_index *>
   OpenTablesForTablespace(abstract_db *db, const char *name, size_t expected_size)
   {
     const bool is_read_only = IsTableReadOnly(name);
-    const bool is_append_only = IsTableAppendOnly(name);
     const string s_name(name);
     vector<abstract_ordered_index *> ret(NumWarehouses());
     if (g_enable_separate_tree_per_partition && !is_read_only) {
       if (NumWarehouses() <= nthreads) {
         for (size_t i = 0; i < NumWarehouses(); i++)
-          ret[i] = db->open_index(s_name + "_" + to_string(i), expected_size, is_append_only);
+          ret[i] = OpenTable(db, name, s_name + "_" + to_string(i), expected_size, 1);
       } else {
         const unsigned nwhse_per_partition = NumWarehouses() / nthreads;
         for (size_t partid = 0; partid < nthreads; partid++) {
@@ -2004,13 +2054,13 @@ private:
           const unsigned wend   = (partid + 1 == nthreads) ?
             NumWarehouses() : (partid + 1) * nwhse_per_partition;
           abstract_ordered_index *idx =
-            db->open_index(s_name + "_" + to_string(partid), expected_size, is_append_only);
+            OpenTable(db, name, s_name + "_" + to_string(partid), expected_size, wend - wstart);
           for (size_t i = wstart; i < wend; i++)
             ret[i] = idx;
         }
       }
     } else {
-      abstract_ordered_index *idx = db->open_index(s_name, expected_size, is_append_only);
+      abstract_ordered_index *idx = OpenTable(db, name, s_name, expected_size, NumWarehouses());
       for (size_t i = 0; i < NumWarehouses(); i++)
         ret[i] = idx;
     }
@@ -2122,9 +2172,34 @@ protected:
             &barrier_a, &barrier_b, wstart+1, wend+1));
       }
     }
+    if (partition_dispatch || numa_aware) {
+      // workers sharing a warehouse share its queue
+      for (size_t i = 0; i < min(NumWarehouses(), nthreads); i++)
+        queues.push_back(new request_queue);
+      for (size_t i = 0; i < nthreads; i++)
+        ret[i]->set_queue(queues[PartitionId(
+              static_cast<tpcc_worker *>(ret[i])->get_warehouse_id_start())]);
+    }
     return ret;
   }
 
+  virtual size_t
+  partition_of(const Request &req) const OVERRIDE
+  {
+    // any worker can draw inputs for a request without them, and fails a
+    // request with invalid ones
+    if (!req.has_inputs ||
+        !tpcc_input_generator::InputsValid(req, NumWarehouses()))
+      return 0;
+    return PartitionId(tpcc_input_generator::HomeWarehouseId(req));
+  }
+
+  virtual bool
+  is_snapshot_txn(const Request &req) const OVERRIDE
+  {
+    return req.type == ORDER_STATUS || req.type == STOCK_LEVEL;
+  }
+
 private:
   map<string, vector<abstract_ordered_index *>> partitions;
 };
@@ -2146,6 +2221,8 @@ tpcc_do_test(abstract_db *db, int argc, char **argv)
       {"new-order-fast-id-gen"                , no_argument       , &g_new_order_fast_id_gen              , 1}   ,
       {"uniform-item-dist"                    , no_argument       , &g_uniform_item_dist                  , 1}   ,
       {"order-status-scan-hack"               , no_argument       , &g_order_status_scan_hack             , 1}   ,
+      {"disable-multi-get"                    , no_argument       , &g_disable_multi_get                  , 1}   ,
+      {"enable-hash-point-tables"             , no_argument       , &g_enable_hash_point_tables           , 1}   ,
       {"workload-mix"                         , required_argument , 0                                     , 'w'} ,
       {0, 0, 0, 0}
     };
@@ -2195,6 +2272,12 @@ tpcc_do_test(abstract_db *db, int argc, char **argv)
     cerr << "  --new-order-remote-item-pct will have no effect" << endl;
   }
 
+  if (snapshot_workers && g_disable_read_only_scans) {
+    cerr << "tpcc: --snapshot-workers needs read-only snapshots, which "
+         << "--disable-read-only-snapshots turns off" << endl;
+    exit(1);
+  }
+
   if (verbose) {
     cerr << "tpcc settings:" << endl;
     cerr << "  cross_partition_transactions : " << !g_disable_xpartition_txn << endl;
@@ -2205,6 +2288,8 @@ tpcc_do_test(abstract_db *db, int argc, char **argv)
     cerr << "  new_order_fast_id_gen        : " << g_new_order_fast_id_gen << endl;
     cerr << "  uniform_item_dist            : " << g_uniform_item_dist << endl;
     cerr << "  order_status_scan_hack       : " << g_order_status_scan_hack << endl;
+    cerr << "  multi_get                    : " << !g_disable_multi_get << endl;
+    cerr << "  hash_point_tables            : " << g_enable_hash_point_tables << endl;
     cerr << "  workload_mix                 : " <<
       format_list(g_txn_workload_mix,
                   g_txn_workload_mix + ARRAY_NELEMS(g_txn_workload_mix)) << endl;
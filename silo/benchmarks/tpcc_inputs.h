@@ -0,0 +1,270 @@
+#ifndef _NDB_BENCH_TPCC_INPUTS_H_
+#define _NDB_BENCH_TPCC_INPUTS_H_
+
+#include <stdint.h>
+
+#include "../macros.h"
+#include "../util.h"
+#include "request.h"
+
+// TPC-C txn inputs. the harness client draws them for each request; the
+// tpcc workers draw them only for requests that carry none. kept free of
+// the db so the networked client can use it
+
+// config constants
+
+static constexpr inline ALWAYS_INLINE size_t
+NumItems()
+{
+  return 100000;
+}
+
+static constexpr inline ALWAYS_INLINE size_t
+NumDistrictsPerWarehouse()
+{
+  return 10;
+}
+
+static constexpr inline ALWAYS_INLINE size_t
+NumCustomersPerDistrict()
+{
+  return 3000;
+}
+
+// utils for generating random #s
+
+static inline ALWAYS_INLINE int
+CheckBetweenInclusive(int v, int lower, int upper)
+{
+  INVARIANT(v >= lower);
+  INVARIANT(v <= upper);
+  return v;
+}
+
+static inline ALWAYS_INLINE int
+RandomNumber(util::fast_random &r, int min, int max)
+{
+  return CheckBetweenInclusive((int) (r.next_uniform() * (max - min + 1) + min), min, max);
+}
+
+static inline ALWAYS_INLINE int
+NonUniformRandom(util::fast_random &r, int A, int C, int min, int max)
+{
+  return (((RandomNumber(r, 0, A) | RandomNumber(r, min, max)) + C) % (max - min + 1)) + min;
+}
+
+static inline ALWAYS_INLINE int
+GetCustomerId(util::fast_random &r)
+{
+  return CheckBetweenInclusive(NonUniformRandom(r, 1023, 259, 1, NumCustomersPerDistrict()), 1, NumCustomersPerDistrict());
+}
+
+// the number of a customer's last name, as looked up by txns
+static inline ALWAYS_INLINE int
+GetNonUniformCustomerLastNameNum(util::fast_random &r)
+{
+  return NonUniformRandom(r, 255, 223, 0, 999);
+}
+
+class tpcc_input_generator {
+public:
+  // a remote item (of a NewOrder) or customer (of a Payment) is at a
+  // warehouse other than the txn's own. with one warehouse there are none
+  tpcc_input_generator(unsigned nwarehouses,
+                       unsigned new_order_remote_item_pct,
+                       unsigned payment_remote_pct,
+                       bool uniform_item_dist)
+    : nwarehouses(nwarehouses),
+      new_order_remote_item_pct(nwarehouses > 1 ? new_order_remote_item_pct : 0),
+      payment_remote_pct(nwarehouses > 1 ? payment_remote_pct : 0),
+      uniform_item_dist(uniform_item_dist)
+  {
+    ALWAYS_ASSERT(nwarehouses >= 1);
+    ALWAYS_ASSERT(new_order_remote_item_pct <= 100);
+    ALWAYS_ASSERT(payment_remote_pct <= 100);
+  }
+
+  // fills in the inputs of a req.type txn at warehouse wid
+  void
+  generate(util::fast_random &r, unsigned wid, Request &req) const
+  {
+    INVARIANT(wid >= 1 && wid <= nwarehouses);
+    req.has_inputs = true;
+    switch (req.type) {
+    case NEW_ORDER:
+      {
+        NewOrderInputs &in = req.new_order;
+        in.warehouse_id = wid;
+        in.district_id = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+        in.customer_id = GetCustomerId(r);
+        in.num_items = RandomNumber(r, 5, 15);
+        for (uint32_t i = 0; i < in.num_items; i++) {
+          in.item_ids[i] = GetItemId(r);
+          if (likely(RandomNumber(r, 1, 100) > int(new_order_remote_item_pct)))
+            in.supplier_warehouse_ids[i] = wid;
+          else
+            in.supplier_warehouse_ids[i] = RemoteWarehouseId(r, wid);
+          in.order_quantities[i] = RandomNumber(r, 1, 10);
+        }
+      }
+      break;
+    case PAYMENT:
+      {
+        PaymentInputs &in = req.payment;
+        in.warehouse_id = wid;
+        in.district_id = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+        if (likely(RandomNumber(r, 1, 100) > int(payment_remote_pct))) {
+          in.customer_district_id = in.district_id;
+          in.customer_warehouse_id = wid;
+        } else {
+          in.customer_district_id = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+          in.customer_warehouse_id = RemoteWarehouseId(r, wid);
+        }
+        in.payment_amount = (float) (RandomNumber(r, 100, 500000) / 100.0);
+        GetCustomer(r, in.customer_id, in.customer_last_name);
+      }
+      break;
+    case DELIVERY:
+      req.delivery.warehouse_id = wid;
+      req.delivery.carrier_id = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+      break;
+    case ORDER_STATUS:
+      {
+        OrderStatusInputs &in = req.order_status;
+        in.warehouse_id = wid;
+        in.district_id = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+        GetCustomer(r, in.customer_id, in.customer_last_name);
+      }
+      break;
+    case STOCK_LEVEL:
+      req.stock_level.warehouse_id = wid;
+      req.stock_level.threshold = RandomNumber(r, 10, 20);
+      req.stock_level.district_id = RandomNumber(r, 1, NumDistrictsPerWarehouse());
+      break;
+    default:
+      ALWAYS_ASSERT(false);
+    }
+  }
+
+  inline ALWAYS_INLINE int
+  GetItemId(util::fast_random &r) const
+  {
+    return CheckBetweenInclusive(
+        uniform_item_dist ?
+          RandomNumber(r, 1, NumItems()) :
+          NonUniformRandom(r, 8191, 7911, 1, NumItems()),
+        1, NumItems());
+  }
+
+  // the warehouse whose worker serves req (for a NewOrder or a Payment,
+  // other warehouses may be touched as well). req must have valid inputs
+  static inline uint32_t
+  HomeWarehouseId(const Request &req)
+  {
+    switch (req.type) {
+    case NEW_ORDER:    return req.new_order.warehouse_id;
+    case PAYMENT:      return req.payment.warehouse_id;
+    case DELIVERY:     return req.delivery.warehouse_id;
+    case ORDER_STATUS: return req.order_status.warehouse_id;
+    case STOCK_LEVEL:  return req.stock_level.warehouse_id;
+    }
+    ALWAYS_ASSERT(false);
+    return 0;
+  }
+
+  // checks that req is a TPC-C txn and that every id it carries names a row
+  // that was loaded, so a bad request (e.g. from a client configured for
+  // more warehouses than were loaded) can be failed instead of reaching the
+  // txn's asserts. a request without inputs only needs a valid type
+  static bool
+  InputsValid(const Request &req, unsigned nwarehouses)
+  {
+    if (req.type > STOCK_LEVEL)
+      return false;
+    if (!req.has_inputs)
+      return true;
+    if (!InRange(HomeWarehouseId(req), 1, nwarehouses))
+      return false;
+    switch (req.type) {
+    case NEW_ORDER:
+      {
+        const NewOrderInputs &in = req.new_order;
+        if (!InRange(in.district_id, 1, NumDistrictsPerWarehouse()) ||
+            !InRange(in.customer_id, 1, NumCustomersPerDistrict()) ||
+            !InRange(in.num_items, 1, 15))
+          return false;
+        for (uint32_t i = 0; i < in.num_items; i++)
+          if (!InRange(in.item_ids[i], 1, NumItems()) ||
+              !InRange(in.supplier_warehouse_ids[i], 1, nwarehouses))
+            return false;
+        return true;
+      }
+    case PAYMENT:
+      {
+        const PaymentInputs &in = req.payment;
+        return InRange(in.district_id, 1, NumDistrictsPerWarehouse()) &&
+               InRange(in.customer_warehouse_id, 1, nwarehouses) &&
+               InRange(in.customer_district_id, 1, NumDistrictsPerWarehouse()) &&
+               CustomerValid(in.customer_id, in.customer_last_name);
+      }
+    case DELIVERY:
+      return InRange(req.delivery.carrier_id, 1, NumDistrictsPerWarehouse());
+    case ORDER_STATUS:
+      {
+        const OrderStatusInputs &in = req.order_status;
+        return InRange(in.district_id, 1, NumDistrictsPerWarehouse()) &&
+               CustomerValid(in.customer_id, in.customer_last_name);
+      }
+    case STOCK_LEVEL:
+      return InRange(req.stock_level.district_id, 1, NumDistrictsPerWarehouse());
+    }
+    return false;
+  }
+
+private:
+  static inline bool
+  InRange(uint32_t v, size_t lower, size_t upper)
+  {
+    return v >= lower && v <= upper;
+  }
+
+  // a customer is named by id, or by last name number if the id is 0
+  static inline bool
+  CustomerValid(uint32_t customer_id, uint32_t last_name)
+  {
+    return customer_id == 0 ?
+      last_name <= 999 : customer_id <= NumCustomersPerDistrict();
+  }
+
+  // a uniformly chosen warehouse other than wid
+  inline unsigned
+  RemoteWarehouseId(util::fast_random &r, unsigned wid) const
+  {
+    INVARIANT(nwarehouses > 1);
+    unsigned ret;
+    do {
+      ret = RandomNumber(r, 1, nwarehouses);
+    } while (ret == wid);
+    return ret;
+  }
+
+  // 60% of customers are looked up by last name (customer_id = 0)
+  static inline void
+  GetCustomer(util::fast_random &r, uint32_t &customer_id, uint32_t &last_name)
+  {
+    if (RandomNumber(r, 1, 100) <= 60) {
+      customer_id = 0;
+      last_name = GetNonUniformCustomerLastNameNum(r);
+    } else {
+      customer_id = GetCustomerId(r);
+      last_name = 0;
+    }
+  }
+
+  const unsigned nwarehouses;
+  const unsigned new_order_remote_item_pct;
+  const unsigned payment_remote_pct;
+  const bool uniform_item_dist;
+};
+
+#endif /* _NDB_BENCH_TPCC_INPUTS_H_ */
@@ -4,6 +4,7 @@
 #include <utility>
 #include <string>
 #include <set>
+#include <atomic>
 
 #include <stdlib.h>
 #include <unistd.h>
@@ -18,6 +19,7 @@
 #include "../core.h"
 
 #include "bench.h"
+#include "request.h"
 
 using namespace std;
 using namespace util;
@@ -29,6 +31,10 @@ static const size_t YCSBRecordSize = 100;
 // we're missing remove for now
 // the default is a modification of YCSB "A" we made (80/20 R/W)
 static unsigned g_txn_workload_mix[] = { 80, 20, 0, 0 };
+static int g_hash_index = 0;
+
+// the key of the next insert of a request that carries no inputs
+static atomic<uint64_t> g_next_insert_key;
 
 class ycsb_worker : public bench_worker {
 public:
@@ -52,9 +58,11 @@ public:
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
     scoped_str_arena s_arena(arena);
     try {
-      const uint64_t k = r.next() % nkeys;
-      ALWAYS_ASSERT(tbl->get(txn, u64_varkey(k).str(obj_key0), obj_v));
-      computation_n += obj_v.size();
+      const uint64_t k = txn_key();
+      if (tbl->get(txn, u64_varkey(k).str(obj_key0), obj_v))
+        computation_n += obj_v.size();
+      else
+        ALWAYS_ASSERT(k >= nkeys);
       measure_txn_counters(txn, "txn_read");
       if (likely(db->commit_txn(txn)))
         return txn_result(true, 0);
@@ -76,7 +84,7 @@ public:
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
     scoped_str_arena s_arena(arena);
     try {
-      tbl->put(txn, u64_varkey(r.next() % nkeys).str(str()), str().assign(YCSBRecordSize, 'b'));
+      tbl->put(txn, u64_varkey(txn_key()).str(str()), str().assign(YCSBRecordSize, 'b'));
       measure_txn_counters(txn, "txn_write");
       if (likely(db->commit_txn(txn)))
         return txn_result(true, 0);
@@ -92,16 +100,43 @@ public:
     return static_cast<ycsb_worker *>(w)->txn_write();
   }
 
+  txn_result
+  txn_insert()
+  {
+    void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
+    scoped_str_arena s_arena(arena);
+    try {
+      const uint64_t k = cur_req->has_inputs ?
+        cur_req->ycsb.key : g_next_insert_key.fetch_add(1);
+      tbl->insert(txn, u64_varkey(k).str(str()), str().assign(YCSBRecordSize, 'd'));
+      measure_txn_counters(txn, "txn_insert");
+      if (likely(db->commit_txn(txn)))
+        return txn_result(true, YCSBRecordSize);
+    } catch (abstract_db::abstract_abort_exception &ex) {
+      db->abort_txn(txn);
+    }
+    return txn_result(false, 0);
+  }
+
+  static txn_result
+  TxnInsert(bench_worker *w)
+  {
+    return static_cast<ycsb_worker *>(w)->txn_insert();
+  }
+
   txn_result
   txn_rmw()
   {
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_RMW);
     scoped_str_arena s_arena(arena);
     try {
-      const uint64_t key = r.next() % nkeys;
-      ALWAYS_ASSERT(tbl->get(txn, u64_varkey(key).str(obj_key0), obj_v));
-      computation_n += obj_v.size();
-      tbl->put(txn, obj_key0, str().assign(YCSBRecordSize, 'c'));
+      const uint64_t key = txn_key();
+      if (tbl->get(txn, u64_varkey(key).str(obj_key0), obj_v)) {
+        computation_n += obj_v.size();
+        tbl->put(txn, obj_key0, str().assign(YCSBRecordSize, 'c'));
+      } else {
+        ALWAYS_ASSERT(key >= nkeys);
+      }
       measure_txn_counters(txn, "txn_rmw");
       if (likely(db->commit_txn(txn)))
         return txn_result(true, 0);
@@ -134,9 +169,10 @@ public:
   {
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_SCAN);
     scoped_str_arena s_arena(arena);
-    const size_t kstart = r.next() % nkeys;
+    const uint64_t kstart = txn_key();
+    const uint64_t len = cur_req->has_inputs ? cur_req->ycsb.scan_len : 100;
     const string &kbegin = u64_varkey(kstart).str(obj_key0);
-    const string &kend = u64_varkey(kstart + 100).str(obj_key1);
+    const string &kend = u64_varkey(kstart + len).str(obj_key1);
     worker_scan_callback c;
     try {
       tbl->scan(txn, kbegin, &kend, c);
@@ -174,19 +210,20 @@ public:
     //w.push_back(workload_desc("Read",  0.8, TxnRead));
     //w.push_back(workload_desc("Write", 0.2, TxnWrite));
 
+    // every op is listed, in YcsbOp order, as requests name their op by
+    // its index. the mix is [R, W, RMW, Scan]: the workers draw no ops, so
+    // it only sets the reported frequencies
     workload_desc_vec w;
     unsigned m = 0;
     for (size_t i = 0; i < ARRAY_NELEMS(g_txn_workload_mix); i++)
       m += g_txn_workload_mix[i];
     ALWAYS_ASSERT(m == 100);
-    if (g_txn_workload_mix[0])
-      w.push_back(workload_desc("Read",  double(g_txn_workload_mix[0])/100.0, TxnRead));
-    if (g_txn_workload_mix[1])
-      w.push_back(workload_desc("Write",  double(g_txn_workload_mix[1])/100.0, TxnWrite));
-    if (g_txn_workload_mix[2])
-      w.push_back(workload_desc("ReadModifyWrite",  double(g_txn_workload_mix[2])/100.0, TxnRmw));
-    if (g_txn_workload_mix[3])
-      w.push_back(workload_desc("Scan",  double(g_txn_workload_mix[3])/100.0, TxnScan));
+    w.push_back(workload_desc("Read",  double(g_txn_workload_mix[0])/100.0, TxnRead));
+    w.push_back(workload_desc("Write",  double(g_txn_workload_mix[1])/100.0, TxnWrite));
+    w.push_back(workload_desc("Insert",  0.0, TxnInsert));
+    w.push_back(workload_desc("Scan",  double(g_txn_workload_mix[3])/100.0, TxnScan));
+    w.push_back(workload_desc("ReadModifyWrite",  double(g_txn_workload_mix[2])/100.0, TxnRmw));
+    ALWAYS_ASSERT(w.size() == YCSB_NUM_OPS);
     return w;
   }
 
@@ -202,6 +239,34 @@ protected:
     rcu::s_instance.pin_current_thread(b);
   }
 
+  // the writes to a key conflict with each other, which under a skewed key
+  // distribution makes the hot keys' writes abort each other
+  virtual size_t
+  conflict_key(const Request &req) const OVERRIDE
+  {
+    if (!req.has_inputs ||
+        (req.type != YCSB_UPDATE && req.type != YCSB_INSERT &&
+         req.type != YCSB_RMW))
+      return NoConflictKey;
+    return req.ycsb.key;
+  }
+
+  // a hash index cannot scan, but the client's mix may still ask for scans
+  virtual bool
+  rejects(const Request &req) const OVERRIDE
+  {
+    return g_hash_index && req.type == YCSB_SCAN;
+  }
+
+  // the key of the current op: the client's, or drawn here if the request
+  // carries none. keys past the loaded ones may name records whose inserts
+  // have not run yet, so ops on them can miss
+  inline uint64_t
+  txn_key()
+  {
+    return cur_req->has_inputs ? cur_req->ycsb.key : r.next() % nkeys;
+  }
+
   inline ALWAYS_INLINE string &
   str() {
     return *arena.next();
@@ -340,7 +405,9 @@ public:
   ycsb_bench_runner(abstract_db *db)
     : bench_runner(db)
   {
-    open_tables["USERTABLE"] = db->open_index("USERTABLE", YCSBRecordSize);
+    open_tables["USERTABLE"] = g_hash_index ?
+      db->open_hash_index("USERTABLE", YCSBRecordSize, nkeys) :
+      db->open_index("USERTABLE", YCSBRecordSize);
   }
 
 protected:
@@ -464,12 +531,14 @@ ycsb_do_test(abstract_db *db, int argc, char **argv)
 {
   nkeys = size_t(scale_factor * 1000.0);
   ALWAYS_ASSERT(nkeys > 0);
+  g_next_insert_key = nkeys;
 
   // parse options
   optind = 1;
   while (1) {
     static struct option long_options[] = {
-      {"workload-mix" , required_argument , 0 , 'w'},
+      {"workload-mix" , required_argument , 0             , 'w'},
+      {"hash-index"   , no_argument       , &g_hash_index , 1}, // scans from the client fail
       {0, 0, 0, 0}
     };
     int option_index = 0;
@@ -507,11 +576,19 @@ ycsb_do_test(abstract_db *db, int argc, char **argv)
     }
   }
 
+  if (g_hash_index && g_txn_workload_mix[3]) {
+    cerr << "--hash-index cannot be used with a workload mix that scans "
+         << "(scans a client's TBENCH_YCSB_MIX asks for are answered as failed)"
+         << endl;
+    exit(1);
+  }
+
   if (verbose) {
     cerr << "ycsb settings:" << endl;
     cerr << "  workload_mix: "
          << format_list(g_txn_workload_mix, g_txn_workload_mix + ARRAY_NELEMS(g_txn_workload_mix))
          << endl;
+    cerr << "  hash_index: " << g_hash_index << endl;
   }
 
   ycsb_bench_runner r(db);
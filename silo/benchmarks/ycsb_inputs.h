@@ -0,0 +1,161 @@
+#ifndef _NDB_BENCH_YCSB_INPUTS_H_
+#define _NDB_BENCH_YCSB_INPUTS_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "../macros.h"
+#include "../util.h"
+#include "request.h"
+
+// YCSB op inputs (Cooper et al., SoCC 2010), drawn by the harness client for
+// each request and executed as given by the ycsb workers. kept free of the db
+// so the networked client can use it
+
+// zipfian over [0, n) with constant theta, as YCSB's ZipfianGenerator (Gray et
+// al., "Quickly Generating Billion-Record Synthetic Databases"). n may grow
+// between draws, in which case zeta(n) is extended incrementally
+class zipfian_generator {
+public:
+  zipfian_generator(uint64_t n, double theta)
+    : theta(theta), alpha(1.0 / (1.0 - theta)), zeta2(zeta(0, 2, theta)),
+      zetan(0), eta(0), n(0)
+  {
+    ALWAYS_ASSERT(theta > 0 && theta < 1);
+    grow(n);
+  }
+
+  // the item of rank next() is the next() most popular: 0 is the hottest.
+  // u is uniform in [0, 1)
+  inline uint64_t
+  next(double u, uint64_t count)
+  {
+    if (count > n)
+      grow(count);
+    const double uz = u * zetan;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + pow(0.5, theta))
+      return 1;
+    return std::min<uint64_t>(n * pow(eta * u - eta + 1.0, alpha), n - 1);
+  }
+
+private:
+  static double
+  zeta(uint64_t from, uint64_t to, double theta)
+  {
+    double sum = 0;
+    for (uint64_t i = from; i < to; i++)
+      sum += 1.0 / pow(i + 1, theta);
+    return sum;
+  }
+
+  void
+  grow(uint64_t newn)
+  {
+    INVARIANT(newn > n);
+    zetan += zeta(n, newn, theta);
+    n = newn;
+    eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+  }
+
+  const double theta;
+  const double alpha;
+  const double zeta2;
+  double zetan;
+  double eta;
+  uint64_t n;
+};
+
+class ycsb_input_generator {
+public:
+  // which keys the ops name. ZIPFIAN scatters its hot keys over the key
+  // space, as YCSB's ScrambledZipfianGenerator does; LATEST makes the most
+  // recently inserted keys the hottest
+  enum key_dist { UNIFORM, ZIPFIAN, LATEST };
+
+  // mix[op] is op's percentage, in YcsbOp order. nrecords must be the
+  // number of records the server loaded. a scan covers 1 to max_scan_len
+  // keys, chosen uniformly
+  ycsb_input_generator(const unsigned (&mix)[YCSB_NUM_OPS],
+                       uint64_t nrecords,
+                       key_dist dist,
+                       double theta,
+                       uint32_t max_scan_len)
+    : ninserted(nrecords), dist(dist), max_scan_len(max_scan_len),
+      zipf(nullptr)
+  {
+    ALWAYS_ASSERT(nrecords > 0);
+    ALWAYS_ASSERT(max_scan_len > 0);
+    unsigned s = 0;
+    for (size_t i = 0; i < YCSB_NUM_OPS; i++) {
+      s += mix[i];
+      op_cdf[i] = s;
+    }
+    ALWAYS_ASSERT(s == 100);
+    if (dist != UNIFORM)
+      zipf = new zipfian_generator(nrecords, theta);
+  }
+
+  ~ycsb_input_generator()
+  {
+    delete zipf;
+  }
+
+  ycsb_input_generator(const ycsb_input_generator &) = delete;
+  ycsb_input_generator &operator=(const ycsb_input_generator &) = delete;
+
+  // draws an op and fills in req with it. not thread safe: inserts take the
+  // next key in turn
+  void
+  generate(util::fast_random &r, Request &req)
+  {
+    const unsigned p = r.next() % 100;
+    size_t op = 0;
+    while (p >= op_cdf[op])
+      op++;
+    req.type = op;
+    req.has_inputs = true;
+    YcsbInputs &in = req.ycsb;
+    in.key = op == YCSB_INSERT ? ninserted++ : next_key(r);
+    in.scan_len = op == YCSB_SCAN ? 1 + r.next() % max_scan_len : 0;
+  }
+
+  static inline uint64_t
+  Hash(uint64_t v)
+  {
+    // 64-bit FNV-1a over the bytes of v, as YCSB's Utils.fnvhash64
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < sizeof(v); i++) {
+      h = (h ^ (v & 0xff)) * 0x100000001b3ULL;
+      v >>= 8;
+    }
+    return h;
+  }
+
+private:
+  inline uint64_t
+  next_key(util::fast_random &r)
+  {
+    switch (dist) {
+    case UNIFORM:
+      return r.next() % ninserted;
+    case ZIPFIAN:
+      return Hash(zipf->next(r.next_uniform(), ninserted)) % ninserted;
+    case LATEST:
+      return ninserted - 1 - zipf->next(r.next_uniform(), ninserted);
+    }
+    ALWAYS_ASSERT(false);
+    return 0;
+  }
+
+  unsigned op_cdf[YCSB_NUM_OPS]; // op_cdf[i]: percentage of ops <= i
+  uint64_t ninserted; // keys [0, ninserted) have been loaded or inserted
+  const key_dist dist;
+  const uint32_t max_scan_len;
+  zipfian_generator *zipf;
+};
+
+#endif /* _NDB_BENCH_YCSB_INPUTS_H_ */
@@ -1164,6 +1164,7 @@ private:
   static void recursive_delete(node *n);
 
   node *volatile root_;
+  uint32_t log_id_;
 
 public:
 
@@ -1176,7 +1177,7 @@ public:
     uint64_t new_version;
   };
 
-  btree() : root_(leaf_node::alloc())
+  btree() : root_(leaf_node::alloc()), log_id_(0)
   {
     static_assert(
         NKeysPerNode > (sizeof(key_slice) + 2), "XX"); // so we can always do a split
@@ -1238,6 +1239,30 @@ public:
     return search_impl(k, v, ns, search_info);
   }
 
+  // this tree keeps no point hash (see mbtree::init_point_hash()), so its
+  // exact-key lookups always descend
+  inline void
+  init_point_hash(size_t expected_nkeys)
+  {
+  }
+
+  /**
+   * Looks up keys[0, n), as n calls to search() would. search_infos may be
+   * null. This tree does not interleave the lookups
+   */
+  inline void
+  multi_search(const key_type *keys, size_t n, value_type *values,
+               bool *found, versioned_node_t *search_infos = nullptr) const
+  {
+    rcu_region guard;
+    typename util::vec<leaf_node *>::type ns;
+    for (size_t i = 0; i < n; i++) {
+      ns.clear();
+      found[i] = search_impl(keys[i], values[i], ns,
+                             search_infos ? &search_infos[i] : nullptr);
+    }
+  }
+
   /**
    * The low level callback interface is as follows:
    *
@@ -1552,6 +1577,19 @@ public:
     return sizeof(leaf_node);
   }
 
+  // names this tree in txn_logger log records (0 if not registered)
+  inline uint32_t
+  get_log_id() const
+  {
+    return log_id_;
+  }
+
+  inline void
+  set_log_id(uint32_t log_id)
+  {
+    log_id_ = log_id;
+  }
+
 private:
 
   /**
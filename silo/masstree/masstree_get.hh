@@ -56,6 +56,86 @@ bool unlocked_tcursor<P>::find_unlocked(threadinfo& ti)
         return match;
 }
 
+template <typename P>
+bool unlocked_stepcursor<P>::step(threadinfo& ti)
+{
+    if (state_ == s_value) {
+        state_ = s_found;
+        return true;
+    }
+
+    int match;
+    key_indexed_position kx;
+    nodeversion_type v;
+
+ retry:
+    // n_ was prefetched by the previous step. Check the parent after reading
+    // n_'s version, as reach_leaf() does; on any change, restart the layer.
+    v = n_->stable_annotated(ti.stable_fence());
+    if (parent_) {
+        if (parent_->has_changed(pv_)) {
+            ti.mark(tc_internode_retry);
+            start_layer(layer_root_);
+            goto retry;
+        }
+    } else
+        while (v.has_split()) {
+            ti.mark(tc_root_retry);
+            n_ = n_->unsplit_ancestor();
+            v = n_->stable_annotated(ti.stable_fence());
+        }
+
+    if (!v.isleaf()) {
+        const internode<P>* in = static_cast<const internode<P>*>(n_);
+        const node_base<P>* child = in->child_[internode<P>::bound_type::upper(ka_, *in)];
+        if (!child) {
+            start_layer(layer_root_);
+            goto retry;
+        }
+        parent_ = in;
+        pv_ = v;
+        n_ = child;
+        n_->prefetch_full();
+        return false;
+    }
+
+    leaf_ = const_cast<leaf<P>*>(static_cast<const leaf<P>*>(n_));
+    v_ = v;
+
+ forward:
+    if (v_.deleted()) {
+        start_layer(layer_root_);
+        goto retry;
+    }
+
+    perm_ = leaf_->permutation();
+    kx = leaf<P>::bound_type::lower(ka_, *this);
+    if (kx.p >= 0) {
+        lv_ = leaf_->lv_[kx.p];
+        match = leaf_->ksuf_matches(kx.p, ka_);
+    } else
+        match = 0;
+    if (leaf_->has_changed(v_)) {
+        ti.mark(threadcounter(tc_stable_leaf_insert + leaf_->simple_has_split(v_)));
+        leaf_ = leaf_->advance_to_key(ka_, v_, ti);
+        goto forward;
+    }
+
+    if (match < 0) {
+        ka_.shift_by(-match);
+        start_layer(lv_.layer());
+        return false;
+    } else if (match) {
+        // Let the value load while other lookups step
+        lv_.prefetch(leaf_->keylenx_[kx.p]);
+        state_ = s_value;
+        return false;
+    } else {
+        state_ = s_notfound;
+        return true;
+    }
+}
+
 template <typename P>
 inline bool basic_table<P>::get(Str key, value_type &value,
                                 threadinfo& ti) const
@@ -88,6 +88,70 @@ class unlocked_tcursor {
     const node_base<P>* root_;
 };
 
+// A lookup that advances one node per step(), so that the traversals of
+// several independent lookups can be interleaved. Each step prefetches the
+// node the next step reads, and the caller steps other lookups while it
+// loads. Same semantics as unlocked_tcursor::find_unlocked().
+template <typename P>
+class unlocked_stepcursor {
+  public:
+    typedef typename P::value_type value_type;
+    typedef key<typename P::ikey_type> key_type;
+    typedef typename P::threadinfo_type threadinfo;
+    typedef typename leaf<P>::nodeversion_type nodeversion_type;
+    typedef typename nodeversion_type::value_type nodeversion_value_type;
+    typedef typename leaf<P>::permuter_type permuter_type;
+
+    void reset(const basic_table<P>& table, Str str) {
+        ka_ = key_type(str);
+        lv_ = leafvalue<P>::make_empty();
+        state_ = s_descend;
+        start_layer(table.root());
+    }
+
+    // Returns true once the lookup is done
+    bool step(threadinfo& ti);
+
+    inline bool found() const {
+        return state_ == s_found;
+    }
+    inline value_type value() const {
+        return lv_.value();
+    }
+    inline leaf<P>* node() const {
+        return leaf_;
+    }
+    inline permuter_type permutation() const {
+        return perm_;
+    }
+    inline int compare_key(const key_type& a, int bp) const {
+        return leaf_->compare_key(a, bp);
+    }
+    inline nodeversion_value_type full_version_value() const {
+        return (v_.version_value() << leaf<P>::permuter_type::size_bits) + perm_.size();
+    }
+
+  private:
+    enum { s_descend, s_value, s_found, s_notfound };
+
+    key_type ka_;
+    const node_base<P>* layer_root_;
+    const node_base<P>* n_;
+    const internode<P>* parent_;
+    nodeversion_type pv_;
+    leaf<P>* leaf_;
+    nodeversion_type v_;
+    permuter_type perm_;
+    leafvalue<P> lv_;
+    int state_;
+
+    void start_layer(const node_base<P>* root) {
+        layer_root_ = n_ = root;
+        parent_ = 0;
+        n_->prefetch_full();
+    }
+};
+
 template <typename P>
 class tcursor {
   public:
@@ -23,6 +23,7 @@
 #include "amd64.h"
 #include "rcu.h"
 #include "util.h"
+#include "point_hash.h"
 #include "small_vector.h"
 #include "ownership_checker.h"
 
@@ -228,7 +229,7 @@ private:
 public:
 #endif
 
-  mbtree() {
+  mbtree() : log_id_(0), hash_(nullptr) {
     threadinfo ti;
     table_.initialize(ti);
   }
@@ -237,6 +238,7 @@ public:
     rcu_region guard;
     threadinfo ti;
     table_.destroy(ti);
+    delete hash_;
   }
 
   /**
@@ -247,6 +249,22 @@ public:
     threadinfo ti;
     table_.destroy(ti);
     table_.initialize(ti);
+    if (hash_)
+      hash_->clear();
+  }
+
+  /**
+   * Keeps a hash of the keys next to the tree, so that search() finds a
+   * present key without descending. Every insert and remove updates the
+   * hash while it holds the key's leaf lock, so the two never disagree.
+   * Keys that are absent are still searched for in the tree, whose leaf
+   * versions back the txn layer's absent set.
+   *
+   * NOT THREAD SAFE: call before any key is inserted
+   */
+  inline void init_point_hash(size_t expected_nkeys) {
+    ALWAYS_ASSERT(!hash_);
+    hash_ = new point_hash<value_type>(expected_nkeys);
   }
 
   /** Note: invariant checking is not thread safe */
@@ -259,6 +277,15 @@ public:
   inline bool search(const key_type &k, value_type &v,
                      versioned_node_t *search_info = nullptr) const;
 
+  /**
+   * Looks up keys[0, n), as n calls to search() would, but keeps several
+   * traversals in flight: each one prefetches its next node and steps aside
+   * while it loads. search_infos may be null
+   */
+  inline void multi_search(const key_type *keys, size_t n, value_type *values,
+                           bool *found,
+                           versioned_node_t *search_infos = nullptr) const;
+
   /**
    * The low level callback interface is as follows:
    *
@@ -471,8 +498,19 @@ public:
     return sizeof(leaf_type);
   }
 
+  // names this tree in txn_logger log records (0 if not registered)
+  inline uint32_t get_log_id() const {
+    return log_id_;
+  }
+
+  inline void set_log_id(uint32_t log_id) {
+    log_id_ = log_id;
+  }
+
  private:
   Masstree::basic_table<P> table_;
+  uint32_t log_id_;
+  point_hash<value_type> *hash_;
 
   static leaf_type* leftmost_descend_layer(node_base_type* n);
   class size_walk_callback;
@@ -585,6 +623,8 @@ inline bool mbtree<P>::search(const key_type &k, value_type &v,
                               versioned_node_t *search_info) const
 {
   rcu_region guard;
+  if (hash_ && hash_->get(k.data(), k.length(), v))
+    return true;
   threadinfo ti;
   Masstree::unlocked_tcursor<P> lp(table_, k.data(), k.length());
   bool found = lp.find_unlocked(ti);
@@ -595,6 +635,74 @@ inline bool mbtree<P>::search(const key_type &k, value_type &v,
   return found;
 }
 
+template <typename P>
+inline void mbtree<P>::multi_search(const key_type *keys, size_t n,
+                                    value_type *values, bool *found,
+                                    versioned_node_t *search_infos) const
+{
+  static const size_t MaxInFlight = 8;
+  rcu_region guard;
+  if (hash_) {
+    // a present key costs a bucket, an entry and its value rather than a
+    // descent. each of the three is loaded for every key of a batch before
+    // any key waits on the next
+    static const size_t MaxHashBatch = 32;
+    uint64_t hs[MaxHashBatch];
+    for (size_t i0 = 0; i0 < n; i0 += MaxHashBatch) {
+      const size_t m = std::min(n - i0, MaxHashBatch);
+      for (size_t j = 0; j < m; j++) {
+        hs[j] = point_hash<value_type>::Hash(keys[i0 + j].data(), keys[i0 + j].length());
+        hash_->prefetch_bucket(hs[j]);
+      }
+      for (size_t j = 0; j < m; j++)
+        hash_->prefetch_entry(hs[j]);
+      for (size_t j = 0; j < m; j++) {
+        const size_t i = i0 + j;
+        found[i] = hash_->get(hs[j], keys[i].data(), keys[i].length(), values[i]);
+        if (found[i])
+          ::prefetch(values[i]);
+      }
+      for (size_t j = 0; j < m; j++) {
+        const size_t i = i0 + j;
+        if (!found[i])
+          found[i] = search(keys[i], values[i],
+                            search_infos ? &search_infos[i] : nullptr);
+      }
+    }
+    return;
+  }
+  threadinfo ti;
+  Masstree::unlocked_stepcursor<P> lps[MaxInFlight];
+  size_t idxs[MaxInFlight];
+  size_t nactive = 0, next = 0;
+  for (; nactive < std::min(n, MaxInFlight); nactive++, next++) {
+    lps[nactive].reset(table_, lcdf::Str(keys[next].data(), keys[next].length()));
+    idxs[nactive] = next;
+  }
+  while (nactive) {
+    for (size_t i = 0; i < nactive;) {
+      Masstree::unlocked_stepcursor<P> &lp = lps[i];
+      if (!lp.step(ti)) {
+        i++;
+        continue;
+      }
+      const size_t idx = idxs[i];
+      found[idx] = lp.found();
+      if (found[idx])
+        values[idx] = lp.value();
+      if (search_infos)
+        search_infos[idx] = versioned_node_t(lp.node(), lp.full_version_value());
+      if (next < n) {
+        lp.reset(table_, lcdf::Str(keys[next].data(), keys[next].length()));
+        idxs[i++] = next++;
+      } else if (i != --nactive) {
+        lps[i] = lps[nactive];
+        idxs[i] = idxs[nactive];
+      }
+    }
+  }
+}
+
 template <typename P>
 inline bool mbtree<P>::insert(const key_type &k, value_type v,
                               value_type *old_v,
@@ -609,6 +717,8 @@ inline bool mbtree<P>::insert(const key_type &k, value_type v,
   if (found && old_v)
     *old_v = lp.value();
   lp.value() = v;
+  if (hash_)
+    hash_->put(k.data(), k.length(), v);
   if (insert_info) {
     insert_info->node = lp.node();
     insert_info->old_version = lp.previous_full_version_value();
@@ -629,6 +739,8 @@ inline bool mbtree<P>::insert_if_absent(const key_type &k, value_type v,
   if (!found) {
     ti.advance_timestamp(lp.node_timestamp());
     lp.value() = v;
+    if (hash_)
+      hash_->put(k.data(), k.length(), v);
     if (insert_info) {
       insert_info->node = lp.node();
       insert_info->old_version = lp.previous_full_version_value();
@@ -654,6 +766,8 @@ inline bool mbtree<P>::remove(const key_type &k, value_type *old_v)
   bool found = lp.find_locked(ti);
   if (found && old_v)
     *old_v = lp.value();
+  if (found && hash_)
+    hash_->remove(k.data(), k.length());
   lp.finish(found ? -1 : 0, ti);
   return found;
 }
@@ -0,0 +1,194 @@
+#ifndef _NDB_POINT_HASH_H_
+#define _NDB_POINT_HASH_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "macros.h"
+#include "lockguard.h"
+#include "prefetch.h"
+#include "rcu.h"
+#include "spinlock.h"
+#include "util.h"
+
+/**
+ * A concurrent hash from keys to values, for exact-key lookups that would
+ * otherwise descend a tree. Readers take no locks, but must be in an RCU
+ * region; writers lock the key's bucket, and removed entries are RCU freed.
+ *
+ * The bucket count is fixed when the hash is made, from the number of keys
+ * it is expected to hold: more keys only make the chains longer
+ */
+template <typename V>
+class point_hash {
+public:
+
+  explicit point_hash(size_t expected_nkeys)
+  {
+    size_t nbuckets = 1;
+    while (nbuckets < expected_nkeys)
+      nbuckets <<= 1;
+    mask = nbuckets - 1;
+    buckets = reinterpret_cast<std::atomic<entry *> *>(
+        calloc(nbuckets, sizeof(std::atomic<entry *>)));
+    ALWAYS_ASSERT(buckets);
+    nlocks = std::min(nbuckets, size_t(MaxLocks));
+    locks = new spinlock[nlocks];
+  }
+
+  ~point_hash()
+  {
+    clear();
+    free(buckets);
+    delete [] locks;
+  }
+
+  point_hash(const point_hash &) = delete;
+  point_hash &operator=(const point_hash &) = delete;
+
+  // FNV-1a over 8-byte words, with murmur3's finalizer so that the low
+  // bits, which pick the bucket, depend on every byte
+  static inline uint64_t
+  Hash(const uint8_t *k, size_t klen)
+  {
+    uint64_t h = 0xcbf29ce484222325ULL ^ klen;
+    uint64_t w;
+    size_t i = 0;
+    for (; i + sizeof(w) <= klen; i += sizeof(w)) {
+      NDB_MEMCPY(&w, k + i, sizeof(w));
+      h = (h ^ w) * 0x100000001b3ULL;
+    }
+    if (i < klen) {
+      w = 0;
+      NDB_MEMCPY(&w, k + i, klen - i);
+      h = (h ^ w) * 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  // a batch of gets can overlap its misses: prefetch_bucket() every key's
+  // bucket, then prefetch_entry() every key's first entry, then get()
+  inline void
+  prefetch_bucket(uint64_t h) const
+  {
+    ::prefetch(&buckets[h & mask]);
+  }
+
+  inline void
+  prefetch_entry(uint64_t h) const
+  {
+    const entry * const e = buckets[h & mask].load(std::memory_order_acquire);
+    if (e)
+      ::prefetch(e);
+  }
+
+  inline bool
+  get(const uint8_t *k, size_t klen, V &v) const
+  {
+    return get(Hash(k, klen), k, klen, v);
+  }
+
+  // h is Hash(k, klen)
+  inline bool
+  get(uint64_t h, const uint8_t *k, size_t klen, V &v) const
+  {
+    for (const entry *e = buckets[h & mask].load(std::memory_order_acquire);
+         e; e = e->next.load(std::memory_order_acquire)) {
+      if (e->matches(h, k, klen)) {
+        v = e->value.load(std::memory_order_acquire);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // sets the value of k to v, adding k if it is absent
+  void
+  put(const uint8_t *k, size_t klen, V v)
+  {
+    const uint64_t h = Hash(k, klen);
+    std::atomic<entry *> &bucket = buckets[h & mask];
+    ::lock_guard<spinlock> l(locks[h & (nlocks - 1)]);
+    for (entry *e = bucket.load(std::memory_order_relaxed);
+         e; e = e->next.load(std::memory_order_relaxed)) {
+      if (e->matches(h, k, klen)) {
+        e->value.store(v, std::memory_order_release);
+        return;
+      }
+    }
+    entry * const e =
+      reinterpret_cast<entry *>(rcu::s_instance.alloc(sizeof(entry) + klen));
+    e->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    e->h = h;
+    e->value.store(v, std::memory_order_relaxed);
+    e->klen = klen;
+    NDB_MEMCPY(&e->key[0], k, klen);
+    bucket.store(e, std::memory_order_release);
+  }
+
+  // returns true if k was removed
+  bool
+  remove(const uint8_t *k, size_t klen)
+  {
+    const uint64_t h = Hash(k, klen);
+    ::lock_guard<spinlock> l(locks[h & (nlocks - 1)]);
+    std::atomic<entry *> *pe = &buckets[h & mask];
+    for (entry *e = pe->load(std::memory_order_relaxed);
+         e; pe = &e->next, e = pe->load(std::memory_order_relaxed)) {
+      if (e->matches(h, k, klen)) {
+        pe->store(e->next.load(std::memory_order_relaxed), std::memory_order_release);
+        rcu::s_instance.dealloc_rcu(e, sizeof(entry) + e->klen);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * NOT THREAD SAFE
+   */
+  void
+  clear()
+  {
+    for (size_t i = 0; i <= mask; i++) {
+      entry *e = buckets[i].load(std::memory_order_relaxed);
+      while (e) {
+        entry * const next = e->next.load(std::memory_order_relaxed);
+        rcu::s_instance.dealloc(e, sizeof(entry) + e->klen);
+        e = next;
+      }
+      buckets[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+private:
+
+  static const size_t MaxLocks = 1024;
+
+  struct entry {
+    std::atomic<entry *> next;
+    uint64_t h;
+    std::atomic<V> value;
+    uint32_t klen;
+    uint8_t key[0];
+
+    inline bool
+    matches(uint64_t h, const uint8_t *k, size_t klen) const
+    {
+      return this->h == h && this->klen == klen && !memcmp(&key[0], k, klen);
+    }
+  };
+
+  std::atomic<entry *> *buckets;
+  size_t mask;
+  spinlock *locks;
+  size_t nlocks;
+};
+
+#endif /* _NDB_POINT_HASH_H_ */
@@ -76,8 +76,11 @@ public:
   static_assert(EpochTimeMultiplier >= 1, "XX");
 
   // legacy helpers
-  static const uint64_t EpochTimeUsec = ticker::tick_us * EpochTimeMultiplier;
-  static const uint64_t EpochTimeNsec = EpochTimeUsec * 1000;
+  static inline uint64_t
+  EpochTimeUsec()
+  {
+    return ticker::tick_us * EpochTimeMultiplier;
+  }
 
   static const size_t NQueueGroups = 32;
 
@@ -1,3 +1,4 @@
 #include "ticker.h"
 
+std::atomic<uint64_t> ticker::tick_us(ticker::default_tick_us);
 ticker ticker::s_instance;
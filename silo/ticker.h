@@ -13,11 +13,16 @@ class ticker {
 public:
 
 #ifdef CHECK_INVARIANTS
-  static const uint64_t tick_us = 1 * 1000; /* 1 ms */
+  static const uint64_t default_tick_us = 1 * 1000; /* 1 ms */
 #else
-  static const uint64_t tick_us = 40 * 1000; /* 40 ms */
+  static const uint64_t default_tick_us = 40 * 1000; /* 40 ms */
 #endif
 
+  // length of a tick, which is also the length of a persistence epoch. read
+  // only and GC epochs are multiples of it. should only be changed
+  // before any txns run
+  static std::atomic<uint64_t> tick_us;
+
   ticker()
     : current_tick_(1), last_tick_inclusive_(0)
   {
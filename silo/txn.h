@@ -854,6 +854,10 @@ struct txn_epoch_sync {
   static inline void finish() {}
   // run this code when a benchmark worker finishes
   static inline void thread_end() {}
+  // txns this thread committed so far are in epochs <= current_epoch(), and
+  // txns in epochs <= persisted_epoch() are durable
+  static inline uint64_t current_epoch() { return 0; }
+  static inline uint64_t persisted_epoch() { return 0; }
   // how many txns have we persisted in total, from
   // the last reset invocation?
   static inline std::pair<uint64_t, double>
@@ -311,6 +311,28 @@ public:
     return this->do_search(t, k, r);
   }
 
+  // sets found[i] and values[i] as search(t, keys[i], values[i]) would, for
+  // each i in [0, n), with the lookups' tree traversals overlapped
+  template <typename Traits>
+  inline void
+  multi_search(Transaction<Traits> &t,
+               const key_type *keys,
+               value_type *values,
+               bool *found,
+               size_t n,
+               size_type max_bytes_read = string_type::npos)
+  {
+    typename util::vec<
+      single_value_reader_type, super_type::MultiSearchMaxKeys>::type rs;
+    for (size_t i = 0; i < n; i += super_type::MultiSearchMaxKeys) {
+      const size_t m = std::min(n - i, size_t(super_type::MultiSearchMaxKeys));
+      rs.clear();
+      for (size_t j = 0; j < m; j++)
+        rs.emplace_back(&values[i + j], max_bytes_read);
+      this->do_multi_search(t, &keys[i], rs, &found[i], m);
+    }
+  }
+
   template <typename Traits>
   inline void
   search_range_call(Transaction<Traits> &t,
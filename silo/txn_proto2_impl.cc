@@ -1,13 +1,23 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <functional>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <limits.h>
+#include <sched.h>
 #include <numa.h>
 
 #include "txn_proto2_impl.h"
 #include "counter.h"
+#include "lockguard.h"
 #include "util.h"
 
 using namespace std;
@@ -19,7 +29,11 @@ bool txn_logger::g_persist = false;
 bool txn_logger::g_call_fsync = true;
 bool txn_logger::g_use_compression = false;
 bool txn_logger::g_fake_writes = false;
+bool txn_logger::g_pin_loggers_to_numa_nodes = false;
 size_t txn_logger::g_nworkers = 0;
+size_t txn_logger::g_nlogs = 0;
+txn_logger::log_progress
+  txn_logger::g_log_progress[txn_logger::g_nmax_loggers];
 txn_logger::epoch_array
   txn_logger::per_thread_sync_epochs_[txn_logger::g_nmax_loggers];
 aligned_padded_elem<atomic<uint64_t>>
@@ -51,6 +65,8 @@ event_avg_counter
 
 static event_avg_counter
   evt_avg_log_buffer_iov_len("avg_log_buffer_iov_len");
+static event_counter
+  evt_logger_numa_moves("logger_numa_moves");
 
 void
 txn_logger::Init(
@@ -60,7 +76,8 @@ txn_logger::Init(
     vector<vector<unsigned>> *assignments_used,
     bool call_fsync,
     bool use_compression,
-    bool fake_writes)
+    bool fake_writes,
+    bool pin_to_numa_nodes)
 {
   INVARIANT(!g_persist);
   INVARIANT(g_nworkers == 0);
@@ -81,7 +98,11 @@ txn_logger::Init(
   g_call_fsync = call_fsync;
   g_use_compression = use_compression;
   g_fake_writes = fake_writes;
+  g_pin_loggers_to_numa_nodes = pin_to_numa_nodes && numa_available() >= 0;
   g_nworkers = nworkers;
+  g_nlogs = fds.size();
+  for (size_t i = 0; i < fds.size(); i++)
+    g_log_progress[i].fd_ = fds[i];
 
   for (size_t i = 0; i < g_nmax_loggers; i++)
     for (size_t j = 0; j < g_nworkers; j++)
@@ -176,6 +197,10 @@ txn_logger::advance_system_sync_epoch(
               }
             }
             if (did_lock) {
+              // the thread may still hold txns it has not pushed to its
+              // logger. push them for it, or they would count as persisted
+              // before they are written
+              txn_epoch_sync<transaction_proto2>::push_pending_log_buffers(k);
               if (!ctx.persist_buffers_.peek()) {
                 min_so_far = min(min_so_far, best_tick_inc);
                 per_thread_sync_epochs_[i].epochs_[k].store(
@@ -220,15 +245,32 @@ txn_logger::advance_system_sync_epoch(
   system_sync_epoch_->store(min_so_far, memory_order_release);
 }
 
+int
+txn_logger::CurrentNumaNode()
+{
+  const int cpu = sched_getcpu();
+  ALWAYS_ASSERT(cpu >= 0);
+  return numa_node_of_cpu(cpu);
+}
+
 void
 txn_logger::writer(
     unsigned id, int fd,
     vector<unsigned> assignment)
 {
 
+  // until it has seen whose buffers it writes, spread the loggers over the
+  // nodes. then, once a second, move to the node whose cores filled the most
+  // bytes since the last move
+  int numa_node = -1;
+  vector<uint64_t> numa_node_nbytes;
+  uint64_t numa_moved_us = 0;
   if (g_pin_loggers_to_numa_nodes) {
-    ALWAYS_ASSERT(!numa_run_on_node(id % numa_num_configured_nodes()));
+    numa_node = id % numa_num_configured_nodes();
+    ALWAYS_ASSERT(!numa_run_on_node(numa_node));
     ALWAYS_ASSERT(!sched_yield());
+    numa_node_nbytes.resize(numa_max_node() + 1);
+    numa_moved_us = timer::cur_usec();
   }
 
   vector<iovec> iovs(
@@ -247,6 +289,7 @@ txn_logger::writer(
   // NOTE: a core id in the persistence system really represets
   // all cores in the regular system modulo g_nworkers
   size_t nbufswritten = 0, nbyteswritten = 0;
+  uint64_t max_epoch_written = 0;
   for (;;) {
 
     const uint64_t last_loop_usec = loop_timer.lap();
@@ -300,6 +343,8 @@ txn_logger::writer(
 
           iovs[nbufswritten].iov_len = pxlen;
           evt_avg_log_buffer_iov_len.offer(pxlen);
+          if (ctx.numa_node_ >= 0)
+            numa_node_nbytes[ctx.numa_node_] += pxlen;
           px->io_scheduled_ = true;
           nbufswritten++;
           nbyteswritten += pxlen;
@@ -323,6 +368,7 @@ txn_logger::writer(
           INVARIANT(epoch_prefixes[sense][k] <= px_epoch);
           INVARIANT(px_epoch > 0);
           epoch_prefixes[sense][k] = px_epoch - 1;
+          max_epoch_written = max(max_epoch_written, px_epoch);
           auto &pes = g_persist_stats[k].d_[px_epoch % g_max_lag_epochs];
           if (!pes.ntxns_.load(memory_order_acquire))
             pes.earliest_start_us_.store(px->earliest_start_us_, memory_order_release);
@@ -339,6 +385,20 @@ txn_logger::writer(
       continue;
     }
 
+    if (g_pin_loggers_to_numa_nodes &&
+        timer::cur_usec() - numa_moved_us >= 1000000) {
+      const int busiest = max_element(numa_node_nbytes.begin(),
+                                      numa_node_nbytes.end()) -
+                          numa_node_nbytes.begin();
+      if (numa_node_nbytes[busiest] && busiest != numa_node) {
+        ALWAYS_ASSERT(!numa_run_on_node(busiest));
+        numa_node = busiest;
+        ++evt_logger_numa_moves;
+      }
+      fill(numa_node_nbytes.begin(), numa_node_nbytes.end(), 0);
+      numa_moved_us = timer::cur_usec();
+    }
+
     const bool dosense = sense;
 
     if (!g_fake_writes) {
@@ -359,6 +419,20 @@ txn_logger::writer(
         }
       }
 
+      // a buffer only holds txns of a single epoch, so the log up to here
+      // holds no txn past max_epoch_written
+      log_progress &lp = g_log_progress[id];
+      ::lock_guard<spinlock> l(lp.lock_);
+      lp.offset_ += ret;
+      lp.max_epoch_ = max_epoch_written;
+      if (lp.tracking_) {
+        if (!lp.prefixes_.empty() &&
+            lp.prefixes_.back().second == max_epoch_written)
+          lp.prefixes_.back().first = lp.offset_;
+        else
+          lp.prefixes_.emplace_back(lp.offset_, max_epoch_written);
+      }
+
 #ifdef ENABLE_EVENT_COUNTERS
       {
         g_evt_avg_logger_bytes_per_writev.offer(nbyteswritten);
@@ -469,6 +543,951 @@ txn_logger::wait_until_current_point_persisted()
   while (system_sync_epoch_->load(memory_order_acquire) < e)
     nop_pause();
 }
+/*}}}*/
+
+                      /** log recovery **/
+/*{{{*/
+spinlock txn_logger::g_tables_lock;
+vector<concurrent_btree *> txn_logger::g_tables;
+
+void
+txn_logger::RegisterTable(concurrent_btree *btr)
+{
+  ::lock_guard<spinlock> l(g_tables_lock);
+  g_tables.push_back(btr);
+  btr->set_log_id(g_tables.size());
+}
+
+namespace {
+  struct recovery_record {
+    concurrent_btree *btr_;
+    const uint8_t *key_;
+    uint32_t klen_;
+    const uint8_t *value_;
+    uint32_t vlen_; // 0 for a delete
+  };
+
+  class restamp_callback : public concurrent_btree::search_range_callback {
+  public:
+    restamp_callback(uint64_t tid, vector<string> &deleted)
+      : tid_(tid), deleted_(&deleted) {}
+
+    virtual bool
+    invoke(const concurrent_btree::string_type &k,
+           concurrent_btree::value_type v)
+    {
+      dbtuple * const tuple = (dbtuple *) v;
+      if (tuple->is_deleting())
+        deleted_->emplace_back((const char *) k.data(), k.length());
+      else
+        tuple->version = tid_;
+      return true;
+    }
+
+  private:
+    uint64_t tid_;
+    vector<string> *deleted_;
+  };
+}
+
+// parses the log entry at [p, end) into recs (see
+// transaction_proto2::write_current_txn_into_buffer()). returns the end of
+// the entry, or nullptr if the entry runs past end
+static const uint8_t *
+read_log_entry(const uint8_t *p, const uint8_t *end,
+               const vector<concurrent_btree *> &tables,
+               uint64_t &tid, vector<recovery_record> &recs)
+{
+  serializer<uint32_t, true> vs_uint32_t;
+  serializer<uint64_t, false> s_uint64_t;
+  recs.clear();
+  uint32_t nwrites;
+  if (!(p = s_uint64_t.failsafe_read(p, end - p, &tid)) ||
+      !(p = vs_uint32_t.failsafe_read(p, end - p, &nwrites)))
+    return nullptr;
+  for (uint32_t i = 0; i < nwrites; i++) {
+    uint32_t log_id, k_nbytes, v_nbytes;
+    if (!(p = vs_uint32_t.failsafe_read(p, end - p, &log_id)) ||
+        !(p = vs_uint32_t.failsafe_read(p, end - p, &k_nbytes)) ||
+        size_t(end - p) < k_nbytes)
+      return nullptr;
+    const uint8_t * const k = p;
+    p += k_nbytes;
+    if (!(p = vs_uint32_t.failsafe_read(p, end - p, &v_nbytes)) ||
+        size_t(end - p) < v_nbytes)
+      return nullptr;
+    if (unlikely(!log_id || log_id > tables.size())) {
+      cerr << "log record names table " << log_id << ", but only "
+           << tables.size() << " tables are open" << endl;
+      ALWAYS_ASSERT(false);
+    }
+    recs.push_back({tables[log_id - 1], k, k_nbytes, p, v_nbytes});
+    p += v_nbytes;
+  }
+  return p;
+}
+
+// installs rec @ tid, unless the tree already holds a version at least as
+// new. the same steps as transaction::try_insert_new_tuple() and
+// dbtuple::write_record_at(), except that older versions are never kept.
+// returns true if rec was installed
+static bool
+install_record(const recovery_record &rec, uint64_t tid)
+{
+  const varkey k(rec.key_, rec.klen_);
+  for (;;) {
+    concurrent_btree::value_type v = 0;
+    if (!rec.btr_->search(k, v)) {
+      dbtuple * const tuple = dbtuple::alloc_first(rec.vlen_, true);
+      if (rec.vlen_)
+        NDB_MEMCPY(tuple->get_value_start(), rec.value_, rec.vlen_);
+      tuple->version = tid;
+      if (likely(rec.btr_->insert_if_absent(
+              k, (concurrent_btree::value_type) tuple))) {
+        tuple->unlock();
+        return true;
+      }
+      // another log inserted this key first
+      tuple->clear_latest();
+      tuple->unlock();
+      dbtuple::release_no_rcu(tuple);
+      continue;
+    }
+
+    dbtuple * const tuple = (dbtuple *) v;
+    tuple->lock(true);
+    if (unlikely(!tuple->is_latest())) {
+      // another log replaced this tuple after our search
+      tuple->unlock();
+      continue;
+    }
+    if (tuple->version >= tid) {
+      tuple->unlock();
+      return false;
+    }
+    if (rec.vlen_ <= tuple->alloc_size) {
+      tuple->mark_modifying();
+      if (rec.vlen_)
+        NDB_MEMCPY(tuple->get_value_start(), rec.value_, rec.vlen_);
+      tuple->version = tid;
+      tuple->size = rec.vlen_;
+      if (!rec.vlen_ && !tuple->is_deleting())
+        tuple->mark_deleting();
+      else if (rec.vlen_ && tuple->is_deleting())
+        tuple->clear_deleting();
+      tuple->unlock();
+      return true;
+    }
+
+    dbtuple * const rep = dbtuple::alloc_first(rec.vlen_, true);
+    NDB_MEMCPY(rep->get_value_start(), rec.value_, rec.vlen_);
+    rep->version = tid;
+    rec.btr_->insert(k, (concurrent_btree::value_type) rep);
+    tuple->clear_latest();
+    dbtuple::release(tuple);
+    tuple->unlock();
+    rep->unlock();
+    return true;
+  }
+}
+
+// replays logfile from offset on, which must be the start of a buffer.
+// txns with TID <= min_tid are skipped
+static void
+replay_log(const string &logfile, uint64_t offset, uint64_t min_tid,
+           bool use_compression, const vector<concurrent_btree *> &tables,
+           txn_logger::recovery_stats *stats)
+{
+  typedef txn_logger::logbuf_header logbuf_header;
+  const int fd = open(logfile.c_str(), O_RDONLY);
+  if (fd == -1) {
+    perror("open");
+    ALWAYS_ASSERT(false);
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror("fstat");
+    ALWAYS_ASSERT(false);
+  }
+  const size_t nbytes = st.st_size;
+  void *m = nullptr;
+  if (nbytes) {
+    m = mmap(nullptr, nbytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+      perror("mmap");
+      ALWAYS_ASSERT(false);
+    }
+    madvise(m, nbytes, MADV_SEQUENTIAL);
+  }
+  if (offset > nbytes) {
+    cerr << "log " << logfile << " has " << nbytes
+         << " bytes, but replay starts at " << offset << endl;
+    ALWAYS_ASSERT(false);
+  }
+  stats->nbytes_ = nbytes - offset;
+
+  // each buffer is a logbuf_header followed by its entries or, when
+  // compressed, by [length (4 bytes)] [lz4 block] pairs, each block holding
+  // the entries of one horizon buffer. a buffer cut short by a crash ends
+  // replay of this log; its complete entries are still installed
+  serializer<uint32_t, false> s_uint32_t;
+  vector<uint8_t> horizon(
+      use_compression ? txn_logger::g_horizon_buffer_size : 0);
+  vector<recovery_record> recs;
+  const uint8_t *p = (const uint8_t *) m + offset;
+  const uint8_t * const end = (const uint8_t *) m + nbytes;
+  while (p != end) {
+    logbuf_header hdr;
+    if (size_t(end - p) < sizeof(hdr))
+      break;
+    NDB_MEMCPY(&hdr, p, sizeof(hdr));
+    if (!hdr.nentries_)
+      break;
+    p += sizeof(hdr);
+
+    scoped_rcu_region guard;
+    uint64_t n = 0, entry_tid;
+    if (use_compression) {
+      while (n < hdr.nentries_) {
+        uint32_t clen;
+        const uint8_t * const block =
+          s_uint32_t.failsafe_read(p, end - p, &clen);
+        if (!block || size_t(end - block) < clen)
+          break;
+        const int dlen = LZ4_decompress_safe(
+            (const char *) block, (char *) &horizon[0], clen, horizon.size());
+        if (dlen < 0)
+          break;
+        const uint8_t *q = &horizon[0];
+        const uint8_t * const qend = q + dlen;
+        while (q != qend) {
+          const uint8_t * const next =
+            read_log_entry(q, qend, tables, entry_tid, recs);
+          if (!next)
+            break;
+          if (entry_tid > min_tid) {
+            for (auto &rec : recs)
+              stats->ninstalled_ += install_record(rec, entry_tid);
+            stats->nrecords_ += recs.size();
+          }
+          q = next;
+          n++;
+        }
+        if (q != qend)
+          break;
+        p = block + clen;
+      }
+    } else {
+      while (n < hdr.nentries_) {
+        const uint8_t * const next =
+          read_log_entry(p, end, tables, entry_tid, recs);
+        if (!next)
+          break;
+        if (entry_tid > min_tid) {
+          for (auto &rec : recs)
+            stats->ninstalled_ += install_record(rec, entry_tid);
+          stats->nrecords_ += recs.size();
+        }
+        p = next;
+        n++;
+      }
+    }
+    stats->ntxns_ += n;
+    if (n != hdr.nentries_)
+      break;
+    stats->nbuffers_++;
+  }
+  if (p != end)
+    stats->ntorn_++;
+  if (m)
+    munmap(m, nbytes);
+  close(fd);
+}
+
+txn_logger::recovery_stats
+txn_logger::Recover(const string &checkpoint_dir,
+                    const vector<string> &logfiles,
+                    bool use_compression)
+{
+  INVARIANT(!checkpoint_dir.empty() || !logfiles.empty());
+  timer t;
+
+  // recovered tuples are restamped into the current epoch, as if a loader
+  // had just inserted them. the log's TIDs come from an earlier run, whose
+  // epochs have nothing to do with this run's ticker
+  const uint64_t tid = transaction_proto2_static::MakeTid(
+      0, 0, ticker::s_instance.global_current_tick());
+
+  const size_t nthreads = max(logfiles.size(), size_t(1));
+  vector<recovery_stats> stats(nthreads);
+
+  // the checkpoint is loaded by every thread before the logs are replayed
+  // over it
+  checkpoint_manifest manifest;
+  vector<uint64_t> offsets(logfiles.size(), 0);
+  if (!checkpoint_dir.empty()) {
+    ALWAYS_ASSERT(read_manifest(checkpoint_dir, manifest));
+    {
+      ::lock_guard<spinlock> l(g_tables_lock);
+      if (manifest.ntables_ != g_tables.size()) {
+        cerr << "checkpoint has " << manifest.ntables_ << " tables, but "
+             << g_tables.size() << " tables are open" << endl;
+        ALWAYS_ASSERT(false);
+      }
+    }
+    if (!logfiles.empty() &&
+        manifest.log_offsets_.size() != logfiles.size()) {
+      cerr << "checkpoint was taken with " << manifest.log_offsets_.size()
+           << " logs, but " << logfiles.size() << " were given" << endl;
+      ALWAYS_ASSERT(false);
+    }
+    if (!logfiles.empty())
+      offsets = manifest.log_offsets_;
+    vector<thread> loaders;
+    for (size_t i = 0; i < nthreads; i++)
+      loaders.emplace_back(
+          &txn_logger::checkpoint_loader, i, nthreads, cref(checkpoint_dir),
+          cref(manifest), &stats[i]);
+    for (auto &th : loaders)
+      th.join();
+  }
+
+  spin_barrier barrier(nthreads);
+  vector<thread> recoverers;
+  for (size_t i = 0; i < nthreads; i++)
+    recoverers.emplace_back(
+        &txn_logger::recoverer, i, nthreads, cref(logfiles), cref(offsets),
+        manifest.tid_, use_compression, tid, &barrier, &stats[i]);
+  for (auto &th : recoverers)
+    th.join();
+
+  recovery_stats ret;
+  for (auto &s : stats) {
+    ret.nbytes_ += s.nbytes_;
+    ret.nbuffers_ += s.nbuffers_;
+    ret.ntxns_ += s.ntxns_;
+    ret.nrecords_ += s.nrecords_;
+    ret.ninstalled_ += s.ninstalled_;
+    ret.nremoved_ += s.nremoved_;
+    ret.ntorn_ += s.ntorn_;
+    ret.nckpt_records_ += s.nckpt_records_;
+    ret.nckpt_bytes_ += s.nckpt_bytes_;
+  }
+  ret.elapsed_us_ = t.lap();
+  return ret;
+}
+
+void
+txn_logger::recoverer(
+    unsigned id, size_t nthreads, const vector<string> &logfiles,
+    const vector<uint64_t> &offsets, uint64_t min_tid,
+    bool use_compression, uint64_t tid,
+    spin_barrier *barrier, recovery_stats *stats)
+{
+  vector<concurrent_btree *> tables;
+  {
+    ::lock_guard<spinlock> l(g_tables_lock);
+    tables = g_tables;
+  }
+
+  if (id < logfiles.size())
+    replay_log(logfiles[id], offsets[id], min_tid, use_compression,
+               tables, stats);
+
+  barrier->count_down();
+  barrier->wait_for();
+
+  for (size_t i = id; i < tables.size(); i += nthreads) {
+    concurrent_btree * const btr = tables[i];
+    vector<string> deleted;
+    {
+      scoped_rcu_region guard;
+      restamp_callback c(tid, deleted);
+      const string lower;
+      btr->search_range_call(varkey(lower), nullptr, c);
+    }
+    // deletes only had to outlive replay, to hide older records of the same
+    // key in other logs
+    for (auto &k : deleted) {
+      scoped_rcu_region guard;
+      concurrent_btree::value_type v = 0;
+      if (!btr->remove(varkey(k), &v))
+        continue;
+      dbtuple * const tuple = (dbtuple *) v;
+      tuple->lock(true);
+      tuple->clear_latest();
+      dbtuple::release(tuple);
+      tuple->unlock();
+    }
+    stats->nremoved_ += deleted.size();
+  }
+}
+/*}}}*/
+
+                      /** checkpointing **/
+/*{{{*/
+static event_counter evt_checkpoint_records("checkpoint_records");
+static event_avg_counter evt_avg_checkpoint_throttle_us(
+    "avg_checkpoint_throttle_us");
+
+namespace {
+  // the round of checkpointing in progress. the checkpointer starts a round
+  // by bumping generation_, and the scanners take tables from next_table_
+  // until none are left
+  struct checkpoint_round {
+    std::mutex lock_;
+    std::condition_variable cv_;
+    uint64_t generation_;
+    size_t nrunning_; // scanners still in the round
+    atomic<bool> stop_;
+
+    // fixed for the life of the checkpointer
+    vector<concurrent_btree *> tables_;
+    string dir_;
+    uint64_t max_bytes_per_sec_; // per scanner, 0 for no limit
+
+    // set by the checkpointer before each round
+    uint64_t seq_;
+    uint64_t tid_;
+    atomic<size_t> next_table_;
+
+    // summed over every round, under lock_
+    uint64_t nrecords_;
+    uint64_t nbytes_;
+    uint64_t ncompressed_bytes_;
+
+    checkpoint_round()
+      : generation_(0), nrunning_(0), stop_(false), max_bytes_per_sec_(0),
+        seq_(0), tid_(0), next_table_(0),
+        nrecords_(0), nbytes_(0), ncompressed_bytes_(0) {}
+  };
+
+  checkpoint_round *g_round = nullptr;
+  thread g_checkpointer_thread;
+  vector<thread> g_scanner_threads;
+  txn_logger::checkpoint_stats g_checkpoint_stats;
+
+  struct checkpoint_value_reader {
+    string *value_;
+
+    template <typename StringAllocator>
+    inline bool
+    operator()(const uint8_t *data, size_t sz, StringAllocator &)
+    {
+      // a read can be retried, so overwrite what an earlier attempt read
+      value_->assign((const char *) data, sz);
+      return true;
+    }
+  };
+
+  struct no_string_allocator {};
+
+  // appends the records of the snapshot at tid_ to out_, as [key length]
+  // [key] [value length] [value], until out_ holds a block's worth of
+  // records. keys absent from the snapshot are skipped
+  class checkpoint_scan_callback : public concurrent_btree::search_range_callback {
+  public:
+    checkpoint_scan_callback(uint64_t tid, size_t max_nbytes, string &out)
+      : tid_(tid), max_nbytes_(max_nbytes), out_(&out),
+        nkeys_(0), nrecords_(0), stopped_(false) {}
+
+    virtual bool
+    invoke(const concurrent_btree::string_type &k,
+           concurrent_btree::value_type v)
+    {
+      const dbtuple * const tuple = (const dbtuple *) v;
+      checkpoint_value_reader reader = {&value_};
+      no_string_allocator sa;
+      transaction_base::tid_t start_t = 0;
+      if (tuple->stable_read(tid_, start_t, reader, sa, true) ==
+          dbtuple::READ_RECORD) {
+        append(k.data(), k.length());
+        append(value_.data(), value_.size());
+        nrecords_++;
+      }
+      last_key_.assign((const char *) k.data(), k.length());
+      // keep an RCU region short, so that neither the epochs nor RCU
+      // reclamation wait on the scan
+      if (++nkeys_ >= MaxKeysPerRegion || out_->size() >= max_nbytes_) {
+        stopped_ = true;
+        return false;
+      }
+      return true;
+    }
+
+    // the scan stopped before the end of the range; it resumes after
+    // last_key()
+    inline bool stopped() const { return stopped_; }
+    inline const string &last_key() const { return last_key_; }
+    inline size_t nrecords() const { return nrecords_; }
+
+  private:
+    static const size_t MaxKeysPerRegion = 256;
+
+    inline void
+    append(const void *p, size_t n)
+    {
+      serializer<uint32_t, true> vs_uint32_t;
+      uint8_t buf[8];
+      const uint8_t * const e = vs_uint32_t.write(&buf[0], uint32_t(n));
+      out_->append((const char *) &buf[0], e - &buf[0]);
+      out_->append((const char *) p, n);
+    }
+
+    const uint64_t tid_;
+    const size_t max_nbytes_;
+    string *out_;
+    string value_;
+    string last_key_;
+    size_t nkeys_;
+    size_t nrecords_;
+    bool stopped_;
+  };
+}
+
+static string
+checkpoint_table_file(const string &dir, uint64_t seq, size_t log_id)
+{
+  return dir + "/ckpt." + to_string(seq) + "." + to_string(log_id);
+}
+
+static void
+write_fully(int fd, const void *p, size_t n)
+{
+  const char *c = (const char *) p;
+  while (n) {
+    const ssize_t ret = write(fd, c, n);
+    if (unlikely(ret == -1)) {
+      if (errno == EINTR)
+        continue;
+      perror("write");
+      ALWAYS_ASSERT(false);
+    }
+    c += ret;
+    n -= ret;
+  }
+}
+
+static void
+fsync_or_die(int fd)
+{
+  if (unlikely(fsync(fd) == -1)) {
+    perror("fsync");
+    ALWAYS_ASSERT(false);
+  }
+}
+
+static void
+sleep_us(uint64_t us)
+{
+  struct timespec t;
+  t.tv_sec  = us / 1000000;
+  t.tv_nsec = (us % 1000000) * 1000;
+  nanosleep(&t, nullptr);
+}
+
+// a checkpoint table file is a sequence of blocks, each [raw length (4
+// bytes)] [compressed length (4 bytes)] [lz4 block]
+static size_t
+write_checkpoint_block(int fd, const string &raw, vector<char> &scratch)
+{
+  const size_t bound = LZ4_compressBound(raw.size());
+  if (scratch.size() < 2 * sizeof(uint32_t) + bound)
+    scratch.resize(2 * sizeof(uint32_t) + bound);
+  const int clen = LZ4_compress(
+      raw.data(), &scratch[2 * sizeof(uint32_t)], raw.size());
+  ALWAYS_ASSERT(clen > 0);
+  serializer<uint32_t, false> s_uint32_t;
+  uint8_t * const hdr = (uint8_t *) &scratch[0];
+  s_uint32_t.write(hdr, raw.size());
+  s_uint32_t.write(hdr + sizeof(uint32_t), clen);
+  const size_t n = 2 * sizeof(uint32_t) + clen;
+  write_fully(fd, &scratch[0], n);
+  return n;
+}
+
+static void
+corrupt_checkpoint(const string &fname)
+{
+  cerr << "checkpoint file " << fname << " is corrupt" << endl;
+  ALWAYS_ASSERT(false);
+}
+
+bool
+txn_logger::read_manifest(const string &dir, checkpoint_manifest &m)
+{
+  ifstream in(dir + "/CHECKPOINT");
+  if (!in)
+    return false;
+  string field;
+  size_t nlogs = 0;
+  in >> field >> m.seq_;
+  ALWAYS_ASSERT(in && field == "seq");
+  in >> field >> m.tid_;
+  ALWAYS_ASSERT(in && field == "tid");
+  in >> field >> m.ntables_;
+  ALWAYS_ASSERT(in && field == "tables");
+  in >> field >> nlogs;
+  ALWAYS_ASSERT(in && field == "logs");
+  m.log_offsets_.resize(nlogs);
+  for (size_t i = 0; i < nlogs; i++) {
+    in >> field >> m.log_offsets_[i];
+    ALWAYS_ASSERT(in && field == "offset");
+  }
+  return true;
+}
+
+void
+txn_logger::write_manifest(const string &dir, const checkpoint_manifest &m)
+{
+  ostringstream out;
+  out << "seq " << m.seq_ << "\n"
+      << "tid " << m.tid_ << "\n"
+      << "tables " << m.ntables_ << "\n"
+      << "logs " << m.log_offsets_.size() << "\n";
+  for (auto off : m.log_offsets_)
+    out << "offset " << off << "\n";
+  const string s = out.str();
+
+  // the new manifest replaces the old one only once it is durable
+  const string tmp = dir + "/CHECKPOINT.tmp";
+  const int fd = open(tmp.c_str(), O_CREAT|O_WRONLY|O_TRUNC, 0664);
+  if (fd == -1) {
+    perror("open");
+    ALWAYS_ASSERT(false);
+  }
+  write_fully(fd, s.data(), s.size());
+  fsync_or_die(fd);
+  close(fd);
+  if (rename(tmp.c_str(), (dir + "/CHECKPOINT").c_str()) == -1) {
+    perror("rename");
+    ALWAYS_ASSERT(false);
+  }
+  const int dfd = open(dir.c_str(), O_RDONLY);
+  if (dfd == -1) {
+    perror("open");
+    ALWAYS_ASSERT(false);
+  }
+  fsync_or_die(dfd);
+  close(dfd);
+}
+
+uint64_t
+txn_logger::log_prefix_through(unsigned id, uint64_t e)
+{
+  log_progress &lp = g_log_progress[id];
+  ::lock_guard<spinlock> l(lp.lock_);
+  uint64_t off = lp.dropped_;
+  while (!lp.prefixes_.empty() && lp.prefixes_.front().second <= e) {
+    off = lp.prefixes_.front().first;
+    lp.prefixes_.pop_front();
+  }
+  return off;
+}
+
+void
+txn_logger::StartCheckpointer(const string &dir, uint64_t interval_ms,
+                              size_t nthreads, uint64_t max_bytes_per_sec)
+{
+  INVARIANT(!g_round);
+  INVARIANT(nthreads > 0);
+#ifdef PROTO2_CAN_DISABLE_SNAPSHOTS
+  // the snapshot's versions are overwritten in place otherwise
+  ALWAYS_ASSERT(transaction_proto2_static::IsSnapshotsEnabled());
+#endif
+  g_round = new checkpoint_round;
+  g_round->dir_ = dir;
+  g_round->max_bytes_per_sec_ = max_bytes_per_sec / nthreads;
+  {
+    ::lock_guard<spinlock> l(g_tables_lock);
+    g_round->tables_ = g_tables;
+  }
+
+  // a checkpoint left by an earlier run goes with that run's logs, which
+  // Init() has truncated
+  checkpoint_manifest old;
+  if (read_manifest(dir, old)) {
+    cerr << "checkpointer: removing the checkpoint of an earlier run in "
+         << dir << endl;
+    unlink((dir + "/CHECKPOINT").c_str());
+    for (size_t i = 1; i <= old.ntables_; i++)
+      unlink(checkpoint_table_file(dir, old.seq_, i).c_str());
+    g_round->seq_ = old.seq_;
+  }
+  g_checkpoint_stats = checkpoint_stats();
+
+  // the writers record log prefixes only while there is a checkpointer to
+  // consume them; until one is recorded, log_prefix_through() keeps the
+  // whole log after dropped_
+  for (size_t i = 0; i < g_nlogs; i++) {
+    log_progress &lp = g_log_progress[i];
+    ::lock_guard<spinlock> l(lp.lock_);
+    lp.tracking_ = true;
+  }
+
+  for (size_t i = 0; i < nthreads; i++)
+    g_scanner_threads.emplace_back(&txn_logger::checkpoint_scanner, i);
+  g_checkpointer_thread = thread(&txn_logger::checkpointer, dir, interval_ms);
+}
+
+txn_logger::checkpoint_stats
+txn_logger::StopCheckpointer()
+{
+  INVARIANT(g_round);
+  {
+    std::lock_guard<std::mutex> l(g_round->lock_);
+    g_round->stop_.store(true);
+  }
+  g_round->cv_.notify_all();
+  g_checkpointer_thread.join();
+  for (auto &th : g_scanner_threads)
+    th.join();
+  g_scanner_threads.clear();
+  for (size_t i = 0; i < g_nlogs; i++) {
+    log_progress &lp = g_log_progress[i];
+    ::lock_guard<spinlock> l(lp.lock_);
+    lp.tracking_ = false;
+    lp.prefixes_.clear();
+  }
+  checkpoint_stats ret = g_checkpoint_stats;
+  ret.nrecords_ = g_round->nrecords_;
+  ret.nbytes_ = g_round->nbytes_;
+  ret.ncompressed_bytes_ = g_round->ncompressed_bytes_;
+  delete g_round;
+  g_round = nullptr;
+  return ret;
+}
+
+void
+txn_logger::checkpointer(string dir, uint64_t interval_ms)
+{
+  checkpoint_round &r = *g_round;
+  const size_t nscanners = g_scanner_threads.size();
+  uint64_t prev_seq = r.seq_;
+  bool can_drop = true;
+  for (;;) {
+    const uint64_t start_us = timer::cur_usec();
+    while (!r.stop_.load() &&
+           timer::cur_usec() - start_us < interval_ms * 1000)
+      sleep_us(10000);
+    if (r.stop_.load())
+      return;
+
+    timer t;
+    const uint64_t tid = transaction_proto2_static::HoldSnapshot();
+    {
+      std::unique_lock<std::mutex> l(r.lock_);
+      r.seq_ = prev_seq + 1;
+      r.tid_ = tid;
+      r.next_table_.store(0);
+      r.nrunning_ = nscanners;
+      r.generation_++;
+      r.cv_.notify_all();
+      r.cv_.wait(l, [&r] { return !r.nrunning_; });
+    }
+    transaction_proto2_static::ReleaseSnapshot();
+
+    if (r.stop_.load()) {
+      for (size_t i = 1; i <= r.tables_.size(); i++)
+        unlink(checkpoint_table_file(dir, r.seq_, i).c_str());
+      return;
+    }
+
+    // every txn in a log prefix through the snapshot's epoch is in the
+    // checkpoint, so recovery can start after it
+    checkpoint_manifest m;
+    m.seq_ = r.seq_;
+    m.tid_ = tid;
+    m.ntables_ = r.tables_.size();
+    const uint64_t e = transaction_proto2_static::EpochId(tid);
+    for (size_t i = 0; i < g_nlogs; i++)
+      m.log_offsets_.push_back(log_prefix_through(i, e));
+    write_manifest(dir, m);
+
+    for (size_t i = 0; i < g_nlogs && can_drop; i++) {
+      log_progress &lp = g_log_progress[i];
+      const uint64_t off = m.log_offsets_[i];
+      if (off == lp.dropped_)
+        continue;
+      if (fallocate(lp.fd_, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+                    lp.dropped_, off - lp.dropped_) == -1) {
+        perror("checkpointer: fallocate");
+        cerr << "checkpointer: not dropping log prefixes" << endl;
+        can_drop = false;
+        break;
+      }
+      g_checkpoint_stats.ntruncated_bytes_ += off - lp.dropped_;
+      ::lock_guard<spinlock> l(lp.lock_);
+      lp.dropped_ = off;
+    }
+    if (prev_seq)
+      for (size_t i = 1; i <= r.tables_.size(); i++)
+        unlink(checkpoint_table_file(dir, prev_seq, i).c_str());
+    prev_seq = m.seq_;
+
+    const uint64_t us = t.lap();
+    g_checkpoint_stats.ncheckpoints_++;
+    g_checkpoint_stats.total_us_ += us;
+    g_checkpoint_stats.max_us_ = max(g_checkpoint_stats.max_us_, us);
+    g_checkpoint_stats.last_tid_ = tid;
+  }
+}
+
+void
+txn_logger::checkpoint_scanner(unsigned id)
+{
+  checkpoint_round &r = *g_round;
+  uint64_t generation = 0;
+  string raw;
+  vector<char> scratch;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> l(r.lock_);
+      r.cv_.wait(l, [&] {
+        return r.stop_.load() || r.generation_ != generation;
+      });
+      if (r.generation_ == generation)
+        return; // stopped between rounds
+      generation = r.generation_;
+    }
+
+    // the throttle's budget is per round: a scanner sleeps whenever it gets
+    // ahead of max_bytes_per_sec_
+    const uint64_t start_us = timer::cur_usec();
+    uint64_t nread = 0;
+    uint64_t nrecords = 0, nbytes = 0, ncompressed_bytes = 0;
+    size_t i;
+    while (!r.stop_.load() &&
+           (i = r.next_table_.fetch_add(1)) < r.tables_.size()) {
+      concurrent_btree * const btr = r.tables_[i];
+      const string fname = checkpoint_table_file(r.dir_, r.seq_, i + 1);
+      const int fd = open(fname.c_str(), O_CREAT|O_WRONLY|O_TRUNC, 0664);
+      if (fd == -1) {
+        perror("open");
+        ALWAYS_ASSERT(false);
+      }
+      string lower;
+      bool more = true;
+      while (more && !r.stop_.load()) {
+        raw.clear();
+        {
+          scoped_rcu_region guard;
+          checkpoint_scan_callback c(r.tid_, g_horizon_buffer_size, raw);
+          btr->search_range_call(varkey(lower), nullptr, c);
+          more = c.stopped();
+          if (more) {
+            // the least key greater than the last one scanned
+            lower = c.last_key();
+            lower.push_back('\0');
+          }
+          nrecords += c.nrecords();
+          evt_checkpoint_records.inc(c.nrecords());
+        }
+        if (!raw.empty()) {
+          ncompressed_bytes += write_checkpoint_block(fd, raw, scratch);
+          nbytes += raw.size();
+          nread += raw.size();
+        }
+        if (r.max_bytes_per_sec_) {
+          const uint64_t due_us = nread * 1000000 / r.max_bytes_per_sec_;
+          const uint64_t elapsed_us = timer::cur_usec() - start_us;
+          if (due_us > elapsed_us) {
+            evt_avg_checkpoint_throttle_us.offer(due_us - elapsed_us);
+            sleep_us(due_us - elapsed_us);
+          }
+        }
+      }
+      fsync_or_die(fd);
+      close(fd);
+    }
+
+    std::lock_guard<std::mutex> l(r.lock_);
+    r.nrecords_ += nrecords;
+    r.nbytes_ += nbytes;
+    r.ncompressed_bytes_ += ncompressed_bytes;
+    if (!--r.nrunning_)
+      r.cv_.notify_all();
+  }
+}
+
+void
+txn_logger::checkpoint_loader(
+    unsigned id, size_t nthreads, const string &dir,
+    const checkpoint_manifest &manifest, recovery_stats *stats)
+{
+  vector<concurrent_btree *> tables;
+  {
+    ::lock_guard<spinlock> l(g_tables_lock);
+    tables = g_tables;
+  }
+  serializer<uint32_t, false> s_uint32_t;
+  serializer<uint32_t, true> vs_uint32_t;
+  vector<uint8_t> raw;
+  for (size_t i = id; i < tables.size(); i += nthreads) {
+    const string fname = checkpoint_table_file(dir, manifest.seq_, i + 1);
+    const int fd = open(fname.c_str(), O_RDONLY);
+    if (fd == -1) {
+      perror(fname.c_str());
+      ALWAYS_ASSERT(false);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+      perror("fstat");
+      ALWAYS_ASSERT(false);
+    }
+    const size_t nbytes = st.st_size;
+    stats->nckpt_bytes_ += nbytes;
+    if (!nbytes) {
+      close(fd);
+      continue;
+    }
+    void * const m = mmap(nullptr, nbytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+      perror("mmap");
+      ALWAYS_ASSERT(false);
+    }
+    madvise(m, nbytes, MADV_SEQUENTIAL);
+
+    // the checkpoint was made durable before its manifest, so unlike a log
+    // it cannot end in a partial block
+    const uint8_t *p = (const uint8_t *) m;
+    const uint8_t * const end = p + nbytes;
+    while (p != end) {
+      uint32_t rawlen, clen;
+      if (!(p = s_uint32_t.failsafe_read(p, end - p, &rawlen)) ||
+          !(p = s_uint32_t.failsafe_read(p, end - p, &clen)) ||
+          size_t(end - p) < clen)
+        corrupt_checkpoint(fname);
+      raw.resize(rawlen);
+      if (LZ4_decompress_safe(
+            (const char *) p, (char *) &raw[0], clen, rawlen) != int(rawlen))
+        corrupt_checkpoint(fname);
+      p += clen;
+
+      scoped_rcu_region guard;
+      const uint8_t *q = &raw[0];
+      const uint8_t * const qend = q + rawlen;
+      while (q != qend) {
+        recovery_record rec;
+        rec.btr_ = tables[i];
+        if (!(q = vs_uint32_t.failsafe_read(q, qend - q, &rec.klen_)) ||
+            size_t(qend - q) < rec.klen_)
+          corrupt_checkpoint(fname);
+        rec.key_ = q;
+        q += rec.klen_;
+        if (!(q = vs_uint32_t.failsafe_read(q, qend - q, &rec.vlen_)) ||
+            size_t(qend - q) < rec.vlen_)
+          corrupt_checkpoint(fname);
+        rec.value_ = q;
+        q += rec.vlen_;
+        install_record(rec, manifest.tid_);
+        stats->nckpt_records_++;
+      }
+    }
+    munmap(m, nbytes);
+    close(fd);
+  }
+}
 /*}}}*/
 
                 /** garbage collection subsystem **/
@@ -487,7 +1506,7 @@ transaction_proto2_static::InitGC()
 static void
 sleep_ro_epoch()
 {
-  const uint64_t sleep_ns = transaction_proto2_static::ReadOnlyEpochUsec * 1000;
+  const uint64_t sleep_ns = transaction_proto2_static::ReadOnlyEpochUsec() * 1000;
   struct timespec t;
   t.tv_sec  = sleep_ns / ONE_SECOND_NS;
   t.tv_nsec = sleep_ns % ONE_SECOND_NS;
@@ -514,7 +1533,8 @@ transaction_proto2_static::PurgeThreadOutstandingGCTasks()
       sleep_ro_epoch();
       continue;
     }
-    const uint64_t ro_tick_geq = ro_tick_ex - 1;
+    const uint64_t ro_tick_geq =
+      min(ro_tick_ex - 1, g_flags->g_gc_max_ro_tick.load());
     if (ro_tick_geq < e) {
       sleep_ro_epoch();
       continue;
@@ -525,6 +1545,35 @@ transaction_proto2_static::PurgeThreadOutstandingGCTasks()
   INVARIANT(ctx.queue_.empty());
 }
 
+uint64_t
+transaction_proto2_static::HoldSnapshot()
+{
+  INVARIANT(g_flags->g_gc_max_ro_tick.load() ==
+            numeric_limits<uint64_t>::max());
+  for (;;) {
+    const uint64_t last_tick_ex = ticker::s_instance.global_last_tick_exclusive();
+    const uint64_t ro_tick = to_read_only_tick(last_tick_ex);
+    if (unlikely(!ro_tick)) {
+      sleep_ro_epoch();
+      continue;
+    }
+    // a snapshot at ro_tick needs the versions that commits in ro_tick or
+    // later replaced, which GC cleans once it moves past ro_tick - 1. GC
+    // reads the ticker before the cap, so if the read only tick has not
+    // moved by the time the cap is set, no GC can have moved past it
+    g_flags->g_gc_max_ro_tick.store(ro_tick - 1);
+    if (to_read_only_tick(ticker::s_instance.global_last_tick_exclusive()) ==
+        ro_tick)
+      return ComputeReadOnlyTid(last_tick_ex);
+  }
+}
+
+void
+transaction_proto2_static::ReleaseSnapshot()
+{
+  g_flags->g_gc_max_ro_tick.store(numeric_limits<uint64_t>::max());
+}
+
 //#ifdef CHECK_INVARIANTS
 //// make sure hidden is blocked by version e, when traversing from start
 //static bool
@@ -693,6 +1742,9 @@ transaction_proto2_static::clean_up_to_including(threadctx &ctx, uint64_t ro_tic
   INVARIANT(!rcu::s_instance.in_rcu_region());
 }
 
+atomic<uint64_t>
+  transaction_proto2_static::ReadOnlyEpochMultiplier(
+      transaction_proto2_static::DefaultReadOnlyEpochMultiplier);
 aligned_padded_elem<transaction_proto2_static::hackstruct>
   transaction_proto2_static::g_hack;
 aligned_padded_elem<transaction_proto2_static::flags>
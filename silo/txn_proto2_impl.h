@@ -4,7 +4,9 @@
 #include <iostream>
 #include <atomic>
 #include <vector>
+#include <deque>
 #include <set>
+#include <limits>
 
 #include <lz4.h>
 
@@ -37,7 +39,6 @@ public:
   static const size_t g_buffer_size = (1<<20); // in bytes
   static const size_t g_horizon_buffer_size = 2 * (1<<16); // in bytes
   static const size_t g_max_lag_epochs = 128; // cannot lag more than 128 epochs
-  static const bool   g_pin_loggers_to_numa_nodes = false;
 
   static inline bool
   IsPersistenceEnabled()
@@ -54,7 +55,11 @@ public:
   // init the logging subsystem.
   //
   // should only be called ONCE is not thread-safe.  if assignments_used is not
-  // null, then fills it with a copy of the assignment actually computed
+  // null, then fills it with a copy of the assignment actually computed.
+  //
+  // if pin_to_numa_nodes is set, each logger runs on the NUMA node whose
+  // cores filled most of the buffers it wrote lately, so it mostly reads
+  // them from local memory
   static void Init(
       size_t nworkers,
       const std::vector<std::string> &logfiles,
@@ -62,7 +67,8 @@ public:
       std::vector<std::vector<unsigned>> *assignments_used = nullptr,
       bool call_fsync = true,
       bool use_compression = false,
-      bool fake_writes = false);
+      bool fake_writes = false,
+      bool pin_to_numa_nodes = false);
 
   struct logbuf_header {
     uint64_t nentries_; // > 0 for all valid log buffers
@@ -198,6 +204,87 @@ public:
   static void
   wait_until_current_point_persisted();
 
+  // called for every txn_btree on construction. a log record names its tree
+  // by the tree's registration order (starting at 1), so recovery expects
+  // the tables to be opened in the same order as in the run that wrote the
+  // log- bench_runners do this when given the same benchmark options
+  static void
+  RegisterTable(concurrent_btree *btr);
+
+  struct recovery_stats {
+    uint64_t nbytes_;     // log bytes read
+    uint64_t nbuffers_;   // log buffers replayed
+    uint64_t ntxns_;      // txns replayed
+    uint64_t nrecords_;   // records replayed
+    uint64_t ninstalled_; // records newer than what the table held
+    uint64_t nremoved_;   // keys whose newest record is a delete
+    uint64_t ntorn_;      // logs ending in a partially written buffer
+    uint64_t nckpt_records_; // records loaded from the checkpoint
+    uint64_t nckpt_bytes_;   // checkpoint bytes read
+    uint64_t elapsed_us_;
+
+    recovery_stats()
+      : nbytes_(0), nbuffers_(0), ntxns_(0), nrecords_(0),
+        ninstalled_(0), nremoved_(0), ntorn_(0),
+        nckpt_records_(0), nckpt_bytes_(0), elapsed_us_(0) {}
+  };
+
+  // replays the logs written by a previous run into the registered tables,
+  // with one thread per log file. for each key, the record with the latest
+  // TID wins. recovered records are then restamped with a TID in the current
+  // epoch, so the tables look as if they had just been loaded.
+  //
+  // if checkpoint_dir is not empty, the tables are first loaded from the
+  // last checkpoint written there (see StartCheckpointer()), and each log is
+  // replayed from the offset the checkpoint names, skipping the txns the
+  // checkpoint already holds. logfiles may then be empty.
+  //
+  // must be called before any txn runs. the logs must not be the ones
+  // passed to Init(), since Init() truncates its logs. records are installed
+  // without being logged again
+  static recovery_stats
+  Recover(const std::string &checkpoint_dir,
+          const std::vector<std::string> &logfiles,
+          bool use_compression);
+
+  struct checkpoint_stats {
+    uint64_t ncheckpoints_;    // checkpoints completed
+    uint64_t nrecords_;        // records written, over all checkpoints
+    uint64_t nbytes_;          // record bytes before compression
+    uint64_t ncompressed_bytes_;
+    uint64_t ntruncated_bytes_; // log bytes dropped
+    uint64_t total_us_;        // time spent checkpointing
+    uint64_t max_us_;          // longest checkpoint
+    uint64_t last_tid_;        // TID of the last checkpoint
+
+    checkpoint_stats()
+      : ncheckpoints_(0), nrecords_(0), nbytes_(0), ncompressed_bytes_(0),
+        ntruncated_bytes_(0), total_us_(0), max_us_(0), last_tid_(0) {}
+  };
+
+  // starts checkpointing the registered tables into dir every interval_ms,
+  // while txns keep running. a checkpoint is the snapshot as of the start of
+  // the current read only epoch: GC keeps the versions it reads until it is
+  // done (see transaction_proto2_static::HoldSnapshot()), and it is scanned
+  // in short RCU regions, so it holds up neither writers nor the epochs.
+  //
+  // nthreads threads scan the tables, each writing every table it takes to
+  // its own lz4 compressed file. each thread reads at most
+  // max_bytes_per_sec / nthreads record bytes a second (0 for no limit),
+  // which bounds how much it takes from the workers. once a checkpoint is
+  // durable, the prefix of each log it covers is dropped, so from then on
+  // the logs can only be recovered together with the checkpoint.
+  //
+  // the tables must all be open, and must not be opened in a different
+  // order in the run that recovers
+  static void
+  StartCheckpointer(const std::string &dir, uint64_t interval_ms,
+                    size_t nthreads, uint64_t max_bytes_per_sec);
+
+  // stops the checkpointer, abandoning a checkpoint in progress
+  static checkpoint_stats
+  StopCheckpointer();
+
 private:
 
   // data structures
@@ -215,10 +302,15 @@ private:
     void *lz4ctx_;     // for compression
     pbuffer *horizon_; // for compression
 
+    // with g_pin_loggers_to_numa_nodes, the node of the core which
+    // allocated (and so first touched) the buffers. -1 if unknown
+    int numa_node_;
+
     circbuf<pbuffer, g_perthread_buffers> all_buffers_;     // logger pushes to core
     circbuf<pbuffer, g_perthread_buffers> persist_buffers_; // core pushes to logger
 
-    persist_ctx() : init_(false), lz4ctx_(nullptr), horizon_(nullptr) {}
+    persist_ctx()
+      : init_(false), lz4ctx_(nullptr), horizon_(nullptr), numa_node_(-1) {}
   };
 
   // context per one epoch
@@ -263,6 +355,62 @@ private:
   static void persister(
       std::vector<std::vector<unsigned>> assignments);
 
+  // what a checkpoint's CHECKPOINT file says
+  struct checkpoint_manifest {
+    uint64_t seq_;     // the checkpoint's tables are ckpt.<seq_>.<log id>
+    uint64_t tid_;     // holds every txn with TID <= tid_, and no other
+    size_t ntables_;
+    std::vector<uint64_t> log_offsets_; // where replay of each log starts
+
+    checkpoint_manifest() : seq_(0), tid_(0), ntables_(0) {}
+  };
+
+  // CHECKPOINT in dir. read_manifest() returns false if there is none
+  static bool read_manifest(const std::string &dir, checkpoint_manifest &m);
+  static void write_manifest(const std::string &dir,
+                             const checkpoint_manifest &m);
+
+  // loads the checkpointed tables id, id + nthreads, ...
+  static void checkpoint_loader(
+      unsigned id, size_t nthreads, const std::string &dir,
+      const checkpoint_manifest &manifest, recovery_stats *stats);
+
+  // replays logfiles[id] from offsets[id] on, skipping txns with TID <=
+  // min_tid, then (once every log is replayed) restamps the registered
+  // tables id, id + nthreads, ...
+  static void recoverer(
+      unsigned id, size_t nthreads, const std::vector<std::string> &logfiles,
+      const std::vector<uint64_t> &offsets, uint64_t min_tid,
+      bool use_compression, uint64_t tid,
+      spin_barrier *barrier, recovery_stats *stats);
+
+  // where logger i is in its log: v = g_log_progress[i].prefixes_[j] says
+  // that every txn in the log before offset v.first is in an epoch <=
+  // v.second. appended to by the writer only while a checkpointer runs
+  // (tracking_), consumed by the checkpointer
+  struct log_progress {
+    spinlock lock_;
+    int fd_;
+    uint64_t offset_;    // bytes written
+    uint64_t max_epoch_; // of all txns written
+    uint64_t dropped_;   // log prefix already dropped
+    bool tracking_;
+    std::deque<std::pair<uint64_t, uint64_t>> prefixes_;
+
+    log_progress()
+      : fd_(-1), offset_(0), max_epoch_(0), dropped_(0), tracking_(false) {}
+  };
+
+  // the end of the longest prefix of log id holding only txns in epochs <= e
+  static uint64_t
+  log_prefix_through(unsigned id, uint64_t e);
+
+  // drives a checkpoint every interval_ms
+  static void checkpointer(std::string dir, uint64_t interval_ms);
+
+  // scans the tables of the checkpoint in progress, one at a time
+  static void checkpoint_scanner(unsigned id);
+
   enum InitMode {
     INITMODE_NONE, // no initialization
     INITMODE_REG,  // just use malloc() to init buffers
@@ -293,6 +441,8 @@ private:
         ctx.all_buffers_.enq(new (mem) pbuffer(core_id, g_buffer_size));
         mem += sizeof(pbuffer) + g_buffer_size;
       }
+      if (g_pin_loggers_to_numa_nodes)
+        ctx.numa_node_ = CurrentNumaNode();
       ctx.init_ = true;
     }
     return ctx;
@@ -310,6 +460,12 @@ private:
   static bool g_fake_writes; // whether or not to fake doing writes (to measure
                              // pure overhead of disk)
 
+  static bool g_pin_loggers_to_numa_nodes; // whether or not loggers follow the
+                                           // NUMA nodes of their cores
+
+  // the NUMA node the calling thread runs on
+  static int CurrentNumaNode();
+
   static size_t g_nworkers; // assignments are computed based on g_nworkers
                             // but a logger responsible for core i is really
                             // responsible for cores i + k * g_nworkers, for k
@@ -332,6 +488,13 @@ private:
 
   static percore<persist_stats> g_persist_stats CACHE_ALIGNED;
 
+  // registered trees, indexed by log id - 1
+  static spinlock g_tables_lock;
+  static std::vector<concurrent_btree *> g_tables;
+
+  static size_t g_nlogs;
+  static log_progress g_log_progress[g_nmax_loggers];
+
   // counters
 
   static event_counter g_evt_log_buffer_epoch_boundary;
@@ -365,18 +528,26 @@ public:
   // subsystem's tick
 
 #ifdef CHECK_INVARIANTS
-  static const uint64_t ReadOnlyEpochMultiplier = 10; /* 10 * 1 ms */
+  static const uint64_t DefaultReadOnlyEpochMultiplier = 10; /* 10 * 1 ms */
 #else
-  static const uint64_t ReadOnlyEpochMultiplier = 25; /* 25 * 40 ms */
-  static_assert(ticker::tick_us * ReadOnlyEpochMultiplier == 1000000, "");
+  static const uint64_t DefaultReadOnlyEpochMultiplier = 25; /* 25 * 40 ms */
+  static_assert(ticker::default_tick_us * DefaultReadOnlyEpochMultiplier == 1000000, "");
 #endif
 
-  static_assert(ReadOnlyEpochMultiplier >= 1, "XX");
+  static_assert(DefaultReadOnlyEpochMultiplier >= 1, "XX");
 
-  static const uint64_t ReadOnlyEpochUsec =
-    ticker::tick_us * ReadOnlyEpochMultiplier;
+  // ticks per read only epoch. a snapshot txn reads the state as of the
+  // start of the current read only epoch, so it lags the latest commits by
+  // up to this many ticks. should only be changed before any txns run
+  static std::atomic<uint64_t> ReadOnlyEpochMultiplier;
 
-  static inline uint64_t constexpr
+  static inline uint64_t
+  ReadOnlyEpochUsec()
+  {
+    return ticker::tick_us * ReadOnlyEpochMultiplier;
+  }
+
+  static inline uint64_t
   to_read_only_tick(uint64_t epoch_tick)
   {
     return epoch_tick / ReadOnlyEpochMultiplier;
@@ -429,8 +600,9 @@ public:
   static uint64_t
   ComputeReadOnlyTid(uint64_t global_tick_ex)
   {
-    const uint64_t a = (global_tick_ex / ReadOnlyEpochMultiplier);
-    const uint64_t b = a * ReadOnlyEpochMultiplier;
+    const uint64_t m = ReadOnlyEpochMultiplier;
+    const uint64_t a = (global_tick_ex / m);
+    const uint64_t b = a * m;
 
     // want to read entries <= b-1, special casing for b=0
     if (!b)
@@ -481,6 +653,16 @@ public:
 
   static void PurgeThreadOutstandingGCTasks();
 
+  // keeps GC from reclaiming the versions that a snapshot read at the
+  // returned TID needs, until ReleaseSnapshot(). like a snapshot txn, the
+  // snapshot is the start of the current read only epoch, but it may be
+  // read for as long as it is held, across any number of RCU regions.
+  // versions pile up while it is held. at most one snapshot may be held at
+  // a time
+  static uint64_t HoldSnapshot();
+
+  static void ReleaseSnapshot();
+
 #ifdef PROTO2_CAN_DISABLE_GC
   static inline bool
   IsGCEnabled()
@@ -685,7 +867,11 @@ protected:
   struct flags {
     std::atomic<bool> g_gc_init;
     std::atomic<bool> g_disable_snapshots;
-    constexpr flags() : g_gc_init(false), g_disable_snapshots(false) {}
+    // GC cleans no later than this read only tick (see HoldSnapshot())
+    std::atomic<uint64_t> g_gc_max_ro_tick;
+    constexpr flags()
+      : g_gc_init(false), g_disable_snapshots(false),
+        g_gc_max_ro_tick(std::numeric_limits<uint64_t>::max()) {}
   };
   static util::aligned_padded_elem<flags> g_flags;
 
@@ -805,6 +991,8 @@ public:
     write_set_u32_vec value_sizes;
     for (unsigned idx = 0; idx < nwrites; idx++) {
       const transaction_base::write_record_t &rec = this->write_set[idx];
+      const uint32_t log_id = rec.get_btree()->get_log_id();
+      space_needed += vs_uint32_t.nbytes(&log_id);
       const uint32_t k_nbytes = rec.get_key().size();
       space_needed += vs_uint32_t.nbytes(&k_nbytes);
       space_needed += k_nbytes;
@@ -889,6 +1077,11 @@ public:
 
 private:
 
+  // a log entry is:
+  //   [tid (8 bytes)] [nwrites (varint)]
+  //   nwrites * ([log id (varint)] [klen (varint)] [key] [vlen (varint)] [value])
+  // where a vlen of 0 is a delete (see txn_logger::Recover())
+  //
   // assumes enough space in px to hold this txn
   inline uint64_t
   write_current_txn_into_buffer(
@@ -921,6 +1114,7 @@ private:
 
     for (unsigned idx = 0; idx < nwrites; idx++) {
       const transaction_base::write_record_t &rec = this->write_set[idx];
+      p = vs_uint32_t.write(p, rec.get_btree()->get_log_id());
       const uint32_t k_nbytes = rec.get_key().size();
       p = vs_uint32_t.write(p, k_nbytes);
       NDB_MEMCPY(p, rec.get_key().data(), k_nbytes);
@@ -1156,7 +1350,8 @@ public:
       // won't have anything to clean
       return;
     // all reads happening at >= ro_tick_geq
-    const uint64_t ro_tick_geq = ro_tick_ex - 1;
+    const uint64_t ro_tick_geq = std::min(
+        ro_tick_ex - 1, g_flags->g_gc_max_ro_tick.load());
     threadctx &ctx = g_threadctxs.my();
     clean_up_to_including(ctx, ro_tick_geq);
   }
@@ -1176,11 +1371,12 @@ private:
 template <>
 struct base_txn_btree_handler<transaction_proto2> {
   static inline void
-  on_construct()
+  on_construct(concurrent_btree *btr)
   {
 #ifndef PROTO2_CAN_DISABLE_GC
     transaction_proto2_static::InitGC();
 #endif
+    txn_logger::RegisterTable(btr);
   }
   static const bool has_background_task = true;
 };
@@ -1216,13 +1412,36 @@ struct txn_epoch_sync<transaction_proto2> : public transaction_proto2_static {
   {
     if (!txn_logger::IsPersistenceEnabled())
       return;
-    const unsigned long my_core_id = coreid::core_id();
+    // holding our tick lock keeps the persister from pushing for us
+    ticker::guard g(ticker::s_instance);
+    push_pending_log_buffers(coreid::core_id());
+  }
+  // every txn this thread has committed so far is in an epoch <= the
+  // returned epoch
+  static uint64_t
+  current_epoch()
+  {
+    return ticker::s_instance.global_current_tick();
+  }
+  // every txn in an epoch <= the returned epoch is durable
+  static uint64_t
+  persisted_epoch()
+  {
+    return txn_logger::system_sync_epoch_->load(std::memory_order_acquire);
+  }
+  // hands the txns which core_id has logged but not yet pushed over to its
+  // logger. a core only pushes a buffer once it fills up or the core commits
+  // in a later epoch, so whatever it logged last waits here once it stops
+  // committing. must be called with core_id's tick lock held
+  static void
+  push_pending_log_buffers(unsigned long core_id)
+  {
     txn_logger::persist_ctx &ctx =
-      txn_logger::persist_ctx_for(my_core_id, txn_logger::INITMODE_NONE);
+      txn_logger::persist_ctx_for(core_id, txn_logger::INITMODE_NONE);
     if (unlikely(!ctx.init_))
       return;
     txn_logger::persist_stats &stats =
-      txn_logger::g_persist_stats[my_core_id];
+      txn_logger::g_persist_stats[core_id];
     txn_logger::pbuffer_circbuf &pull_buf = ctx.all_buffers_;
     txn_logger::pbuffer_circbuf &push_buf = ctx.persist_buffers_;
     if (txn_logger::IsCompressionEnabled() &&
@@ -1235,11 +1454,11 @@ struct txn_epoch_sync<transaction_proto2> : public transaction_proto2_static {
     }
     txn_logger::pbuffer *px = pull_buf.peek();
     if (!px || !px->header()->nentries_) {
-      //std::cerr << "core " << my_core_id
+      //std::cerr << "core " << core_id
       //          << " nothing to push to logger" << std::endl;
       return;
     }
-    //std::cerr << "core " << my_core_id
+    //std::cerr << "core " << core_id
     //          << " pushing buffer to logger" << std::endl;
     txn_logger::pbuffer *px0 = pull_buf.deq();
     util::non_atomic_fetch_add(stats.ntxns_pushed_, px0->header()->nentries_);
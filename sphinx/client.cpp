@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <random>
 #include <string>
@@ -6,41 +9,170 @@
 
 #include "internal.h"
 #include "getopt.h"
+#include "msgs.h"
 #include "tbench_client.h"
 
 /*******************************************************************************
  * Class Definitions
  *******************************************************************************/
+// All audio samples, read once at startup into a single contiguous arena so
+// that generating a request is a copy out of memory instead of a file read.
 class AudioSamples {
 private:
-    // filenames of audio samples
-    std::vector<std::string> samples;
+    struct Sample {
+        size_t offset; // in samples, into arena
+        size_t len; // in samples
+    };
+
+    std::vector<int16_t> arena;
+    std::vector<Sample> samples;
 
     // random number generator
     std::default_random_engine generator;
-    std::uniform_int_distribution<int> distrib;
+    std::discrete_distribution<int> distrib;
 
     void loadSamples(std::string an4Corpus, std::string samplesFile) {
         std::ifstream fd(samplesFile, std::ifstream::in);
         std::string line;
+        std::vector<std::string> files;
         while (std::getline(fd, line)) {
             if (fd.fail()) {
                 throw AsrException("I/O error");
             }
 
-            samples.push_back(an4Corpus + "/" + line);
+            files.push_back(an4Corpus + "/" + line);
+        }
+
+        // Size the arena first so it never has to be reallocated
+        std::vector<size_t> sizes;
+        size_t total = 0;
+        for (auto& f : files) {
+            std::ifstream file(f, std::ios::binary | std::ios::ate);
+            if (!file.is_open()) {
+                std::cerr << "Failed to open audio sample " << f << std::endl;
+                exit(-1);
+            }
+
+            size_t bytes = file.tellg();
+            if (bytes > static_cast<size_t>(MAX_REQ_BYTES)) {
+                std::cerr << "Audio sample " << f << " is too large ("
+                    << bytes << " bytes)" << std::endl;
+                exit(-1);
+            }
+
+            sizes.push_back(bytes / sizeof(int16_t));
+            total += sizes.back();
+        }
+
+        arena.resize(total);
+        size_t offset = 0;
+        for (size_t i = 0; i < files.size(); ++i) {
+            std::ifstream file(files[i], std::ios::binary);
+            file.read(reinterpret_cast<char*>(&arena[offset]),
+                    sizes[i] * sizeof(int16_t));
+            if (file.fail()) throw AsrException("I/O error");
+
+            samples.push_back({offset, sizes[i]});
+            offset += sizes[i];
         }
+
+        std::cerr << "Loaded " << samples.size() << " audio samples ("
+            << total * sizeof(int16_t) / (1024 * 1024) << " MB)" << std::endl;
     }
 
 public:
-    AudioSamples(std::string an4Corpus, std::string samplesFile) {
+    // Samples are drawn with probability proportional to len^lengthExp: 0
+    // picks uniformly, positive values favor long utterances and negative
+    // values short ones, which controls the mix of service times.
+    AudioSamples(std::string an4Corpus, std::string samplesFile,
+            double lengthExp) {
         loadSamples(an4Corpus, samplesFile);
-        distrib = std::uniform_int_distribution<int>(0, samples.size() - 1);
+        if (samples.empty()) throw AsrException("No audio samples");
+
+        std::vector<double> weights;
+        for (auto& s : samples) {
+            weights.push_back(std::pow(std::max<size_t>(s.len, 1), lengthExp));
+        }
+        distrib = std::discrete_distribution<int>(weights.begin(),
+                weights.end());
     }
 
-    const std::string& get() {
-        int idx = distrib(generator);
-        return samples[idx];
+    // Picks a sample, returning a pointer into the arena and its length in
+    // samples
+    const int16_t* get(size_t* len) {
+        const Sample& s = samples[distrib(generator)];
+        *len = s.len;
+        return &arena[s.offset];
+    }
+};
+
+// Splits utterances into fixed-duration chunks. Several utterances are in
+// flight at once, and chunks are handed out round-robin across them, so with
+// nstreams streams and a chunk length of c ms, a request rate of
+// nstreams * 1000 / c QPS feeds every stream at real-time speed.
+class AudioStreams {
+private:
+    struct Stream {
+        const int16_t* audio;
+        size_t len;
+        size_t offset;
+        uint32_t session;
+        uint32_t seq;
+        bool active;
+    };
+
+    AudioSamples* samples;
+    std::vector<Stream> streams;
+    size_t chunkSamples;
+    size_t next;
+    uint32_t nextSession;
+
+    void startUtterance(Stream& s) {
+        s.audio = samples->get(&s.len);
+        s.offset = 0;
+        s.session = nextSession++;
+        s.seq = 0;
+        s.active = true;
+    }
+
+public:
+    AudioStreams(AudioSamples* samples, int nstreams, int chunkMs)
+        : samples(samples), streams(nstreams),
+          chunkSamples(chunkMs * SAMPLES_PER_MS), next(0), nextSession(0)
+    {
+        size_t maxSamples = (MAX_REQ_BYTES - sizeof(ChunkHeader))
+            / sizeof(int16_t);
+        if (chunkSamples == 0 || chunkSamples > maxSamples) {
+            throw AsrException("Invalid TBENCH_CHUNK_MS");
+        }
+        for (auto& s : streams) s.active = false;
+    }
+
+    size_t nextChunk(void* data) {
+        Stream& s = streams[next];
+        next = (next + 1) % streams.size();
+
+        if (!s.active) startUtterance(s);
+
+        ChunkHeader* hdr = reinterpret_cast<ChunkHeader*>(data);
+        size_t nsamples = std::min(chunkSamples, s.len - s.offset);
+
+        hdr->session = s.session;
+        hdr->seq = s.seq++;
+        hdr->nsamples = nsamples;
+        memcpy(hdr + 1, s.audio + s.offset, nsamples * sizeof(int16_t));
+        s.offset += nsamples;
+
+        if (s.offset == s.len) {
+            hdr->flags = CHUNK_LAST;
+            s.active = false;
+            tBenchClientSetReqClass(FINAL_CHUNK);
+        } else {
+            hdr->flags = 0;
+            tBenchClientSetReqClass(PARTIAL_CHUNK);
+        }
+
+        return sizeof(ChunkHeader) + nsamples * sizeof(int16_t);
     }
 };
 
@@ -48,37 +180,30 @@ public:
  * Global State
  *******************************************************************************/
 AudioSamples* samples = nullptr;
+AudioStreams* streams = nullptr;
 
 /*******************************************************************************
  * API
  *******************************************************************************/
 void tBenchClientInit() {
     std::string an4Corpus = getOpt<std::string>("TBENCH_AN4_CORPUS", ".");
-    std::string samplesFile = getOpt<std::string>("TBENCH_AUDIO_SAMPLES", 
+    std::string samplesFile = getOpt<std::string>("TBENCH_AUDIO_SAMPLES",
             "audio_samples");
-    samples = new AudioSamples(an4Corpus, samplesFile);
+    double lengthExp = getOpt<double>("TBENCH_LENGTH_WEIGHT", 0.0);
+    samples = new AudioSamples(an4Corpus, samplesFile, lengthExp);
+
+    int chunkMs = getOpt<int>("TBENCH_CHUNK_MS", 0);
+    if (chunkMs > 0) {
+        int nstreams = getOpt<int>("TBENCH_STREAMS", 1);
+        streams = new AudioStreams(samples, nstreams, chunkMs);
+    }
 }
 
 size_t tBenchClientGenReq(void* data) {
-    const std::string& sample = samples->get();
-
-    std::streampos fsize = 0;
-    std::ifstream file(sample, std::ios::binary);
-
-    if (file.is_open()) {
-        fsize = file.tellg();
-        file.seekg(0, std::ios::end);
-        fsize = file.tellg() - fsize;
-
-        file.seekg(0, std::ios::beg);
-
-        file.read(reinterpret_cast<char*>(data), fsize);
-
-        file.close();
-    } else {
-        std::cerr << "Failed to open audio sample " << sample << std::endl;
-        exit(-1);
-    }
+    if (streams) return streams->nextChunk(data);
 
-    return fsize;
+    size_t len;
+    const int16_t* audio = samples->get(&len);
+    memcpy(data, audio, len * sizeof(int16_t));
+    return len * sizeof(int16_t);
 }
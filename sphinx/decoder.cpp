@@ -3,38 +3,365 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <mutex>
 #include <random>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "internal.h"
 #include "tbench_server.h"
 #include <pocketsphinx.h>
+#include <ckd_alloc.h>
 #include <err.h>
 
-void doAsr() {
-    tBenchServerThreadStart();
+// sphinxbase internals, to give each decoder its own view of the shared LM
+extern "C" {
+#include "ngram_model_trie.h"
+}
 
-    err_set_logfp(NULL); // Get sphinx to be quiet
-    ps_decoder_t *ps;
-    cmd_ln_t *config;
-    FILE *fh;
-    char const *hyp, *uttid;
-    int64_t bufsize = 1024*1024;
-    int16* buf = nullptr;
-    int rv;
-    int32 score;
+/*******************************************************************************
+ * Decoder Pool
+ *******************************************************************************/
+// Name under which the shared language model is registered with each decoder
+static const char* SHARED_LM_SEARCH = "shared_lm";
 
-    config = cmd_ln_init(NULL, ps_args(), TRUE,
+static cmd_ln_t* initConfig() {
+    cmd_ln_t* config = cmd_ln_init(NULL, ps_args(), TRUE,
                  "-hmm", MODELDIR"/en-us/en-us",
                  "-lm", MODELDIR"/en-us/en-us.lm.bin",
                  "-dict", MODELDIR"/en-us/cmudict-en-us.dict",
+                 "-mmap", "yes",
                  NULL);
     if (config == NULL) throw AsrException("Could not init config");
-    ps = ps_init(config);
-    if (ps == NULL) throw AsrException("Could not init pocketsphinx");
+    return config;
+}
+
+static size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static double nowSecs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The trie LM caches the backoffs of the last history it scored in the trie
+// itself, so decoders cannot score against one ngram_model_t concurrently.
+// Instead, each decoder gets a view: copies of the model and trie headers with
+// their own scoring state, pointing at the shared word table and n-gram arrays,
+// which are only read while decoding.
+static ngram_model_t* newLmView(ngram_model_t* lm) {
+    ngram_model_trie_t* shared = reinterpret_cast<ngram_model_trie_t*>(lm);
+    ngram_model_trie_t* view = static_cast<ngram_model_trie_t*>(
+            ckd_calloc(1, sizeof(ngram_model_trie_t)));
+
+    view->base = shared->base;
+    // ngram_model_free() must never free the shared tables through a view,
+    // so the view holds a reference the decoders cannot drop (see
+    // freeLmView())
+    view->base.refcount = 2;
+    view->base.tmp_wids = static_cast<int32*>(
+            ckd_calloc(lm->n, sizeof(int32)));
+
+    view->trie = static_cast<lm_trie_t*>(ckd_calloc(1, sizeof(lm_trie_t)));
+    *view->trie = *shared->trie;
+    memset(view->trie->prev_hist, -1, sizeof(view->trie->prev_hist));
+
+    return &view->base;
+}
+
+// Frees only what newLmView() allocated; call after the decoder is freed
+static void freeLmView(ngram_model_t* lm) {
+    ngram_model_trie_t* view = reinterpret_cast<ngram_model_trie_t*>(lm);
+    ckd_free(view->trie);
+    ckd_free(view->base.tmp_wids);
+    ckd_free(view);
+}
+
+// Creates all decoders up front. In shared mode, the language model is
+// loaded once, and each decoder scores against its own view of it.
+// Pocketsphinx has no API to hand an acoustic model or dictionary to a
+// decoder, so each decoder still loads its own.
+class DecoderPool {
+    private:
+        bool shared;
+        cmd_ln_t* config; // Only used to load the shared LM
+        logmath_t* lmath;
+        ngram_model_t* lm;
+        std::vector<ps_decoder_t*> decoders;
+        std::vector<ngram_model_t*> lmViews; // lmViews[i] is decoders[i]'s
+
+        std::mutex freeLock;
+        std::vector<ps_decoder_t*> freeDecoders;
+
+        ps_decoder_t* initDecoder(ngram_model_t* lmView) {
+            // ps_init() retains and updates its config, so every decoder
+            // gets one of its own
+            cmd_ln_t* psConfig = initConfig();
+            if (shared) {
+                // Keep ps_init() from loading a private copy of the LM
+                cmd_ln_set_str_r(psConfig, "-lm", NULL);
+            }
+            ps_decoder_t* ps = ps_init(psConfig);
+            cmd_ln_free_r(psConfig); // The decoder holds its own reference
+            if (ps == NULL) throw AsrException("Could not init pocketsphinx");
+
+            if (shared) {
+                if (ps_set_lm(ps, SHARED_LM_SEARCH, lmView) < 0)
+                    throw AsrException("Could not set shared language model");
+                if (ps_set_search(ps, SHARED_LM_SEARCH) < 0)
+                    throw AsrException("Could not select shared search");
+            }
+
+            return ps;
+        }
+
+    public:
+        DecoderPool(int ndecoders, bool shared)
+            : shared(shared), config(initConfig()), lmath(nullptr), lm(nullptr)
+        {
+            size_t startBytes = residentBytes();
+            double startSecs = nowSecs();
+
+            if (shared) {
+                lmath = logmath_init(cmd_ln_float_r(config, "-logbase"), 0,
+                        FALSE);
+                lm = ngram_model_read(config, cmd_ln_str_r(config, "-lm"),
+                        NGRAM_AUTO, lmath);
+                if (lm == NULL) throw AsrException("Could not load LM");
+            }
+
+            // As in the original server, every decoder loads its models
+            // concurrently
+            decoders.resize(ndecoders);
+            lmViews.resize(ndecoders, nullptr);
+            if (shared) {
+                for (auto& view : lmViews) view = newLmView(lm);
+            }
+
+            std::vector<std::thread> loaders;
+            for (int i = 0; i < ndecoders; ++i) {
+                loaders.push_back(std::thread([this, i] {
+                    decoders[i] = initDecoder(lmViews[i]);
+                }));
+            }
+            for (auto& th : loaders) th.join();
+
+            double secs = nowSecs() - startSecs;
+            double mbytes = (residentBytes() - startBytes) / (1024.0 * 1024.0);
+            std::cerr << "Decoder pool (" << (shared ? "shared" : "private")
+                << " models): " << ndecoders << " decoders, startup "
+                << secs << " s, " << mbytes << " MB resident ("
+                << mbytes / ndecoders << " MB/decoder)" << std::endl;
+
+            freeDecoders = decoders;
+        }
+
+        ~DecoderPool() {
+            for (ps_decoder_t* ps : decoders) ps_free(ps);
+            for (ngram_model_t* view : lmViews) {
+                if (view) freeLmView(view);
+            }
+            if (lm) ngram_model_free(lm);
+            if (lmath) logmath_free(lmath);
+            cmd_ln_free_r(config);
+        }
+
+        ps_decoder_t* get(int idx) { return decoders[idx]; }
+
+        // Streaming sessions hold a decoder from their first chunk to their
+        // last one. Returns nullptr if every decoder is taken.
+        ps_decoder_t* acquire() {
+            std::lock_guard<std::mutex> guard(freeLock);
+            if (freeDecoders.empty()) return nullptr;
+            ps_decoder_t* ps = freeDecoders.back();
+            freeDecoders.pop_back();
+            return ps;
+        }
+
+        void release(ps_decoder_t* ps) {
+            std::lock_guard<std::mutex> guard(freeLock);
+            freeDecoders.push_back(ps);
+        }
+};
+
+/*******************************************************************************
+ * Streaming Sessions
+ *******************************************************************************/
+// A chunk of a streaming session. A chunk that arrives before its turn is
+// parked: its samples are copied out of the request buffer, and its response
+// is deferred until it is decoded.
+struct Chunk {
+    ChunkHeader hdr;
+    bool valid; // False if the request is shorter than hdr claims
+    const int16* samples;
+    std::vector<int16> buffered; // Samples of a parked chunk
+    void* resp; // Deferred response of a parked chunk, nullptr otherwise
+
+    Chunk() : valid(false), samples(nullptr), resp(nullptr) {}
+};
+
+static void respond(const Chunk& chunk, const char* hyp) {
+    if (chunk.resp) {
+        tBenchSendDeferredResp(chunk.resp, hyp, strlen(hyp));
+    } else {
+        tBenchSendResp(hyp, strlen(hyp));
+    }
+}
+
+// Tracks the decoder of every in-flight streaming session. Session ids are
+// only unique per client, so sessions are keyed by client and session id.
+// Chunks of a session may be picked up by different server threads. A thread
+// decodes its chunk if it is the session's next one, and then any parked
+// chunks that follow it; otherwise it parks the chunk and moves on to the next
+// request, so no thread waits on another.
+class SessionTable {
+    private:
+        struct Session {
+            ps_decoder_t* ps; // nullptr once the session has failed
+            uint32_t nextSeq;
+            bool busy; // A thread is decoding a chunk of this session
+            std::map<uint32_t, Chunk> parked;
+
+            Session() : ps(nullptr), nextSeq(0), busy(false) {}
+        };
+
+        DecoderPool* pool;
+        std::mutex lock;
+        std::unordered_map<uint64_t, Session*> sessions;
+
+        // Decodes chunk and responds with the hypothesis so far. Errors fail
+        // the session: it gives up its decoder and the rest of its chunks get
+        // empty responses.
+        void decode(Session* s, const Chunk& chunk) {
+            const ChunkHeader& hdr = chunk.hdr;
+            char const *hyp = "";
+            int32 score;
+
+            if (hdr.seq == 0) {
+                s->ps = pool->acquire();
+                if (!s->ps) {
+                    std::cerr << "Decoder pool exhausted, more concurrent "
+                        "sessions than decoders (see -n)" << std::endl;
+                } else if (ps_start_utt(s->ps) < 0) {
+                    std::cerr << "Could not start utterance" << std::endl;
+                    pool->release(s->ps);
+                    s->ps = nullptr;
+                }
+            }
+
+            if (s->ps && chunk.valid && hdr.nsamples > 0) {
+                ps_process_raw(s->ps, chunk.samples, hdr.nsamples, FALSE,
+                        FALSE);
+            }
+
+            if (s->ps && (hdr.flags & CHUNK_LAST) && ps_end_utt(s->ps) < 0) {
+                std::cerr << "Could not end utterance" << std::endl;
+                pool->release(s->ps);
+                s->ps = nullptr;
+            }
+
+            if (s->ps && chunk.valid) {
+                hyp = ps_get_hyp(s->ps, &score);
+                if (hyp == NULL) hyp = "";
+            }
+
+            respond(chunk, hyp);
+        }
+
+    public:
+        SessionTable(DecoderPool* pool) : pool(pool) {}
+
+        // Takes the chunk the calling thread just received
+        void process(int client, Chunk& chunk) {
+            const ChunkHeader& hdr = chunk.hdr;
+            uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(client))
+                    << 32) | hdr.session;
+            Session* s;
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+
+                Session*& session = sessions[key];
+                if (!session) session = new Session();
+                s = session;
+
+                if (hdr.seq < s->nextSeq || s->parked.count(hdr.seq)) {
+                    std::cerr << "Dropping duplicate chunk " << hdr.seq
+                        << " of session " << hdr.session << std::endl;
+                    s = nullptr;
+                } else if (s->busy || hdr.seq != s->nextSeq) {
+                    Chunk& p = s->parked[hdr.seq];
+                    p.hdr = hdr;
+                    p.valid = chunk.valid;
+                    if (chunk.valid) {
+                        p.buffered.assign(chunk.samples,
+                                chunk.samples + hdr.nsamples);
+                    }
+                    p.samples = p.buffered.data();
+                    p.resp = tBenchDeferResp();
+                    return;
+                } else {
+                    s->busy = true;
+                    s->nextSeq++;
+                }
+            }
+
+            if (!s) {
+                tBenchSendResp("", 0);
+                return;
+            }
+
+            Chunk next;
+            Chunk* cur = &chunk;
+            std::vector<void*> orphans;
+            while (true) {
+                decode(s, *cur);
+
+                std::lock_guard<std::mutex> guard(lock);
+                if (cur->hdr.flags & CHUNK_LAST) {
+                    // Chunks parked past the last one can never be decoded
+                    for (auto& p : s->parked) orphans.push_back(p.second.resp);
+                    if (s->ps) pool->release(s->ps);
+                    sessions.erase(key);
+                    delete s;
+                    break;
+                }
+
+                auto it = s->parked.find(s->nextSeq);
+                if (it == s->parked.end()) {
+                    s->busy = false;
+                    break;
+                }
+                next = std::move(it->second);
+                next.samples = next.buffered.data();
+                s->parked.erase(it);
+                s->nextSeq++;
+                cur = &next;
+            }
+
+            for (void* resp : orphans) tBenchSendDeferredResp(resp, "", 0);
+        }
+};
+
+/*******************************************************************************
+ * Server Thread
+ *******************************************************************************/
+void doAsr(ps_decoder_t* ps) {
+    tBenchServerThreadStart();
+
+    char const *hyp;
+    int64_t bufsize = 1024*1024;
+    int16* buf = nullptr;
+    int rv;
+    int32 score;
 
     while (true) {
         size_t len = tBenchRecvReq(reinterpret_cast<void**>(&buf));
@@ -61,25 +388,80 @@ void doAsr() {
 
         tBenchSendResp(reinterpret_cast<const void*>(hyp), strlen(hyp));
     }
-
-    ps_free(ps);
-    cmd_ln_free_r(config);
 };
 
+// Decodes each chunk as it arrives and responds with the partial hypothesis so
+// far, or with the final hypothesis once the last chunk has been decoded
+void doStreamingAsr(SessionTable* sessions) {
+    tBenchServerThreadStart();
+
+    void* buf = nullptr;
+
+    while (true) {
+        size_t len = tBenchRecvReq(&buf);
+
+        // A request too short for its header cannot be tied to a session,
+        // so it is failed with an empty response
+        if (len < sizeof(ChunkHeader)) {
+            std::cerr << "Dropping malformed chunk of " << len << " bytes"
+                << std::endl;
+            tBenchSendResp("", 0);
+            continue;
+        }
+
+        Chunk chunk;
+        chunk.hdr = *reinterpret_cast<ChunkHeader*>(buf);
+        chunk.samples = reinterpret_cast<int16*>(
+                reinterpret_cast<ChunkHeader*>(buf) + 1);
+
+        // A chunk shorter than its header claims is failed too, but still
+        // takes its turn, so the session's later chunks are not held up
+        const ChunkHeader& hdr = chunk.hdr;
+        chunk.valid = len - sizeof(ChunkHeader) >=
+            static_cast<size_t>(hdr.nsamples) * sizeof(int16);
+        if (!chunk.valid) {
+            std::cerr << "Chunk " << hdr.seq << " of session " << hdr.session
+                << " claims " << hdr.nsamples << " samples but carries "
+                << (len - sizeof(ChunkHeader)) / sizeof(int16) << std::endl;
+        }
+
+        sessions->process(tBenchReqClient(), chunk);
+    }
+}
+
 void usage() {
-    std::cerr << "Usage: decoder [-t nthreads]" << std::endl;
+    std::cerr << "Usage: decoder [-t nthreads] [-s] [-c] [-n ndecoders]"
+        << std::endl;
+    std::cerr << "  -s: share the language model across decoder threads"
+        << std::endl;
+    std::cerr << "  -c: streaming mode, requests carry utterance chunks"
+        << std::endl;
+    std::cerr << "  -n: decoders to create in streaming mode, at least the "
+        "number of concurrent client streams (default: nthreads)" << std::endl;
 }
 
 int main(int argc, char *argv[])
 {
     int nthreads = 1;
+    int ndecoders = 0;
+    bool sharedModels = false;
+    bool streaming = false;
 
     int c;
-    while((c = getopt(argc, argv, "t:")) != EOF) {
+    while((c = getopt(argc, argv, "t:scn:")) != EOF) {
         switch(c) {
             case 't':
                 nthreads = atoi(optarg);
                 break;
+            case 's':
+                sharedModels = true;
+                break;
+            case 'c':
+                streaming = true;
+                break;
+            case 'n':
+                ndecoders = atoi(optarg);
+                break;
             case '?':
                 usage();
                 return -1;
@@ -87,12 +469,24 @@ int main(int argc, char *argv[])
         }
     }
 
+    err_set_logfp(NULL); // Get sphinx to be quiet
+
+    if (!streaming || ndecoders < nthreads) ndecoders = nthreads;
+
+    DecoderPool pool(ndecoders, sharedModels);
+    SessionTable sessions(&pool);
+
     std::vector<std::thread> threads;
 
     tBenchServerInit(nthreads);
 
-    for (int i = 0; i < nthreads; i++)
-        threads.push_back(std::thread(doAsr));
+    for (int i = 0; i < nthreads; i++) {
+        if (streaming) {
+            threads.push_back(std::thread(doStreamingAsr, &sessions));
+        } else {
+            threads.push_back(std::thread(doAsr, pool.get(i)));
+        }
+    }
 
     // never reached
     for (auto& th : threads) th.join();
@@ -1,6 +1,8 @@
 #ifndef __INTERNAL_H
 #define __INTERNAL_H
 
+#include <stdint.h>
+
 class AsrException : public std::exception {
     private:
         std::string msg;
@@ -12,4 +14,23 @@ class AsrException : public std::exception {
         }
 };
 
+// Raw audio is 16-bit PCM sampled at 16 kHz
+const int SAMPLES_PER_MS = 16;
+
+// In streaming mode, every request carries one chunk of an utterance: this
+// header followed by the chunk's samples. Chunks of a session are numbered
+// from 0, and the last one has CHUNK_LAST set. Session ids only need to be
+// unique per client.
+const uint32_t CHUNK_LAST = 0x1;
+
+struct ChunkHeader {
+    uint32_t session;
+    uint32_t seq;
+    uint32_t flags;
+    uint32_t nsamples;
+};
+
+// Request classes reported to the harness in streaming mode
+enum ChunkClass { WHOLE_UTTERANCE = 0, PARTIAL_CHUNK = 1, FINAL_CHUNK = 2 };
+
 #endif
@@ -21,6 +21,21 @@ class Lat(object):
     def parseSojournTimes(self):
         return self.reqTimes[:, 2]
 
+class ReqClasses(object):
+    def __init__(self, fileName):
+        f = open(fileName, 'rb')
+        self.classes = np.fromfile(f, dtype=np.uint32)
+        f.close()
+
+class RespAttempts(object):
+    def __init__(self, fileName):
+        f = open(fileName, 'rb')
+        a = np.fromfile(f, dtype=np.uint64)
+        a = a.reshape((a.shape[0]/2, 2))
+        self.attempts = a[:, 0]
+        self.failedTimes = a[:, 1]
+        f.close()
+
 if __name__ == '__main__':
     def getLatPct(latsFile):
         assert os.path.exists(latsFile)
@@ -44,6 +59,29 @@ if __name__ == '__main__':
         print "95th percentile latency %.3f ms | max latency %.3f ms" \
                 % (p95, maxLat)
 
+        classesFile = os.path.join(os.path.dirname(latsFile),
+                'lats_classes.bin')
+        if os.path.exists(classesFile):
+            classes = ReqClasses(classesFile).classes
+            assert len(classes) == len(sjrnTimes)
+            for cls in np.unique(classes):
+                clsTimes = [l for (l, c) in zip(sjrnTimes, classes) if c == cls]
+                print "class %d: %d reqs | 95th percentile latency %.3f ms" \
+                        " | max latency %.3f ms" % (cls, len(clsTimes),
+                        stats.scoreatpercentile(clsTimes, 95), max(clsTimes))
+
+        attemptsFile = os.path.join(os.path.dirname(latsFile),
+                'lats_attempts.bin')
+        if os.path.exists(attemptsFile):
+            respAttempts = RespAttempts(attemptsFile)
+            attempts = respAttempts.attempts
+            failedTimes = [l/1e6 for l in respAttempts.failedTimes]
+            assert len(attempts) == len(sjrnTimes)
+            print "attempts: mean %.3f | %.2f%% of reqs retried | max %d" \
+                    " | 95th percentile failed time %.3f ms" \
+                    % (np.mean(attempts), 100.0 * np.mean(attempts > 1),
+                    max(attempts), stats.scoreatpercentile(failedTimes, 95))
+
     latsFile = sys.argv[1]
     getLatPct(latsFile)
         
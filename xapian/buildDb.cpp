@@ -0,0 +1,374 @@
+#include <xapian.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+void usage() {
+    cout << "Usage: buildDb -o outDir [-i corpus] [-f text|xml] [-s numShards]"
+        " [-t numThreads] [-b batchSize]" << endl;
+    cout << "  text: one document per line; xml: MediaWiki XML dump" << endl;
+    exit(-1);
+}
+
+/*******************************************************************************
+ * Pipeline
+ *******************************************************************************/
+template <typename T>
+class BoundedQueue {
+    private:
+        pthread_mutex_t lock;
+        pthread_cond_t notEmpty;
+        pthread_cond_t notFull;
+        deque<T> items;
+        size_t capacity;
+        bool closed;
+
+    public:
+        BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {
+            pthread_mutex_init(&lock, NULL);
+            pthread_cond_init(&notEmpty, NULL);
+            pthread_cond_init(&notFull, NULL);
+        }
+
+        void push(const T& item) {
+            pthread_mutex_lock(&lock);
+            while (items.size() == capacity)
+                pthread_cond_wait(&notFull, &lock);
+            items.push_back(item);
+            pthread_cond_signal(&notEmpty);
+            pthread_mutex_unlock(&lock);
+        }
+
+        // Returns false once the queue is closed and drained
+        bool pop(T* item) {
+            pthread_mutex_lock(&lock);
+            while (items.empty() && !closed)
+                pthread_cond_wait(&notEmpty, &lock);
+            bool ok = !items.empty();
+            if (ok) {
+                *item = items.front();
+                items.pop_front();
+                pthread_cond_signal(&notFull);
+            }
+            pthread_mutex_unlock(&lock);
+            return ok;
+        }
+
+        void close() {
+            pthread_mutex_lock(&lock);
+            closed = true;
+            pthread_cond_broadcast(&notEmpty);
+            pthread_mutex_unlock(&lock);
+        }
+};
+
+struct RawDoc {
+    unsigned long seq;
+    string title;
+    string text;
+};
+
+// Documents are handed between threads by pointer, since copies of Xapian
+// objects share non-atomic reference counts
+struct IndexedDoc {
+    unsigned long seq;
+    Xapian::Document* doc;
+};
+
+const size_t QUEUE_DEPTH = 4096;
+const size_t SUMMARY_LEN = 256;
+
+BoundedQueue<RawDoc*> rawDocs(QUEUE_DEPTH);
+vector<BoundedQueue<IndexedDoc>*> shardQueues;
+unsigned numShards = 1;
+unsigned long batchSize = 10000;
+
+atomic_ulong docsIndexed(0);
+atomic_ulong bytesIndexed(0);
+
+/*******************************************************************************
+ * Parsing
+ *******************************************************************************/
+static string decodeEntities(const string& s) {
+    static const char* entities[][2] = { {"&lt;", "<"}, {"&gt;", ">"},
+        {"&quot;", "\""}, {"&apos;", "'"}, {"&amp;", "&"} };
+
+    string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ) {
+        bool matched = false;
+        if (s[i] == '&') {
+            for (auto& e : entities) {
+                size_t len = strlen(e[0]);
+                if (s.compare(i, len, e[0]) == 0) {
+                    out += e[1];
+                    i += len;
+                    matched = true;
+                    break;
+                }
+            }
+        }
+        if (!matched) out += s[i++];
+    }
+    return out;
+}
+
+// Returns the contents of the first <tag ...>...</tag> in s, or "" if absent
+static string extractElement(const string& s, const string& tag) {
+    size_t open = s.find("<" + tag);
+    if (open == string::npos) return "";
+    size_t start = s.find('>', open);
+    if (start == string::npos || s[start - 1] == '/') return "";
+    size_t end = s.find("</" + tag + ">", start);
+    if (end == string::npos) return "";
+    return decodeEntities(s.substr(start + 1, end - start - 1));
+}
+
+static void readText(istream& in) {
+    unsigned long seq = 0;
+    string line;
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        RawDoc* d = new RawDoc();
+        d->seq = seq++;
+        d->text = line;
+        rawDocs.push(d);
+    }
+}
+
+static void readXml(istream& in) {
+    unsigned long seq = 0;
+    string line;
+    string page;
+    bool inPage = false;
+    while (getline(in, line)) {
+        if (!inPage) {
+            if (line.find("<page>") == string::npos) continue;
+            inPage = true;
+            page.clear();
+        }
+
+        page += line;
+        page += '\n';
+
+        if (line.find("</page>") != string::npos) {
+            inPage = false;
+            RawDoc* d = new RawDoc();
+            d->seq = seq++;
+            d->title = extractElement(page, "title");
+            d->text = extractElement(page, "text");
+            rawDocs.push(d);
+        }
+    }
+}
+
+/*******************************************************************************
+ * Term generation
+ *******************************************************************************/
+// Uses the same stemmer and stop words as Server, so that indexed terms match
+// parsed queries
+void* indexer(void*) {
+    const char* stopWords[] = { "a", "about", "an", "and", "are", "as", "at", "be",
+        "by", "en", "for", "from", "how", "i", "in", "is", "it", "of", "on",
+        "or", "that", "the", "this", "to", "was", "what", "when", "where",
+        "which", "who", "why", "will", "with" };
+    Xapian::SimpleStopper stopper(stopWords, \
+            stopWords + sizeof(stopWords) / sizeof(stopWords[0]));
+
+    Xapian::TermGenerator termGen;
+    termGen.set_stemmer(Xapian::Stem("english"));
+    termGen.set_stopper(&stopper);
+
+    RawDoc* raw;
+    while (rawDocs.pop(&raw)) {
+        Xapian::Document* doc = new Xapian::Document();
+        termGen.set_document(*doc);
+        if (!raw->title.empty()) {
+            termGen.index_text(raw->title);
+            termGen.increase_termpos();
+        }
+        termGen.index_text(raw->text);
+        // Drop termGen's reference before the writer thread takes the doc
+        termGen.set_document(Xapian::Document());
+
+        string data = raw->title.empty() ? "" : raw->title + "\n";
+        data += raw->text.substr(0, SUMMARY_LEN);
+        doc->set_data(data);
+
+        bytesIndexed += raw->title.size() + raw->text.size();
+
+        IndexedDoc d = { raw->seq, doc };
+        shardQueues[raw->seq % numShards]->push(d);
+        delete raw;
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ * Shard writers
+ *******************************************************************************/
+struct Writer {
+    unsigned shard;
+    string path;
+};
+
+// Document seq goes to shard seq % numShards with docid seq / numShards + 1,
+// the same layout as splitDb, so the stub database numbers documents in
+// corpus order
+void* writer(void* v) {
+    Writer* w = static_cast<Writer*>(v);
+    Xapian::WritableDatabase db(w->path, Xapian::DB_CREATE_OR_OVERWRITE);
+
+    unsigned long pending = 0;
+    IndexedDoc d;
+    while (shardQueues[w->shard]->pop(&d)) {
+        db.replace_document(d.seq / numShards + 1, *d.doc);
+        delete d.doc;
+
+        ++docsIndexed;
+        if (++pending == batchSize) {
+            db.commit();
+            pending = 0;
+        }
+    }
+
+    db.commit();
+    return NULL;
+}
+
+static double nowSecs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+volatile bool indexingDone = false;
+
+void* reporter(void*) {
+    const unsigned REPORT_INTERVAL_SECS = 5;
+    double start = nowSecs();
+    while (!indexingDone) {
+        sleep(REPORT_INTERVAL_SECS);
+        double secs = nowSecs() - start;
+        cerr << "indexed " << docsIndexed << " docs in " << secs << " s: " \
+            << docsIndexed / secs << " docs/s, " \
+            << bytesIndexed / secs / (1024 * 1024) << " MB/s" << endl;
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    string inPath = "-";
+    string format = "text";
+    string outDir;
+    unsigned numThreads = 4;
+
+    int c;
+    string optString = "i:f:o:s:t:b:";
+    while ((c = getopt(argc, argv, optString.c_str())) != -1) {
+        switch (c) {
+            case 'i':
+                inPath = optarg;
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            case 'o':
+                outDir = optarg;
+                break;
+            case 's':
+                numShards = atoi(optarg);
+                break;
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+            case 'b':
+                batchSize = atol(optarg);
+                break;
+            default:
+                cerr << "Unknown option: " << optopt << endl;
+                usage();
+                break;
+        }
+    }
+
+    if (outDir.empty() || numShards == 0 || numThreads == 0 || batchSize == 0)
+        usage();
+    if (format != "text" && format != "xml") usage();
+
+    ifstream inFile;
+    if (inPath != "-") {
+        inFile.open(inPath.c_str());
+        if (inFile.fail()) {
+            cerr << "Can't open corpus " << inPath << endl;
+            exit(-1);
+        }
+    }
+    istream& in = (inPath == "-") ? cin : inFile;
+
+    // A single shard is written as a plain database at outDir; more shards
+    // go in outDir/shard<i> with a stub database over them, as with splitDb
+    vector<Writer> writers(numShards);
+    if (numShards == 1) {
+        writers[0].shard = 0;
+        writers[0].path = outDir;
+    } else {
+        mkdir(outDir.c_str(), 0755);
+        ofstream stub((outDir + "/XAPIANDB").c_str());
+        for (unsigned s = 0; s < numShards; ++s) {
+            stringstream name;
+            name << "shard" << s;
+            writers[s].shard = s;
+            writers[s].path = outDir + "/" + name.str();
+            stub << "auto " << name.str() << endl;
+        }
+    }
+
+    for (unsigned s = 0; s < numShards; ++s)
+        shardQueues.push_back(new BoundedQueue<IndexedDoc>(QUEUE_DEPTH));
+
+    double start = nowSecs();
+
+    vector<pthread_t> writerThreads(numShards);
+    for (unsigned s = 0; s < numShards; ++s)
+        pthread_create(&writerThreads[s], NULL, writer, &writers[s]);
+
+    vector<pthread_t> indexerThreads(numThreads);
+    for (unsigned t = 0; t < numThreads; ++t)
+        pthread_create(&indexerThreads[t], NULL, indexer, NULL);
+
+    pthread_t reporterThread;
+    pthread_create(&reporterThread, NULL, reporter, NULL);
+    pthread_detach(reporterThread);
+
+    if (format == "xml") readXml(in);
+    else readText(in);
+
+    rawDocs.close();
+    for (auto& t : indexerThreads) pthread_join(t, NULL);
+
+    for (auto q : shardQueues) q->close();
+    for (auto& t : writerThreads) pthread_join(t, NULL);
+
+    double secs = nowSecs() - start;
+    indexingDone = true;
+    cerr << "Indexed " << docsIndexed << " docs (" \
+        << bytesIndexed / (1024 * 1024) << " MB) into " << numShards \
+        << " shards in " << secs << " s: " << docsIndexed / secs \
+        << " docs/s, " << bytesIndexed / secs / (1024 * 1024) << " MB/s" \
+        << endl;
+
+    return 0;
+}
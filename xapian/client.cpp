@@ -3,10 +3,14 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <random>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -15,14 +19,15 @@
  *******************************************************************************/
 class TermSet {
     private:
-        pthread_mutex_t lock;
         std::vector<std::string> terms;
-        std::default_random_engine randEngine;
-        std::uniform_int_distribution<unsigned long> termGen;
-    public:
-        TermSet(std::string termsFile) {
-            pthread_mutex_init(&lock, NULL);
+        std::vector<double> cdf; // cdf[i]: P(rank <= i)
 
+    public:
+        // Terms are ranked by popularity in a random (seeded) order, since
+        // the terms file is sorted alphabetically. With skew 0, all terms are
+        // equally likely; otherwise the term of rank r is chosen with
+        // probability proportional to 1 / r^skew.
+        TermSet(std::string termsFile, double skew, unsigned long seed) {
             std::ifstream fin(termsFile);
             if (fin.fail()) {
                 std::cerr << "Error opening terms file" << std::endl;
@@ -46,42 +51,156 @@ class TermSet {
             }
 
             fin.close();
-            termGen = std::uniform_int_distribution<unsigned long>(0, \
-                    termCount - 1);
+
+            if (terms.empty()) {
+                std::cerr << "Terms file is empty" << std::endl;
+                exit(-1);
+            }
+
+            std::mt19937_64 shuffleEngine(seed);
+            std::shuffle(terms.begin(), terms.end(), shuffleEngine);
+
+            double sum = 0;
+            cdf.resize(terms.size());
+            for (size_t r = 0; r < terms.size(); ++r) {
+                sum += 1.0 / std::pow(r + 1, skew);
+                cdf[r] = sum;
+            }
+            for (auto& c : cdf) c /= sum;
         }
 
         ~TermSet() {}
 
-        void acquireLock() { pthread_mutex_lock(&lock); }
+        // u is uniform in [0, 1)
+        const std::string& getTerm(double u) const {
+            size_t idx = std::upper_bound(cdf.begin(), cdf.end(), u) - \
+                         cdf.begin();
+            return terms[std::min(idx, terms.size() - 1)];
+        }
+};
 
-        void releaseLock() { pthread_mutex_unlock(&lock); }
+// Generates queries of one or more terms. The number of terms is drawn from
+// configurable weights, and multi-term queries are issued as phrase or AND
+// queries with the given probabilities (plain OR queries otherwise). Each
+// thread uses its own random engine, so generation takes no locks and the
+// harness can run it outside its client lock.
+class QueryGenerator {
+    private:
+        const TermSet& termSet;
+        std::vector<double> lengthCdf; // lengthCdf[i]: P(nterms <= i + 1)
+        double phraseFrac;
+        double andFrac;
+        unsigned long seed;
+        std::atomic_ulong nextThread;
+
+        std::mt19937_64& engine() {
+            // Seeded on each thread's first call
+            static thread_local std::mt19937_64 eng(seed + nextThread++);
+            return eng;
+        }
 
-        const std::string& getTerm() {
-            acquireLock();
-            unsigned long idx = termGen(randEngine);
-            releaseLock();
-            return terms[idx];
+    public:
+        QueryGenerator(const TermSet& termSet, std::vector<double> lengthWeights,
+                double phraseFrac, double andFrac, unsigned long seed)
+            : termSet(termSet), phraseFrac(phraseFrac), andFrac(andFrac),
+              seed(seed), nextThread(0)
+        {
+            double sum = 0;
+            for (double w : lengthWeights) {
+                sum += w;
+                lengthCdf.push_back(sum);
+            }
+            for (auto& c : lengthCdf) c /= sum;
+        }
+
+        std::string getQuery() {
+            std::mt19937_64& eng = engine();
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+            unsigned nterms = std::upper_bound(lengthCdf.begin(),
+                    lengthCdf.end(), uniform(eng)) - lengthCdf.begin() + 1;
+            nterms = std::min<unsigned>(nterms, lengthCdf.size());
+            if (nterms == 1) return termSet.getTerm(uniform(eng));
+
+            double type = uniform(eng);
+            bool phrase = type < phraseFrac;
+            bool conj = !phrase && (type < phraseFrac + andFrac);
+
+            std::string query = phrase ? "\"" : "";
+            for (unsigned t = 0; t < nterms; ++t) {
+                if (t > 0) query += conj ? " AND " : " ";
+                query += termSet.getTerm(uniform(eng));
+            }
+            if (phrase) query += "\"";
+
+            return query;
         }
 };
 
+// Queries generated ahead of time and replayed in order, so that generating a
+// request is just a copy
+class QueryStream {
+    private:
+        std::vector<std::string> queries;
+        std::atomic_ulong next;
+
+    public:
+        QueryStream(QueryGenerator& gen, unsigned long len) : next(0) {
+            queries.reserve(len);
+            for (unsigned long q = 0; q < len; ++q)
+                queries.push_back(gen.getQuery());
+        }
+
+        const std::string& getQuery() {
+            return queries[next++ % queries.size()];
+        }
+};
+
+static std::vector<double> parseWeights(std::string str) {
+    std::vector<double> weights;
+    std::stringstream ss(str);
+    std::string w;
+    while (std::getline(ss, w, ',')) weights.push_back(atof(w.c_str()));
+    if (weights.empty()) weights.push_back(1.0);
+    return weights;
+}
+
 /*******************************************************************************
  * Global Data
  *******************************************************************************/
 TermSet* termSet = nullptr;
+QueryGenerator* queryGen = nullptr;
+QueryStream* queryStream = nullptr;
 
 /*******************************************************************************
  * Liblat API
  *******************************************************************************/
 void tBenchClientInit() {
     std::string termsFile = getOpt<std::string>("TBENCH_TERMS_FILE", "terms.in");
-    termSet = new TermSet(termsFile);
+    double skew = getOpt<double>("TBENCH_ZIPF_SKEW", 0.0);
+    unsigned long seed = getOpt<unsigned long>("TBENCH_QUERY_SEED", 0);
+    std::string lengthWeights = getOpt<std::string>("TBENCH_QUERY_LEN_WEIGHTS",
+            "1");
+    double phraseFrac = getOpt<double>("TBENCH_PHRASE_FRAC", 0.0);
+    double andFrac = getOpt<double>("TBENCH_AND_FRAC", 0.0);
+    unsigned long streamLen = getOpt<unsigned long>("TBENCH_QUERY_STREAM_LEN",
+            0);
+
+    termSet = new TermSet(termsFile, skew, seed);
+    queryGen = new QueryGenerator(*termSet, parseWeights(lengthWeights),
+            phraseFrac, andFrac, seed);
+    if (streamLen > 0) queryStream = new QueryStream(*queryGen, streamLen);
+
+    tBenchClientSetConcurrentGen();
 }
 
 size_t tBenchClientGenReq(void* data) {
-    std::string term = termSet->getTerm();
-    size_t len = term.size();
+    std::string generated;
+    const std::string& query = queryStream ? queryStream->getQuery() : \
+                               (generated = queryGen->getQuery());
+    size_t len = query.size();
 
-    memcpy(data, reinterpret_cast<const void*>(term.c_str()), len + 1);
+    memcpy(data, reinterpret_cast<const void*>(query.c_str()), len + 1);
 
     return len + 1;
 }
@@ -0,0 +1,75 @@
+#include "doccache.h"
+
+using namespace std;
+
+DocCache::DocCache(size_t capacityBytes, unsigned numShards)
+    : shardCapacity(capacityBytes / numShards)
+    , hits(0)
+    , misses(0)
+{
+    for (unsigned s = 0; s < numShards; ++s) shards.push_back(new Shard());
+}
+
+DocCache::~DocCache() {
+    for (Shard* s : shards) delete s;
+}
+
+bool DocCache::lookup(Xapian::docid did, string* desc) {
+    Shard* s = shardFor(did);
+
+    pthread_mutex_lock(&s->lock);
+
+    auto it = s->index.find(did);
+    bool found = (it != s->index.end());
+    if (found) {
+        s->lru.splice(s->lru.begin(), s->lru, it->second);
+        *desc = it->second->second;
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    if (found) ++hits;
+    else ++misses;
+
+    return found;
+}
+
+void DocCache::insert(Xapian::docid did, const string& desc) {
+    Shard* s = shardFor(did);
+    size_t bytes = entryBytes(desc);
+    if (bytes > shardCapacity) return;
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->index.find(did) == s->index.end()) {
+        while (s->bytes + bytes > shardCapacity) {
+            Entry& victim = s->lru.back();
+            s->bytes -= entryBytes(victim.second);
+            s->index.erase(victim.first);
+            s->lru.pop_back();
+        }
+
+        s->lru.push_front(Entry(did, desc));
+        s->index[did] = s->lru.begin();
+        s->bytes += bytes;
+    }
+
+    pthread_mutex_unlock(&s->lock);
+}
+
+void DocCache::printStats(ostream& out) {
+    unsigned long h = hits;
+    unsigned long m = misses;
+    size_t bytes = 0;
+    size_t entries = 0;
+    for (Shard* s : shards) {
+        pthread_mutex_lock(&s->lock);
+        bytes += s->bytes;
+        entries += s->index.size();
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    out << "Doc cache: hits " << h << ", misses " << m << ", hit ratio "
+        << ((h + m) ? (double)h / (h + m) : 0.0) << ", entries " << entries
+        << ", bytes " << bytes << endl;
+}
@@ -0,0 +1,56 @@
+#ifndef __DOCCACHE_H
+#define __DOCCACHE_H
+
+#include <atomic>
+#include <list>
+#include <ostream>
+#include <pthread.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <xapian.h>
+
+// Caches the serialized summary (Document::get_description()) of returned
+// documents, so popular documents are not re-read from the record table on
+// every hit. Shared by all Server threads; split into shards, each an LRU list
+// bounded to its share of the byte budget under its own lock.
+class DocCache {
+    private:
+        typedef std::pair<Xapian::docid, std::string> Entry;
+
+        struct Shard {
+            pthread_mutex_t lock;
+            std::list<Entry> lru; // most recently used first
+            std::unordered_map<Xapian::docid, std::list<Entry>::iterator> index;
+            size_t bytes;
+
+            Shard() : bytes(0) { pthread_mutex_init(&lock, NULL); }
+        };
+
+        std::vector<Shard*> shards;
+        size_t shardCapacity;
+
+        std::atomic_ulong hits;
+        std::atomic_ulong misses;
+
+        static size_t entryBytes(const std::string& desc) {
+            // Approximate list node and hash table overheads
+            return desc.size() + sizeof(Entry) + 4 * sizeof(void*);
+        }
+
+        Shard* shardFor(Xapian::docid did) {
+            return shards[did % shards.size()];
+        }
+
+    public:
+        DocCache(size_t capacityBytes, unsigned numShards);
+        ~DocCache();
+
+        bool lookup(Xapian::docid did, std::string* desc);
+        void insert(Xapian::docid did, const std::string& desc);
+
+        void printStats(std::ostream& out);
+};
+
+#endif
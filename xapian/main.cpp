@@ -1,5 +1,7 @@
 #include <iostream>
+#include <sstream>
 #include <atomic>
+#include <vector>
 #include <pthread.h>
 #include <unistd.h>
 #include <string.h>
@@ -16,7 +18,10 @@ pthread_barrier_t barrier;
 
 inline void usage() {
     cerr << "xapian_search [-n <numServers>]\
-        [-d <dbPath>] [-r <numRequests]" << endl;
+        [-d <dbPath>] [-r <numRequests] [-c <cacheMB>] [-a lru|tinylfu]\
+        [-m <msetSize> | -k] [-e <checkAtLeast>] [-p <percentCutoff>]\
+        [-w <weightCutoff>] [-s <numShardWorkers>] [-f <fanout,...>]\
+        [-D <docCacheMB>] [-P <numPreloadDocs> -q <termsFile>]" << endl;
 }
 
 inline void sanityCheckArg(string msg) {
@@ -30,9 +35,17 @@ inline void sanityCheckArg(string msg) {
 int main(int argc, char* argv[]) {
     unsigned numServers = 4;
     string dbPath = "db";
+    unsigned long cacheMB = 0;
+    string cacheAdmission = "tinylfu";
+    SearchOptions searchOptions;
+    unsigned numShardWorkers = 0;
+    vector<unsigned> fanouts;
+    unsigned long docCacheMB = 0;
+    unsigned long numPreloadDocs = 0;
+    string preloadTermsFile;
 
     int c;
-    string optString = "n:d:r:";
+    string optString = "n:d:r:c:a:m:ke:p:w:s:f:D:P:q:";
     while ((c = getopt(argc, argv, optString.c_str())) != -1) {
         switch (c) {
             case 'n':
@@ -49,6 +62,74 @@ int main(int argc, char* argv[]) {
                 sanityCheckArg("Missing #reqs");
                 numReqsToProcess = atol(optarg);
                 break;
+
+            case 'c':
+                sanityCheckArg("Missing cache size");
+                cacheMB = atol(optarg);
+                break;
+
+            case 'a':
+                sanityCheckArg("Missing cache admission policy");
+                cacheAdmission = optarg;
+                if (cacheAdmission != "lru" && cacheAdmission != "tinylfu") {
+                    usage();
+                    exit(-1);
+                }
+                break;
+
+            case 'm':
+                sanityCheckArg("Missing MSet size");
+                searchOptions.msetSize = atoi(optarg);
+                break;
+
+            case 'k':
+                searchOptions.msetSize = SearchOptions::RESULTS_PER_PAGE;
+                break;
+
+            case 'e':
+                sanityCheckArg("Missing check-at-least count");
+                searchOptions.checkAtLeast = atoi(optarg);
+                break;
+
+            case 'p':
+                sanityCheckArg("Missing percent cutoff");
+                searchOptions.percentCutoff = atoi(optarg);
+                break;
+
+            case 'w':
+                sanityCheckArg("Missing weight cutoff");
+                searchOptions.weightCutoff = atof(optarg);
+                break;
+
+            case 's':
+                sanityCheckArg("Missing #shard workers");
+                numShardWorkers = atoi(optarg);
+                break;
+
+            case 'f':
+                {
+                    sanityCheckArg("Missing fanouts");
+                    stringstream ss(optarg);
+                    string f;
+                    while (getline(ss, f, ',')) fanouts.push_back(atoi(f.c_str()));
+                }
+                break;
+
+            case 'D':
+                sanityCheckArg("Missing doc cache size");
+                docCacheMB = atol(optarg);
+                break;
+
+            case 'P':
+                sanityCheckArg("Missing #docs to preload");
+                numPreloadDocs = atol(optarg);
+                break;
+
+            case 'q':
+                sanityCheckArg("Missing preload terms file");
+                preloadTermsFile = optarg;
+                break;
+
             default:
                 cerr << "Unknown option " << c << endl;
                 usage();
@@ -59,11 +140,42 @@ int main(int argc, char* argv[]) {
 
     tBenchServerInit(numServers);
 
-    Server::init(numReqsToProcess, numServers);
+    const unsigned CACHE_SHARDS = 64;
+    ResultCache* cache = NULL;
+    if (cacheMB > 0) {
+        cache = new ResultCache(cacheMB << 20, cacheAdmission == "tinylfu", \
+                CACHE_SHARDS);
+    }
+
+    // In sharded mode, dbPath is the stub database written by splitDb
+    ShardPool* shardPool = NULL;
+    if (numShardWorkers > 0) {
+        shardPool = new ShardPool(dbPath, numShardWorkers, searchOptions, \
+                fanouts);
+        cerr << "Searching " << shardPool->numShards() << " shards with " \
+            << numShardWorkers << " workers" << endl;
+    }
+
+    const unsigned DOC_CACHE_SHARDS = 64;
+    DocCache* docCache = NULL;
+    if (docCacheMB > 0)
+        docCache = new DocCache(docCacheMB << 20, DOC_CACHE_SHARDS);
+
+    Server::init(numReqsToProcess, numServers, searchOptions, cache, docCache, \
+            shardPool);
     Server** servers = new Server* [numServers];
     for (unsigned i = 0; i < numServers; i++)
         servers[i] = new Server(i, dbPath);
 
+    if (docCache && numPreloadDocs > 0) {
+        if (preloadTermsFile.empty()) {
+            cerr << "Preloading docs requires a terms file (-q)" << endl;
+            usage();
+            exit(-1);
+        }
+        servers[0]->warmDocCache(preloadTermsFile, numPreloadDocs);
+    }
+
     pthread_t* threads = NULL;
     if (numServers > 1) {
         threads = new pthread_t [numServers - 1];
@@ -86,5 +198,8 @@ int main(int argc, char* argv[]) {
 
     Server::fini();
 
+    delete cache;
+    delete docCache;
+
     return 0;
 }
@@ -0,0 +1,180 @@
+#include <ctype.h>
+
+#include "resultcache.h"
+
+using namespace std;
+
+/*******************************************************************************
+ * FrequencySketch
+ *******************************************************************************/
+FrequencySketch::FrequencySketch(uint64_t width) {
+    uint64_t w = 1;
+    while (w < width) w <<= 1;
+
+    table.resize(w * DEPTH, 0);
+    mask = w - 1;
+    sampleSize = 10 * w;
+    additions = 0;
+}
+
+uint64_t FrequencySketch::index(uint64_t hash, unsigned row) const {
+    static const uint64_t SEEDS[DEPTH] = { 0xc3a5c85c97cb3127ULL,
+        0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL };
+    uint64_t h = (hash + SEEDS[row]) * SEEDS[row];
+    h ^= h >> 32;
+    return row * (mask + 1) + (h & mask);
+}
+
+void FrequencySketch::reset() {
+    for (auto& c : table) c >>= 1;
+    additions /= 2;
+}
+
+void FrequencySketch::increment(uint64_t hash) {
+    bool added = false;
+    for (unsigned r = 0; r < DEPTH; ++r) {
+        uint8_t& c = table[index(hash, r)];
+        if (c < MAX_COUNT) {
+            ++c;
+            added = true;
+        }
+    }
+
+    if (added && ++additions == sampleSize) reset();
+}
+
+unsigned FrequencySketch::frequency(uint64_t hash) const {
+    unsigned freq = MAX_COUNT;
+    for (unsigned r = 0; r < DEPTH; ++r) {
+        unsigned c = table[index(hash, r)];
+        if (c < freq) freq = c;
+    }
+    return freq;
+}
+
+/*******************************************************************************
+ * ResultCache
+ *******************************************************************************/
+ResultCache::ResultCache(size_t capacityBytes, bool tinyLfu, \
+        unsigned numShards)
+    : shardCapacity(capacityBytes / numShards)
+    , tinyLfu(tinyLfu)
+    , hits(0)
+    , misses(0)
+    , insertions(0)
+    , rejections(0)
+    , evictions(0)
+{
+    // Size sketches for ~1KB entries; frequencies only need to be accurate
+    // for the entries that fit
+    const uint64_t AVG_ENTRY_BYTES = 1024;
+    uint64_t sketchWidth = shardCapacity / AVG_ENTRY_BYTES;
+    if (sketchWidth < 1024) sketchWidth = 1024;
+
+    for (unsigned s = 0; s < numShards; ++s)
+        shards.push_back(new Shard(sketchWidth));
+}
+
+ResultCache::~ResultCache() {
+    for (Shard* s : shards) delete s;
+}
+
+string ResultCache::normalize(const char* query) {
+    string key;
+    bool space = false;
+    for (const char* c = query; *c; ++c) {
+        if (isspace(static_cast<unsigned char>(*c))) {
+            space = !key.empty();
+        } else {
+            if (space) key += ' ';
+            key += *c;
+            space = false;
+        }
+    }
+    return key;
+}
+
+bool ResultCache::lookup(const string& key, string* value) {
+    uint64_t hash = std::hash<string>()(key);
+    Shard* s = shards[hash % shards.size()];
+
+    pthread_mutex_lock(&s->lock);
+
+    s->sketch.increment(hash);
+
+    auto it = s->index.find(key);
+    bool found = (it != s->index.end());
+    if (found) {
+        s->lru.splice(s->lru.begin(), s->lru, it->second);
+        *value = it->second->value;
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    if (found) ++hits;
+    else ++misses;
+
+    return found;
+}
+
+void ResultCache::insert(const string& key, const string& value) {
+    uint64_t hash = std::hash<string>()(key);
+    Shard* s = shards[hash % shards.size()];
+
+    Entry entry = { key, value };
+    size_t bytes = entryBytes(entry);
+    if (bytes > shardCapacity) return;
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->index.find(key) != s->index.end()) {
+        // Another thread raced us to it
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+
+    if (tinyLfu && s->bytes + bytes > shardCapacity) {
+        unsigned victimFreq = s->sketch.frequency(
+                std::hash<string>()(s->lru.back().key));
+        if (s->sketch.frequency(hash) <= victimFreq) {
+            pthread_mutex_unlock(&s->lock);
+            ++rejections;
+            return;
+        }
+    }
+
+    while (s->bytes + bytes > shardCapacity) {
+        Entry& victim = s->lru.back();
+        s->bytes -= entryBytes(victim);
+        s->index.erase(victim.key);
+        s->lru.pop_back();
+        ++evictions;
+    }
+
+    s->lru.push_front(std::move(entry));
+    s->index[key] = s->lru.begin();
+    s->bytes += bytes;
+
+    pthread_mutex_unlock(&s->lock);
+
+    ++insertions;
+}
+
+void ResultCache::printStats(ostream& out) {
+    unsigned long h = hits;
+    unsigned long m = misses;
+    size_t bytes = 0;
+    size_t entries = 0;
+    for (Shard* s : shards) {
+        pthread_mutex_lock(&s->lock);
+        bytes += s->bytes;
+        entries += s->index.size();
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    out << "Result cache: hits " << h << ", misses " << m << ", hit ratio "
+        << ((h + m) ? (double)h / (h + m) : 0.0) << ", insertions "
+        << insertions << ", rejections " << rejections << ", evictions "
+        << evictions << ", entries " << entries << ", bytes " << bytes
+        << endl;
+}
@@ -0,0 +1,92 @@
+#ifndef __RESULTCACHE_H
+#define __RESULTCACHE_H
+
+#include <atomic>
+#include <list>
+#include <ostream>
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Approximate access counts for TinyLFU admission: a count-min sketch of 4-bit
+// saturating counters that are halved every sampleSize increments, so old
+// popularity fades.
+class FrequencySketch {
+    private:
+        static const unsigned DEPTH = 4;
+        static const uint8_t MAX_COUNT = 15;
+
+        std::vector<uint8_t> table;
+        uint64_t mask;
+        uint64_t sampleSize;
+        uint64_t additions;
+
+        uint64_t index(uint64_t hash, unsigned row) const;
+        void reset();
+
+    public:
+        FrequencySketch(uint64_t width);
+
+        void increment(uint64_t hash);
+        unsigned frequency(uint64_t hash) const;
+};
+
+// Query result cache shared by all Server threads. Keys are normalized query
+// strings, and values are the serialized responses. The cache is split into
+// shards, each an LRU list bounded to its share of the byte budget under its
+// own lock. With TinyLFU admission, a new entry that would force an eviction is
+// only admitted if it has been requested more often than the LRU victim, which
+// keeps one-off queries from flushing popular ones.
+class ResultCache {
+    private:
+        struct Entry {
+            std::string key;
+            std::string value;
+        };
+
+        struct Shard {
+            pthread_mutex_t lock;
+            std::list<Entry> lru; // most recently used first
+            std::unordered_map<std::string, std::list<Entry>::iterator> index;
+            size_t bytes;
+            FrequencySketch sketch;
+
+            Shard(uint64_t sketchWidth) : bytes(0), sketch(sketchWidth) {
+                pthread_mutex_init(&lock, NULL);
+            }
+        };
+
+        std::vector<Shard*> shards;
+        size_t shardCapacity;
+        bool tinyLfu;
+
+        std::atomic_ulong hits;
+        std::atomic_ulong misses;
+        std::atomic_ulong insertions;
+        std::atomic_ulong rejections;
+        std::atomic_ulong evictions;
+
+        static size_t entryBytes(const Entry& e) {
+            return e.key.size() + e.value.size() + sizeof(Entry);
+        }
+
+    public:
+        ResultCache(size_t capacityBytes, bool tinyLfu, unsigned numShards);
+        ~ResultCache();
+
+        // Trims the query and collapses runs of whitespace. Case is kept:
+        // QueryParser only takes upper case AND/OR/NOT as operators, and
+        // does not stem capitalised words, so "a AND b" and "a and b" are
+        // different queries
+        static std::string normalize(const char* query);
+
+        bool lookup(const std::string& key, std::string* value);
+        void insert(const std::string& key, const std::string& value);
+
+        void printStats(std::ostream& out);
+};
+
+#endif
@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
+#include <unordered_map>
 
 #include <assert.h>
 #include <unistd.h>
@@ -13,6 +17,10 @@ using namespace std;
 unsigned long Server::numReqsToProcess = 0;
 volatile atomic_ulong Server::numReqsProcessed(0);
 pthread_barrier_t Server::barrier;
+SearchOptions Server::options;
+ResultCache* Server::cache = NULL;
+ShardPool* Server::shardPool = NULL;
+DocCache* Server::docCache = NULL;
 
 Server::Server(int id, string dbPath) 
     : db(dbPath)
@@ -33,6 +41,9 @@ Server::Server(int id, string dbPath)
     parser.set_stemmer(stemmer);
     parser.set_stemming_strategy(Xapian::QueryParser::STEM_SOME);
     parser.set_stopper(&stopper);
+
+    if (options.percentCutoff > 0 || options.weightCutoff > 0)
+        enquire.set_cutoff(options.percentCutoff, options.weightCutoff);
 }
 
 Server::~Server() {
@@ -45,53 +56,149 @@ void Server::_run() {
 
     while (numReqsProcessed < numReqsToProcess) {
        processRequest();
-       ++numReqsProcessed;
+       unsigned long processed = ++numReqsProcessed;
+       if (processed % CACHE_STATS_INTERVAL == 0) {
+           if (cache) cache->printStats(cerr);
+           if (docCache) docCache->printStats(cerr);
+       }
     }
 }
 
 void Server::processRequest() {
-    const unsigned MAX_TERM_LEN = 256;
+    const unsigned MAX_TERM_LEN = 4096; // multi-term queries
     char term[MAX_TERM_LEN];
     void* termPtr;
 
     size_t len = tBenchRecvReq(&termPtr);
+    // The length comes from the client, so a query that does not fit is
+    // failed with an empty response
+    if (len >= MAX_TERM_LEN) {
+        cerr << "Dropping query of " << len << " bytes" << endl;
+        tBenchSendResp("", 0);
+        return;
+    }
     memcpy(reinterpret_cast<void*>(term), termPtr, len);
     term[len] = '\0';
 
+    string key;
+    if (cache) {
+        string cached;
+        key = ResultCache::normalize(term);
+        if (cache->lookup(key, &cached)) {
+            tBenchSendResp(reinterpret_cast<const void*>(cached.data()), \
+                    cached.size());
+            return;
+        }
+    }
+
     unsigned int flags = Xapian::QueryParser::FLAG_DEFAULT;
     Xapian::Query query = parser.parse_query(term, flags);
-    enquire.set_query(query);
-    mset = enquire.get_mset(0, MSET_SIZE);
+
+    std::vector<Xapian::docid> page;
+    search(query, &page);
 
     const unsigned MAX_RES_LEN = 1 << 20;
     char res[MAX_RES_LEN];
 
     unsigned resLen = 0;
-    unsigned doccount = 0;
-    const unsigned MAX_DOC_COUNT = 25; // up to 25 results per page
-    for (auto it = mset.begin(); it != mset.end(); ++it) {
-        std::string desc = it.get_document().get_description();
-        resLen += desc.size();
-        assert(resLen <= MAX_RES_LEN);
+    for (Xapian::docid did : page) {
+        std::string desc = describe(did);
+        assert(resLen + desc.size() <= MAX_RES_LEN);
         memcpy(reinterpret_cast<void*>(&res[resLen]), desc.c_str(), desc.size());
-
-        if (++doccount == MAX_DOC_COUNT) break;
+        resLen += desc.size();
     }
 
+    if (cache) cache->insert(key, string(res, resLen));
+
     tBenchSendResp(reinterpret_cast<void*>(res), resLen);
 }
 
+void Server::search(const Xapian::Query& query, \
+        std::vector<Xapian::docid>* page) {
+    page->clear();
+
+    if (shardPool) {
+        // db is the stub database over all shards, so merged hits index it
+        std::vector<ShardHit> hits;
+        shardPool->search(query, &hits);
+        size_t n = min<size_t>(hits.size(), SearchOptions::RESULTS_PER_PAGE);
+        for (size_t i = 0; i < n; ++i) page->push_back(hits[i].did);
+    } else {
+        enquire.set_query(query);
+        mset = enquire.get_mset(0, options.msetSize, options.checkAtLeast);
+
+        for (auto it = mset.begin(); it != mset.end(); ++it) {
+            page->push_back(*it);
+            if (page->size() == SearchOptions::RESULTS_PER_PAGE) break;
+        }
+    }
+}
+
+string Server::describe(Xapian::docid did) {
+    string desc;
+    if (docCache && docCache->lookup(did, &desc)) return desc;
+
+    desc = db.get_document(did).get_description();
+    if (docCache) docCache->insert(did, desc);
+    return desc;
+}
+
+void Server::warmDocCache(const string& termsFile, unsigned long numDocs) {
+    assert(docCache);
+
+    ifstream fin(termsFile.c_str());
+    if (fin.fail()) {
+        cerr << "Error opening terms file " << termsFile << endl;
+        exit(-1);
+    }
+
+    // Count how often each doc is returned across the terms' result pages
+    unordered_map<Xapian::docid, unsigned long> freqs;
+    std::vector<Xapian::docid> page;
+    string term;
+    unsigned long queries = 0;
+    while (getline(fin, term)) {
+        unsigned int flags = Xapian::QueryParser::FLAG_DEFAULT;
+        search(parser.parse_query(term, flags), &page);
+        for (Xapian::docid did : page) ++freqs[did];
+        ++queries;
+    }
+
+    std::vector<pair<unsigned long, Xapian::docid> > ranked;
+    for (auto& f : freqs) ranked.push_back(make_pair(f.second, f.first));
+    size_t n = min<size_t>(numDocs, ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(), \
+            greater<pair<unsigned long, Xapian::docid> >());
+
+    // Insert the most popular docs last, so they are the last to be evicted
+    for (size_t i = n; i > 0; --i) {
+        Xapian::docid did = ranked[i - 1].second;
+        docCache->insert(did, db.get_document(did).get_description());
+    }
+
+    cerr << "Preloaded " << n << " docs from " << queries << " queries" \
+        << endl;
+}
+
 void* Server::run(void* v) {
     Server* server = static_cast<Server*> (v);
     server->_run();
     return NULL;
 }
 
-void Server::init(unsigned long _numReqsToProcess, unsigned numServers) {
+void Server::init(unsigned long _numReqsToProcess, unsigned numServers, \
+        const SearchOptions& _options, ResultCache* _cache, \
+        DocCache* _docCache, ShardPool* _shardPool) {
     numReqsToProcess = _numReqsToProcess;
+    options = _options;
+    cache = _cache;
+    docCache = _docCache;
+    shardPool = _shardPool;
     pthread_barrier_init(&barrier, NULL, numServers);
 }
 
 void Server::fini() {
+    if (cache) cache->printStats(cerr);
+    if (docCache) docCache->printStats(cerr);
     pthread_barrier_destroy(&barrier);
 }
@@ -6,12 +6,42 @@
 #include <xapian.h>
 #include <vector>
 
+#include "doccache.h"
+#include "resultcache.h"
+#include "shardpool.h"
+
+// Controls how much ranking work each query does. By default the server ranks
+// DEFAULT_MSET_SIZE candidates even though it only returns the first page; in
+// top-k mode it asks Xapian for just that page, which lets the matcher use
+// its max-weight bounds to stop early, and checkAtLeast/cutoffs tune how much
+// extra work it does beyond that.
+struct SearchOptions {
+    static const unsigned int DEFAULT_MSET_SIZE = 20480;
+    static const unsigned int RESULTS_PER_PAGE = 25;
+
+    unsigned msetSize; // candidates ranked per query
+    unsigned checkAtLeast; // documents to consider before stopping early
+    int percentCutoff; // drop results below this % of the top weight
+    double weightCutoff; // drop results below this absolute weight
+
+    SearchOptions()
+        : msetSize(DEFAULT_MSET_SIZE)
+        , checkAtLeast(0)
+        , percentCutoff(0)
+        , weightCutoff(0)
+    {}
+};
+
 class Server {
     private:
         static unsigned long numReqsToProcess;
         static volatile std::atomic_ulong numReqsProcessed;
-        static const unsigned int MSET_SIZE = 20480;
+        static SearchOptions options;
         static pthread_barrier_t barrier;
+        static ResultCache* cache;
+        static ShardPool* shardPool;
+        static DocCache* docCache;
+        static const unsigned long CACHE_STATS_INTERVAL = 100000;
 
         Xapian::Database db;
         Xapian::Enquire enquire;
@@ -25,13 +55,23 @@ class Server {
 
         void _run();
         void processRequest();
+        // Fills page with the docids of the first page of results
+        void search(const Xapian::Query& query,
+                std::vector<Xapian::docid>* page);
+        std::string describe(Xapian::docid did);
 
     public:
         Server(int id, std::string dbPath);
         ~Server();
 
+        // Runs the query for each term in termsFile, and caches the numDocs
+        // docs that appear most often in their result pages
+        void warmDocCache(const std::string& termsFile, unsigned long numDocs);
+
         static void* run(void* v);
-        static void init(unsigned long _numReqsToProcess, unsigned numServers);
+        static void init(unsigned long _numReqsToProcess, unsigned numServers,
+                const SearchOptions& _options, ResultCache* _cache,
+                DocCache* _docCache, ShardPool* _shardPool);
         static void fini();
 };
 
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <assert.h>
+
+#include "server.h"
+#include "shardpool.h"
+
+using namespace std;
+
+static bool hitCmp(const ShardHit& a, const ShardHit& b) {
+    return a.weight > b.weight;
+}
+
+vector<string> ShardPool::readStub(const string& dbPath) {
+    string stubPath = dbPath + "/XAPIANDB";
+    ifstream stub(stubPath.c_str());
+    if (stub.fail()) {
+        cerr << "Can't open stub database " << stubPath << endl;
+        exit(-1);
+    }
+
+    // Each line is "<backend> <path relative to the stub>"
+    vector<string> paths;
+    string line;
+    while (getline(stub, line)) {
+        istringstream ss(line);
+        string type, path;
+        if (!(ss >> type >> path)) continue;
+        paths.push_back(path[0] == '/' ? path : dbPath + "/" + path);
+    }
+
+    return paths;
+}
+
+ShardPool::ShardPool(const string& dbPath, unsigned numWorkers, \
+        const SearchOptions& options, const vector<unsigned>& fanouts)
+    : shardPaths(readStub(dbPath))
+    , options(options)
+    , fanoutByLength(fanouts)
+{
+    if (shardPaths.empty()) {
+        cerr << "No shards listed in " << dbPath << "/XAPIANDB" << endl;
+        exit(-1);
+    }
+
+    pthread_mutex_init(&queueLock, NULL);
+    pthread_cond_init(&queueCond, NULL);
+
+    // Xapian objects are not thread-safe, so every worker opens its own
+    // handles on each shard
+    for (unsigned i = 0; i < numWorkers; ++i) {
+        Worker* w = new Worker();
+        w->pool = this;
+        for (auto& p : shardPaths) w->shards.push_back(Xapian::Database(p));
+        w->groupDbs.resize(numShards());
+        workers.push_back(w);
+    }
+
+    threads.resize(numWorkers);
+    for (unsigned i = 0; i < numWorkers; ++i)
+        pthread_create(&threads[i], NULL, workerMain, workers[i]);
+}
+
+unsigned ShardPool::fanout(Xapian::termcount queryLen) const {
+    unsigned f = numShards();
+    if (!fanoutByLength.empty()) {
+        size_t idx = min<size_t>(max<Xapian::termcount>(queryLen, 1), \
+                fanoutByLength.size()) - 1;
+        f = fanoutByLength[idx];
+    }
+    return max(1u, min(f, numShards()));
+}
+
+void ShardPool::runTask(Worker* w, const Task& t) {
+    vector<Xapian::Database>& groups = w->groupDbs[t.fanout - 1];
+    if (groups.empty()) {
+        groups.resize(t.fanout);
+        for (unsigned s = 0; s < numShards(); ++s)
+            groups[s % t.fanout].add_database(w->shards[s]);
+    }
+
+    // Group j holds shards j, j + F, ..., and Xapian interleaves their
+    // docids the same way the stub database interleaves all shards
+    unsigned groupSize = (numShards() - t.group + t.fanout - 1) / t.fanout;
+
+    Xapian::Enquire enquire(groups[t.group]);
+    enquire.set_query(Xapian::Query::unserialise(*t.query));
+    if (options.percentCutoff > 0 || options.weightCutoff > 0)
+        enquire.set_cutoff(options.percentCutoff, options.weightCutoff);
+    Xapian::MSet mset = enquire.get_mset(0, options.msetSize, \
+            options.checkAtLeast);
+
+    vector<ShardHit>& hits = t.batch->results[t.group];
+    hits.reserve(mset.size());
+    for (auto it = mset.begin(); it != mset.end(); ++it) {
+        Xapian::docid gdid = *it;
+        unsigned shard = t.group + ((gdid - 1) % groupSize) * t.fanout;
+        Xapian::docid sdid = (gdid - 1) / groupSize + 1;
+
+        ShardHit h;
+        h.weight = it.get_weight();
+        h.did = (sdid - 1) * numShards() + shard + 1;
+        hits.push_back(h);
+    }
+
+    pthread_mutex_lock(&t.batch->lock);
+    if (--t.batch->remaining == 0) pthread_cond_signal(&t.batch->done);
+    pthread_mutex_unlock(&t.batch->lock);
+}
+
+void* ShardPool::workerMain(void* v) {
+    Worker* w = static_cast<Worker*>(v);
+    ShardPool* pool = w->pool;
+
+    while (true) {
+        pthread_mutex_lock(&pool->queueLock);
+        while (pool->queue.empty())
+            pthread_cond_wait(&pool->queueCond, &pool->queueLock);
+        Task t = pool->queue.front();
+        pool->queue.pop_front();
+        pthread_mutex_unlock(&pool->queueLock);
+
+        pool->runTask(w, t);
+    }
+
+    return NULL;
+}
+
+void ShardPool::search(const Xapian::Query& query, vector<ShardHit>* hits) {
+    unsigned f = fanout(query.get_length());
+    string serialised = query.serialise();
+
+    Batch batch;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.done, NULL);
+    batch.remaining = f;
+    batch.results.resize(f);
+
+    pthread_mutex_lock(&queueLock);
+    for (unsigned g = 0; g < f; ++g) {
+        Task t = { &batch, f, g, &serialised };
+        queue.push_back(t);
+    }
+    pthread_cond_broadcast(&queueCond);
+    pthread_mutex_unlock(&queueLock);
+
+    pthread_mutex_lock(&batch.lock);
+    while (batch.remaining > 0) pthread_cond_wait(&batch.done, &batch.lock);
+    pthread_mutex_unlock(&batch.lock);
+
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.done);
+
+    hits->clear();
+    for (auto& r : batch.results) hits->insert(hits->end(), r.begin(), r.end());
+
+    size_t k = min<size_t>(hits->size(), options.msetSize);
+    partial_sort(hits->begin(), hits->begin() + k, hits->end(), hitCmp);
+    hits->resize(k);
+}
@@ -0,0 +1,80 @@
+#ifndef __SHARDPOOL_H
+#define __SHARDPOOL_H
+
+#include <deque>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <xapian.h>
+
+struct SearchOptions;
+
+struct ShardHit {
+    double weight;
+    Xapian::docid did; // in the numbering of the combined (stub) database
+};
+
+// Searches a database that has been split into shards by splitDb. A query is
+// fanned out into F tasks (F <= number of shards), each searching a fixed group
+// of shards on a pool of worker threads shared by all Server threads, and the
+// per-group top results are merged by weight. Shard i holds the documents whose
+// combined docid d has (d - 1) % numShards == i, the same interleaving Xapian
+// uses for the stub database, so merged hits can be looked up in it directly.
+//
+// Note that each group is ranked with its own collection statistics; since
+// splitDb assigns documents round-robin, these closely match the global ones.
+class ShardPool {
+    private:
+        struct Batch {
+            pthread_mutex_t lock;
+            pthread_cond_t done;
+            unsigned remaining;
+            std::vector<std::vector<ShardHit> > results;
+        };
+
+        struct Task {
+            Batch* batch;
+            unsigned fanout;
+            unsigned group;
+            const std::string* query; // serialised
+        };
+
+        struct Worker {
+            ShardPool* pool;
+            std::vector<Xapian::Database> shards;
+            // groupDbs[F - 1][j]: shards j, j + F, j + 2F, ... combined
+            std::vector<std::vector<Xapian::Database> > groupDbs;
+        };
+
+        std::vector<std::string> shardPaths;
+        const SearchOptions& options;
+        std::vector<unsigned> fanoutByLength;
+
+        pthread_mutex_t queueLock;
+        pthread_cond_t queueCond;
+        std::deque<Task> queue;
+
+        std::vector<Worker*> workers;
+        std::vector<pthread_t> threads;
+
+        void runTask(Worker* w, const Task& t);
+        static void* workerMain(void* v);
+
+    public:
+        // fanouts[i] is the fanout for queries of i + 1 terms; longer queries
+        // use the last entry. Empty means fan out to every shard.
+        ShardPool(const std::string& dbPath, unsigned numWorkers,
+                const SearchOptions& options,
+                const std::vector<unsigned>& fanouts);
+
+        unsigned numShards() const { return shardPaths.size(); }
+        unsigned fanout(Xapian::termcount queryLen) const;
+
+        // Returns up to options.msetSize hits, highest weight first
+        void search(const Xapian::Query& query, std::vector<ShardHit>* hits);
+
+        // Reads the shard list from a stub database file written by splitDb
+        static std::vector<std::string> readStub(const std::string& dbPath);
+};
+
+#endif
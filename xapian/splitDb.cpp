@@ -0,0 +1,96 @@
+#include <xapian.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+void usage() {
+    cout << "Usage: splitDb -d db -o outDir -s numShards" << endl;
+    exit(-1);
+}
+
+// Splits a database into numShards shards, outDir/shard<i>, assigning document
+// d to shard (d - 1) % numShards. Also writes outDir/XAPIANDB, a stub database
+// that opens all shards as one, with the same docids as the original database
+// (if its docids are contiguous).
+int main(int argc, char* argv[]) {
+    char* dbPath = NULL;
+    string outDir;
+    unsigned numShards = 0;
+
+    int c;
+    string optString = "d:o:s:";
+    while ((c = getopt(argc, argv, optString.c_str())) != -1) {
+        switch (c) {
+            case 'd':
+                dbPath = optarg;
+                break;
+
+            case 'o':
+                outDir = optarg;
+                break;
+
+            case 's':
+                numShards = atoi(optarg);
+                break;
+
+            default:
+                cerr << "Unknown option: " << optopt << endl;
+                usage();
+                break;
+        }
+    }
+
+    if (!dbPath || outDir.empty() || numShards == 0) usage();
+
+    Xapian::Database db;
+    try {
+        db.add_database(Xapian::Database(dbPath));
+    }
+    catch (const Xapian::Error& e) {
+        cerr << "Error opening database: " << e.get_msg() << endl;
+        usage();
+    }
+
+    mkdir(outDir.c_str(), 0755);
+
+    vector<Xapian::WritableDatabase> shards;
+    ofstream stub((outDir + "/XAPIANDB").c_str());
+    for (unsigned s = 0; s < numShards; ++s) {
+        stringstream name;
+        name << "shard" << s;
+        shards.push_back(Xapian::WritableDatabase(outDir + "/" + name.str(), \
+                    Xapian::DB_CREATE_OR_OVERWRITE));
+        stub << "auto " << name.str() << endl;
+    }
+    stub.close();
+
+    const unsigned long COMMIT_INTERVAL = 100000;
+    unsigned long count = 0;
+
+    // Iterating the postlist of the empty term visits every document
+    for (Xapian::PostingIterator it = db.postlist_begin(""); \
+            it != db.postlist_end(""); ++it) {
+        Xapian::docid did = *it;
+        Xapian::WritableDatabase& shard = shards[(did - 1) % numShards];
+        shard.replace_document((did - 1) / numShards + 1, db.get_document(did));
+
+        if (++count % COMMIT_INTERVAL == 0) {
+            for (auto& s : shards) s.commit();
+            cerr << "count = " << count << endl;
+        }
+    }
+
+    for (auto& s : shards) s.commit();
+
+    cerr << "Split " << count << " documents into " << numShards \
+        << " shards" << endl;
+
+    return 0;
+}